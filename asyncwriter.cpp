@@ -0,0 +1,150 @@
+#include "asyncwriter.h"
+
+#include <algorithm>
+#include <chrono>
+
+// ================= AsyncWriteJob =================
+
+int AsyncWriteJob::wait(int timeoutMs) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (timeoutMs < 0) {
+    _cv.wait(lock, [this] { return _done; });
+  } else if (!_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                           [this] { return _done; })) {
+    return kPending;
+  }
+  return _result;
+}
+
+bool AsyncWriteJob::done() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _done;
+}
+
+void AsyncWriteJob::complete(int result) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _result = result;
+    _done = true;
+  }
+  _cv.notify_all();
+}
+
+// ================= AsyncWriteQueue =================
+
+AsyncWriteQueue &AsyncWriteQueue::getInstance() {
+  static AsyncWriteQueue instance;
+  return instance;
+}
+
+AsyncWriteQueue::~AsyncWriteQueue() { shutdown(); }
+
+void AsyncWriteQueue::setMaxInFlight(int n) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxInFlight = std::max(1, n);
+  }
+  _cvSlots.notify_all();
+}
+
+int AsyncWriteQueue::maxInFlight() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _maxInFlight;
+}
+
+std::shared_ptr<AsyncWriteJob>
+AsyncWriteQueue::submit(const std::function<Task()> &prepare,
+                        Callback callback) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cvSlots.wait(lock, [this] { return _inFlight < _maxInFlight; });
+    ++_inFlight;
+    // I/O 线程按需启动（shutdown 后再次提交也会重新启动）
+    if (!_thread.joinable()) {
+      _stop = false;
+      _thread = std::thread(&AsyncWriteQueue::run, this);
+    }
+  }
+
+  // 入队前任何一步失败（放弃、prepare 抛异常、分配失败）都归还占位，
+  // 否则占位泄漏，之后的 submit 会一直等空位
+  struct SlotGuard {
+    AsyncWriteQueue *queue;
+    ~SlotGuard() {
+      if (queue)
+        queue->releaseSlot();
+    }
+  } guard{this};
+
+  // 占位后再准备数据，拷贝份数不超过上限
+  Task task = prepare ? prepare() : Task();
+  if (!task)
+    return nullptr;
+
+  auto job = std::make_shared<AsyncWriteJob>();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queue.push_back({std::move(task), std::move(callback), job});
+  }
+  guard.queue = nullptr; // 占位交给 I/O 线程归还
+  _cvWork.notify_one();
+  return job;
+}
+
+void AsyncWriteQueue::run() {
+  for (;;) {
+    Entry entry;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cvWork.wait(lock, [this] { return _stop || !_queue.empty(); });
+      if (_queue.empty())
+        return; // _stop 且已写完
+      entry = std::move(_queue.front());
+      _queue.pop_front();
+    }
+
+    // 异常不能逃出 I/O 线程（会 std::terminate），记为任务失败
+    int result;
+    try {
+      result = entry.task();
+    } catch (...) {
+      result = AsyncWriteJob::kFailed;
+    }
+    entry.task = nullptr; // 先释放拷贝的数据，再回调
+    // 回调先于完成标记：wait 返回后回调不会再访问调用方数据
+    if (entry.callback) {
+      try {
+        entry.callback(result);
+      } catch (...) {
+        // 回调失败不影响任务结果，等待方仍要被唤醒
+      }
+    }
+    entry.job->complete(result);
+    releaseSlot();
+  }
+}
+
+void AsyncWriteQueue::releaseSlot() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    --_inFlight;
+  }
+  _cvSlots.notify_all();
+}
+
+void AsyncWriteQueue::waitAll() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cvSlots.wait(lock, [this] { return _inFlight == 0; });
+}
+
+void AsyncWriteQueue::shutdown() {
+  std::thread thread;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+    thread = std::move(_thread);
+  }
+  _cvWork.notify_all();
+  if (thread.joinable())
+    thread.join();
+}
@@ -0,0 +1,83 @@
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// ---------------- 异步写出 ----------------
+// 单个 I/O 线程按提交顺序执行写任务；未完成的任务数有上限，
+// 超过时 submit 阻塞（背压），默认 2 即双缓冲：写第 N 页时可准备第 N+1 页
+
+class AsyncWriteJob {
+public:
+  static constexpr int kPending = 1;
+  static constexpr int kFailed = -6; // 写任务抛出异常
+
+  // timeoutMs < 0 无限等待；返回任务结果，超时返回 kPending
+  int wait(int timeoutMs = -1);
+  bool done() const;
+
+private:
+  friend class AsyncWriteQueue;
+  void complete(int result);
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _done = false;
+  int _result = 0;
+};
+
+class AsyncWriteQueue {
+public:
+  using Task = std::function<int()>;
+  using Callback = std::function<void(int result)>;
+
+  static AsyncWriteQueue &getInstance();
+
+  // 先等到有空位，再在调用线程执行 prepare（拷贝数据等），
+  // 返回的任务交给 I/O 线程；prepare 返回空任务时放弃并返回 nullptr，
+  // prepare 抛出的异常原样传给调用方。两种情况占位都会归还。
+  // 任务在 I/O 线程抛出异常时按 AsyncWriteJob::kFailed 完成
+  std::shared_ptr<AsyncWriteJob> submit(const std::function<Task()> &prepare,
+                                        Callback callback = nullptr);
+
+  // 未完成任务上限（排队 + 正在写），至少 1
+  void setMaxInFlight(int n);
+  int maxInFlight() const;
+
+  // 等待所有已提交任务完成
+  void waitAll();
+  // 写完剩余任务并结束 I/O 线程；之后仍可再次 submit，但不能与 submit 并发
+  void shutdown();
+
+  ~AsyncWriteQueue();
+
+private:
+  AsyncWriteQueue() = default;
+  AsyncWriteQueue(const AsyncWriteQueue &) = delete;
+  AsyncWriteQueue &operator=(const AsyncWriteQueue &) = delete;
+
+  struct Entry {
+    Task task;
+    Callback callback;
+    std::shared_ptr<AsyncWriteJob> job;
+  };
+
+  void run();
+  void releaseSlot();
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cvWork;  // I/O 线程等任务
+  std::condition_variable _cvSlots; // 提交方等空位 / waitAll
+  std::deque<Entry> _queue;
+  std::thread _thread;
+  int _maxInFlight = 2;
+  int _inFlight = 0; // 已占位（含准备中、排队、正在写）
+  bool _stop = false;
+};
+
+#endif // ASYNCWRITER_H
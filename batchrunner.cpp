@@ -0,0 +1,408 @@
+#include "batchrunner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include <tiffio.h>
+
+#include "taskpool.h"
+#include "utils.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// 整数或名称；类型不符或名称未知返回 false
+bool parseMethod(const nlohmann::json &v, BlacknessMethod &method) {
+  if (v.is_number_integer()) {
+    const int64_t m = v.get<int64_t>();
+    if (m < 0 || m > static_cast<int>(BlacknessMethod::MAX_CHANNEL))
+      return false;
+    method = static_cast<BlacknessMethod>(m);
+    return true;
+  }
+  if (!v.is_string())
+    return false;
+  const std::string s = v.get<std::string>();
+  if (s == "GRAY")
+    method = BlacknessMethod::GRAY;
+  else if (s == "DARK_NEUTRAL")
+    method = BlacknessMethod::DARK_NEUTRAL;
+  else if (s == "MAX_CHANNEL")
+    method = BlacknessMethod::MAX_CHANNEL;
+  else
+    return false;
+  return true;
+}
+
+// COMPRESSION_* 数值或名称（"source" 沿用源文件）；类型不符或名称未知返回 false
+bool parseCompression(const nlohmann::json &v, int &compression) {
+  if (v.is_number_integer()) {
+    const int64_t c = v.get<int64_t>();
+    if (c < -1 || c > 0xffff)
+      return false;
+    compression = static_cast<int>(c);
+    return true;
+  }
+  if (!v.is_string())
+    return false;
+  std::string s = v.get<std::string>();
+  std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+  if (s == "none")
+    compression = COMPRESSION_NONE;
+  else if (s == "lzw")
+    compression = COMPRESSION_LZW;
+  else if (s == "deflate" || s == "zip")
+    compression = COMPRESSION_ADOBE_DEFLATE;
+  else if (s == "packbits")
+    compression = COMPRESSION_PACKBITS;
+  else if (s == "source")
+    compression = -1;
+  else
+    return false;
+  return true;
+}
+
+const char *methodName(BlacknessMethod m) {
+  switch (m) {
+  case BlacknessMethod::GRAY:
+    return "GRAY";
+  case BlacknessMethod::DARK_NEUTRAL:
+    return "DARK_NEUTRAL";
+  case BlacknessMethod::MAX_CHANNEL:
+    return "MAX_CHANNEL";
+  }
+  return "";
+}
+
+int64_t fileSize(const std::string &path) {
+  std::error_code ec;
+  const uintmax_t size = fs::file_size(path, ec);
+  return ec ? -1 : static_cast<int64_t>(size);
+}
+
+// 各页像素数之和；打不开返回 -1
+int64_t tiffPixels(const std::string &path, int &pages) {
+  pages = 0;
+  TIFF *tif = TIFFOpen(path.c_str(), "r");
+  if (!tif)
+    return -1;
+  int64_t pixels = 0;
+  do {
+    uint32_t w = 0, h = 0;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+    pixels += int64_t(w) * h;
+    ++pages;
+  } while (TIFFReadDirectory(tif));
+  TIFFClose(tif);
+  return pixels;
+}
+
+} // namespace
+
+int readPageParams(const nlohmann::json &j, TiffPageParams &params) {
+  if (j.is_null())
+    return 0;
+  if (!j.is_object())
+    return -1;
+  if (j.contains("method") && !parseMethod(j["method"], params.method))
+    return -1;
+  if (!readJsonField(j, "blacknessThresh", params.blacknessThresh) ||
+      !readJsonField(j, "noiseArea", params.noiseThresh) ||
+      !readJsonField(j, "whiteOffset", params.whiteOffset))
+    return -1;
+  if (j.contains("compression") &&
+      !parseCompression(j["compression"], params.compression))
+    return -1;
+  return 0;
+}
+
+int readCacheConfig(const nlohmann::json &j, ResultCacheConfig &config) {
+  if (j.is_null())
+    return 0;
+  if (j.is_string()) {
+    config.dir = j.get<std::string>();
+    return 0;
+  }
+  if (!j.is_object())
+    return -1;
+  int64_t maxMB = config.maxBytes >> 20;
+  if (!readJsonField(j, "dir", config.dir) ||
+      !readJsonField(j, "maxMB", maxMB) ||
+      !readJsonField(j, "hardlink", config.allowHardlink))
+    return -1;
+  // 左移 20 位不能溢出
+  if (maxMB <= 0 || maxMB > (INT64_MAX >> 20))
+    return -1;
+  config.maxBytes = maxMB << 20;
+  return 0;
+}
+
+int64_t estimateTiffMemory(const std::string &path) {
+  TIFF *tif = TIFFOpen(path.c_str(), "r");
+  if (!tif)
+    return -1;
+  // 解码后的原始数据、输出（+3 通道）、BGR、黑度、补白等中间结果
+  int64_t peak = 0;
+  do {
+    uint32_t w = 0, h = 0;
+    uint16_t spp = 1, bps = 8;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+    const int64_t pixels = int64_t(w) * h;
+    const int64_t bytes = (bps + 7) / 8;
+    peak = std::max(peak, pixels * (bytes * (2 * spp + 3) + 8));
+  } while (TIFFReadDirectory(tif));
+  TIFFClose(tif);
+  return peak;
+}
+
+// ---------------- BatchRunner ----------------
+
+int BatchRunner::load(const std::string &manifestPath) {
+  std::ifstream in(manifestPath);
+  if (!in)
+    return -1;
+  nlohmann::json j = nlohmann::json::parse(in, nullptr, false);
+  if (j.is_discarded())
+    return -2;
+
+  // 清单级字段类型不符整份清单无效（-4）；作业内的只让该作业失败
+  nlohmann::json defaults, jobs;
+  if (j.is_array()) {
+    jobs = j;
+  } else if (j.is_object()) {
+    defaults = j.value("defaults", nlohmann::json::object());
+    jobs = j.value("jobs", nlohmann::json::array());
+    _parallel = 0;
+    _reportPath.clear();
+    if (!jobs.is_array() || !readJsonField(j, "parallel", _parallel) ||
+        !readJsonField(j, "report", _reportPath))
+      return -4;
+  } else {
+    return -2;
+  }
+
+  TiffPageParams base;
+  std::string baseTemplate;
+  if (readPageParams(defaults, base) != 0 ||
+      !readJsonField(defaults, "template", baseTemplate))
+    return -4;
+
+  // 相对路径按清单所在目录解析
+  const fs::path dir = fs::path(manifestPath).parent_path();
+  auto resolve = [&](const std::string &p) {
+    return p.empty() || fs::path(p).is_absolute() ? p : (dir / p).string();
+  };
+  if (!_reportPath.empty())
+    _reportPath = resolve(_reportPath);
+
+  ResultCacheConfig cache;
+  if (j.is_object() &&
+      readCacheConfig(j.value("cache", nlohmann::json()), cache) != 0)
+    return -4;
+  cache.dir = resolve(cache.dir);
+  _cache = cache.dir.empty() ? nullptr : std::make_unique<ResultCache>(cache);
+
+  _jobs.clear();
+  for (const auto &item : jobs) {
+    if (!item.is_object())
+      return -3;
+    BatchJob job;
+    std::string input, output, templatePath = baseTemplate;
+    // 逐个读，某个字段有误时其余字段仍写进报告
+    bool typed = readJsonField(item, "input", input);
+    typed = readJsonField(item, "output", output) && typed;
+    typed = readJsonField(item, "template", templatePath) && typed;
+    job.input = resolve(input);
+    job.output = resolve(output);
+    if (typed && (job.input.empty() || job.output.empty()))
+      return -3;
+    job.params = base;
+    // 参数有误的作业不运行，报告中记为失败
+    if (!typed || readPageParams(item, job.params) != 0)
+      job.stages.params = -4;
+    job.templatePath = resolve(templatePath);
+    _jobs.push_back(std::move(job));
+  }
+  return 0;
+}
+
+const PsTemplateRegistry &BatchRunner::templates(const std::string &path) {
+  std::unique_ptr<PsTemplateRegistry> &reg = _templates[path];
+  if (!reg) {
+    reg = std::make_unique<PsTemplateRegistry>();
+    std::error_code ec;
+    if (fs::is_directory(path, ec))
+      reg->loadDirectory(path);
+    else if (!path.empty())
+      reg->add(path);
+  }
+  return *reg;
+}
+
+int BatchRunner::run() {
+  const Clock::time_point t0 = Clock::now();
+
+  // 模板先在本线程加载好，作业里只读；按像素量从大到小排调度顺序
+  std::vector<size_t> order(_jobs.size());
+  std::vector<const PsTemplateRegistry *> registry(_jobs.size());
+  for (size_t i = 0; i < _jobs.size(); ++i) {
+    BatchJob &job = _jobs[i];
+    order[i] = i;
+    if (job.stages.params != 0)
+      continue; // 参数有误，不运行
+    registry[i] = &templates(job.templatePath);
+    job.pixels = tiffPixels(job.input, job.pages);
+    job.inputBytes = fileSize(job.input);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return _jobs[a].pixels > _jobs[b].pixels;
+  });
+
+  // 同时处理的文件数：页内各阶段本身就在线程池上并行，默认只开两路，
+  // 让一个文件的串行部分（读 / 写）与另一个文件的计算重叠
+  int parallel = _parallel > 0 ? _parallel : 2;
+  parallel =
+      std::clamp(parallel, 1, std::max(1, static_cast<int>(_jobs.size())));
+
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (;;) {
+      const size_t k = next.fetch_add(1);
+      if (k >= order.size() || taskCancelled())
+        break;
+      const size_t i = order[k];
+      BatchJob &job = _jobs[i];
+      job.queuedMs = msSince(t0);
+      const Clock::time_point start = Clock::now();
+
+      // 单个作业抛异常按失败记录后继续：漏到 TaskGroup 会取消其余作业，
+      // 也就写不出报告
+      try {
+        std::error_code ec;
+        const fs::path outDir = fs::path(job.output).parent_path();
+        if (job.stages.params != 0) {
+          job.result = job.stages.params;
+        } else if (job.pixels < 0) {
+          job.result = job.stages.open = -1; // 打不开
+        } else if (!outDir.empty() && !fs::create_directories(outDir, ec) &&
+                   ec) {
+          job.result = job.stages.outputDir = -5;
+        } else {
+          // 文件内逐页处理，页内各阶段在线程池上并行
+          job.result = processWithCache(
+              _cache.get(), job.input, job.output, job.params, *registry[i],
+              [&](const std::string &dst) {
+                return tiffProcess::getInstance().genernateMultiPageTiff(
+                    job.input, dst, {}, job.params, *registry[i], 1,
+                    &job.stages.tiff);
+              },
+              &job.cached);
+        }
+      } catch (...) {
+        job.result = -6;
+      }
+      job.elapsedMs = msSince(start);
+      job.outputBytes = job.result == 0 ? fileSize(job.output) : -1;
+      job.done = true;
+      DEBUG << "[Batch]" << job.input.c_str() << "->" << job.result
+            << job.elapsedMs << "ms";
+    }
+  };
+
+  TaskGroup group;
+  for (int i = 0; i < parallel; ++i)
+    group.run(worker);
+  group.wait();
+  _wallMs = msSince(t0);
+
+  int failed = 0;
+  for (const BatchJob &job : _jobs)
+    failed += (!job.done || job.result != 0) ? 1 : 0;
+  return failed;
+}
+
+int BatchRunner::writeReport(const std::string &path) const {
+  const std::string target = path.empty() ? _reportPath : path;
+  if (target.empty())
+    return -1;
+
+  nlohmann::json jobs = nlohmann::json::array();
+  int ok = 0, cached = 0;
+  for (const BatchJob &job : _jobs) {
+    const char *status =
+        !job.done ? "skipped" : (job.result == 0 ? "ok" : "failed");
+    ok += (job.done && job.result == 0) ? 1 : 0;
+    cached += job.cached ? 1 : 0;
+    nlohmann::json r;
+    r["input"] = job.input;
+    r["output"] = job.output;
+    r["status"] = status;
+    r["error"] = job.result;
+    nlohmann::json stages;
+    stages["params"] = job.stages.params;
+    stages["open"] = job.stages.open;
+    stages["outputDir"] = job.stages.outputDir;
+    stages["read"] = job.stages.tiff.read;
+    stages["process"] = job.stages.tiff.process;
+    stages["resources"] = job.stages.tiff.resources;
+    stages["write"] = job.stages.tiff.write;
+    r["stages"] = stages;
+    r["failedPage"] = job.stages.tiff.failedPage;
+    r["cached"] = job.cached;
+    r["method"] = methodName(job.params.method);
+    r["blacknessThresh"] = job.params.blacknessThresh;
+    r["noiseArea"] = job.params.noiseThresh;
+    r["compression"] = job.params.compression;
+    r["pages"] = job.pages;
+    r["pixels"] = job.pixels;
+    r["queuedMs"] = job.queuedMs;
+    r["elapsedMs"] = job.elapsedMs;
+    r["inputBytes"] = job.inputBytes;
+    r["outputBytes"] = job.outputBytes;
+    jobs.push_back(r);
+  }
+
+  nlohmann::json report;
+  report["total"] = _jobs.size();
+  report["ok"] = ok;
+  report["cached"] = cached;
+  report["failed"] = static_cast<int>(_jobs.size()) - ok;
+  report["wallMs"] = _wallMs;
+  report["threads"] = TaskPool::getInstance().workers();
+  report["jobs"] = jobs;
+
+  std::ofstream out(target);
+  if (!out)
+    return -2;
+  out << report.dump(2) << "\n";
+  return out ? 0 : -3;
+}
+
+int runBatch(const std::string &manifestPath, const std::string &reportPath) {
+  BatchRunner runner;
+  int res = runner.load(manifestPath);
+  if (res != 0) {
+    DEBUG << "[Batch] bad manifest" << manifestPath.c_str() << res;
+    return res;
+  }
+  const int failed = runner.run();
+  res = runner.writeReport(reportPath);
+  if (res != 0)
+    DEBUG << "[Batch] cannot write report" << res;
+  DEBUG << "[Batch] finished," << failed << "failed";
+  return failed == 0 && res == 0 ? 0 : 1;
+}
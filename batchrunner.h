@@ -0,0 +1,137 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "pstemplate.h"
+#include "resultcache.h"
+#include "tiffprocess.h"
+
+// ---------------- 批量作业 ----------------
+// 读取 JSON 作业清单，各文件参数独立，在共用线程池上并行处理，输出 JSON 报告。
+// 清单：
+//   {
+//     "defaults": { "method": "DARK_NEUTRAL", "blacknessThresh": 235,
+//                   "noiseArea": 0, "whiteOffset": 0,
+//                   "template": "templates", "compression": "lzw" },
+//     "parallel": 2,              // 同时处理的文件数，<= 0 自动
+//     "report": "report.json",    // 命令行未指定报告路径时使用
+//     "cache": { "dir": "cache", "maxMB": 20480, "hardlink": false },
+//     "jobs": [ { "input": "a.tif", "output": "out/a.tif", ... }, ... ]
+//   }
+// 也可以直接是 jobs 数组。作业按像素量从大到小调度，减少最后只剩一个大文件在跑的长尾。
+// 报告中每个作业有状态、最终错误码和各阶段（params / open / outputDir / read /
+// process / resources / write）的错误码、排队 / 处理耗时和输入输出大小。
+
+// 读取对象 j 的 key 字段到 value：键不存在时保持原值并返回 true；
+// 类型不符（整数超出 T 的范围也算）返回 false，不抛 json::type_error
+template <typename T>
+bool readJsonField(const nlohmann::json &j, const char *key, T &value) {
+  const auto it = j.find(key);
+  if (it == j.end())
+    return true;
+  if constexpr (std::is_same_v<T, bool>) {
+    if (!it->is_boolean())
+      return false;
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    if (!it->is_string())
+      return false;
+  } else {
+    static_assert(std::is_integral_v<T>, "unsupported field type");
+    if (!it->is_number_integer())
+      return false;
+    using Limits = std::numeric_limits<T>;
+    if (it->is_number_unsigned()) {
+      if (it->get<uint64_t>() > static_cast<uint64_t>(Limits::max()))
+        return false;
+    } else {
+      const int64_t v = it->get<int64_t>();
+      if (v < static_cast<int64_t>(Limits::min()) ||
+          (v > 0 && static_cast<uint64_t>(v) >
+                        static_cast<uint64_t>(Limits::max())))
+        return false;
+    }
+  }
+  value = it->get<T>();
+  return true;
+}
+
+// JSON 中的处理参数（method / blacknessThresh / noiseArea / whiteOffset /
+// compression），缺少的键保持 params 原值；j 为 null 时什么都不读。
+// 字段类型不符或取值无效返回 -1
+int readPageParams(const nlohmann::json &j, TiffPageParams &params);
+
+// JSON 中的缓存配置："cache": "<dir>" 或 { "dir", "maxMB", "hardlink" }
+// （hardlink 默认 false，见 resultcache.h）；
+// 字段类型不符或取值无效返回 -1
+int readCacheConfig(const nlohmann::json &j, ResultCacheConfig &config);
+
+// 处理一个文件的估算峰值内存（逐页处理，取最大的一页）；打不开返回 -1
+int64_t estimateTiffMemory(const std::string &path);
+
+// 作业各阶段的返回码，成功或未执行为 0
+struct BatchStageCodes {
+  int params = 0;      // 清单中本作业的字段（类型不符为 -4，作业不运行）
+  int open = 0;        // 打开输入
+  int outputDir = 0;   // 创建输出目录
+  TiffStageCodes tiff; // 逐页读取 / 处理 / 选资源 / 写出
+};
+
+struct BatchJob {
+  std::string input;
+  std::string output;
+  std::string templatePath; // 模板文件或目录，为空不用模板
+  TiffPageParams params;
+
+  // ---- 结果 ----
+  int64_t pixels = 0; // 各页像素数之和，用于调度；打不开为 -1
+  int result = 0;
+  BatchStageCodes stages;
+  bool done = false;
+  bool cached = false; // 结果直接取自缓存
+  int pages = 0;
+  double queuedMs = 0; // 批处理开始到该作业开始
+  double elapsedMs = 0;
+  int64_t inputBytes = 0;
+  int64_t outputBytes = 0;
+};
+
+class BatchRunner {
+public:
+  // 读取清单，失败返回负数
+  int load(const std::string &manifestPath);
+
+  // 运行全部作业，返回失败的作业数
+  int run();
+
+  // 写 JSON 报告（path 为空时用清单中的 report）
+  int writeReport(const std::string &path = {}) const;
+
+  const std::vector<BatchJob> &jobs() const { return _jobs; }
+
+private:
+  const PsTemplateRegistry &templates(const std::string &path);
+
+  std::vector<BatchJob> _jobs;
+  int _parallel = 0;
+  std::string _reportPath;
+  double _wallMs = 0;
+  std::unique_ptr<ResultCache> _cache;
+
+  // 同一模板路径只加载一次，各作业只读共享
+  std::map<std::string, std::unique_ptr<PsTemplateRegistry>> _templates;
+};
+
+// 命令行入口：读取清单、运行并写报告；全部成功返回 0
+int runBatch(const std::string &manifestPath,
+             const std::string &reportPath = {});
+
+#endif // BATCHRUNNER_H
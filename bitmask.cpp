@@ -0,0 +1,544 @@
+#include "bitmask.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+
+#include "taskpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BITMASK_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+inline int ctz64(uint64_t v) {
+#if defined(_MSC_VER)
+  unsigned long idx;
+  _BitScanForward64(&idx, v);
+  return static_cast<int>(idx);
+#else
+  return __builtin_ctzll(v);
+#endif
+}
+
+// 行末字中有效位的掩码
+inline uint64_t tailMask(int width) {
+  const int rem = width & 63;
+  return rem ? (~0ULL >> (64 - rem)) : ~0ULL;
+}
+
+// 从位缓冲的第 pos 位起取 64 位（可跨字）
+inline uint64_t read64(const uint64_t *bits, int64_t pos) {
+  const size_t w = static_cast<size_t>(pos >> 6);
+  const int b = static_cast<int>(pos & 63);
+  return b ? (bits[w] >> b) | (bits[w + 1] << (64 - b)) : bits[w];
+}
+
+// 把 src 的前 n 位写到 dst 的第 x0 位起，其余位不变
+void copyBits(const uint64_t *src, int n, uint64_t *dst, int x0) {
+  for (int i = 0; i * 64 < n; ++i) {
+    const int len = std::min(64, n - i * 64);
+    const uint64_t mask = len == 64 ? ~0ULL : (1ULL << len) - 1;
+    const uint64_t val = src[i] & mask;
+    const int p = x0 + i * 64;
+    const size_t w = static_cast<size_t>(p >> 6);
+    const int b = p & 63;
+    dst[w] = (dst[w] & ~(mask << b)) | (val << b);
+    if (b && b + len > 64)
+      dst[w + 1] =
+          (dst[w + 1] & ~(mask >> (64 - b))) | (val >> (64 - b));
+  }
+}
+
+// 一行 n 个字节压成位：kNonZero 时取 != 0，否则取 <= thresh
+template <bool kNonZero>
+void packRowImpl(const uint8_t *src, int n, uint8_t thresh, uint64_t *dst) {
+  const int full = n / 64;
+#ifdef BITMASK_SSE2
+  const __m128i t = _mm_set1_epi8(static_cast<char>(thresh));
+  const __m128i zero = _mm_setzero_si128();
+  for (int i = 0; i < full; ++i) {
+    uint64_t w = 0;
+    for (int k = 0; k < 4; ++k) {
+      const __m128i v = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(src + i * 64 + k * 16));
+      // 无符号 v <= t 等价于 min(v, t) == v
+      const int m =
+          kNonZero ? ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xFFFF
+                   : _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, t), v));
+      w |= static_cast<uint64_t>(m) << (16 * k);
+    }
+    dst[i] = w;
+  }
+#else
+  for (int i = 0; i < full; ++i) {
+    const uint8_t *s = src + i * 64;
+    uint64_t w = 0;
+    for (int k = 0; k < 64; ++k)
+      w |= static_cast<uint64_t>(kNonZero ? s[k] != 0 : s[k] <= thresh) << k;
+    dst[i] = w;
+  }
+#endif
+  if (n % 64) {
+    const uint8_t *s = src + full * 64;
+    uint64_t w = 0;
+    for (int k = 0; k < n % 64; ++k)
+      w |= static_cast<uint64_t>(kNonZero ? s[k] != 0 : s[k] <= thresh) << k;
+    dst[full] = w;
+  }
+}
+
+template <bool kNonZero>
+int packMat(const cv::Mat &src, uint8_t thresh, BitMask &dst,
+            cv::Point origin) {
+  if (src.empty() || src.type() != CV_8UC1)
+    return -1;
+  if (dst.empty()) {
+    if (origin != cv::Point())
+      return -2;
+    dst.create(src.cols, src.rows);
+  }
+  if (origin.x < 0 || origin.y < 0 || origin.x + src.cols > dst.width() ||
+      origin.y + src.rows > dst.height())
+    return -2;
+
+  // 整行对齐时直接写，否则先压到临时行再按位拷贝
+  const bool direct = origin.x == 0 && src.cols == dst.width();
+  parallelFor(cv::Range(0, src.rows), [&](const cv::Range &range) {
+    std::vector<uint64_t> tmp(direct ? 0 : (src.cols + 63) / 64);
+    for (int y = range.start; y < range.end; ++y) {
+      uint64_t *d = dst.row(origin.y + y);
+      if (direct) {
+        packRowImpl<kNonZero>(src.ptr<uint8_t>(y), src.cols, thresh, d);
+      } else {
+        packRowImpl<kNonZero>(src.ptr<uint8_t>(y), src.cols, thresh, tmp.data());
+        copyBits(tmp.data(), src.cols, d, origin.x);
+      }
+    }
+  });
+  return 0;
+}
+
+// ---------------- 形态学 ----------------
+
+struct BitOr {
+  static constexpr uint64_t fill = 0; // 膨胀时图外视为背景
+  static uint64_t apply(uint64_t a, uint64_t b) { return a | b; }
+};
+
+struct BitAnd {
+  static constexpr uint64_t fill = ~0ULL; // 腐蚀时图外视为前景
+  static uint64_t apply(uint64_t a, uint64_t b) { return a & b; }
+};
+
+// 一行左右各扩 margin 个字（填 Op::fill），末字无效位也置为 fill，
+// 之后可按任意位移读取；fill 是 Op 的单位元，图外不影响结果
+template <typename Op>
+void extendRow(const uint64_t *bits, size_t words, int width, int margin,
+               uint64_t *ext) {
+  std::fill(ext, ext + margin, Op::fill);
+  std::copy(bits, bits + words, ext + margin);
+  ext[margin + words - 1] |= Op::fill & ~tailMask(width);
+  std::fill(ext + margin + words, ext + 2 * margin + words, Op::fill);
+}
+
+// 扩展行中以 shift 位移读出的第 i 个字：对应原行第 i*64 + shift 位起
+inline uint64_t shiftedWord(const uint64_t *ext, int margin, size_t i,
+                            int shift) {
+  return read64(ext, static_cast<int64_t>(margin + i) * 64 + shift);
+}
+
+// dst(x, y) = src(x + x1, y + y1) op src(x + x2, y + y2)，dst 尺寸可小于 src
+template <typename Op>
+void shiftCombine(const BitMask &src, BitMask &dst, int x1, int y1, int x2,
+                  int y2) {
+  const int w = src.width(), h = src.height();
+  const size_t words = src.wordsPerRow();
+  const size_t dstWords = dst.wordsPerRow();
+  const int margin = (std::max(std::abs(x1), std::abs(x2)) + 63) / 64 + 1;
+
+  parallelFor(cv::Range(0, dst.height()), [&](const cv::Range &range) {
+    std::vector<uint64_t> e1(words + 2 * margin), e2(words + 2 * margin);
+    for (int y = range.start; y < range.end; ++y) {
+      const bool in1 = y + y1 >= 0 && y + y1 < h;
+      const bool in2 = y + y2 >= 0 && y + y2 < h;
+      if (in1)
+        extendRow<Op>(src.row(y + y1), words, w, margin, e1.data());
+      if (in2)
+        extendRow<Op>(src.row(y + y2), words, w, margin, e2.data());
+
+      uint64_t *d = dst.row(y);
+      for (size_t i = 0; i < dstWords; ++i) {
+        const uint64_t a = in1 ? shiftedWord(e1.data(), margin, i, x1) : Op::fill;
+        const uint64_t b = in2 ? shiftedWord(e2.data(), margin, i, x2) : Op::fill;
+        d[i] = Op::apply(a, b);
+      }
+      d[dstWords - 1] &= tailMask(dst.width());
+    }
+  });
+}
+
+// 方向 (dx, dy) 上半长 r 的线段滤波。
+// 倍增：R_s(p) 覆盖 p .. p+(s-1)·dir，R_2s(p) = R_s(p) op R_s(p + s·dir)，
+// 最后两段 R_s 重叠拼成长度 2r+1 并居中，共 log2(2r+1) 次整幅移位。
+// 起点在图外的窗口也会用到，所以先沿线段方向四周各扩 r 个像素
+template <typename Op>
+void bitLineFilter(const BitMask &src, BitMask &dst, int r, int dx, int dy) {
+  const int len = 2 * r + 1;
+  const int ox = r * std::abs(dx), oy = r * std::abs(dy);
+  BitMask a(src.width() + 2 * ox, src.height() + 2 * oy, Op::fill != 0);
+  for (int y = 0; y < src.height(); ++y)
+    copyBits(src.row(y), src.width(), a.row(y + oy), ox);
+
+  BitMask b(a.width(), a.height());
+  int s = 1;
+  while (2 * s <= len) {
+    shiftCombine<Op>(a, b, 0, 0, s * dx, s * dy);
+    std::swap(a, b);
+    s *= 2;
+  }
+  const int k1 = -r, k2 = len - s - r;
+  dst.create(src.width(), src.height());
+  shiftCombine<Op>(a, dst, ox + k1 * dx, oy + k1 * dy, ox + k2 * dx,
+                   oy + k2 * dy);
+}
+
+// 与 fastMorphology 的八边形分解一致
+template <typename Op>
+void bitOctagon(const BitMask &src, BitMask &dst, int radius) {
+  int b = static_cast<int>(radius * 0.2929 + 0.5);
+  int a = radius - 2 * b;
+  if (a < 1 && radius > 0) {
+    a = radius;
+    b = 0;
+  }
+
+  BitMask tmp;
+  bitLineFilter<Op>(src, tmp, a, 1, 0);
+  bitLineFilter<Op>(tmp, dst, a, 0, 1);
+  if (b > 0) {
+    bitLineFilter<Op>(dst, tmp, b, 1, 1);
+    bitLineFilter<Op>(tmp, dst, b, 1, -1);
+  }
+}
+
+// 精确圆盘 dx² + dy² <= r²：
+// 先把竖直半高 h 的线段做成 V_h（逐行增量，h 每加 1 只多合并两行），
+// 再对每个半高为 h 的 dx 把 V_h 水平移 ±dx 合并到输出
+template <typename Op>
+void bitDisk(const BitMask &src, BitMask &dst, int r) {
+  const int w = src.width(), h = src.height();
+  const size_t words = src.wordsPerRow();
+  const int margin = (r + 63) / 64 + 1;
+
+  // half[dx] = floor(sqrt(r² - dx²))，随 dx 递减
+  std::vector<int> half(r + 1);
+  for (int dx = 0; dx <= r; ++dx) {
+    const int64_t v = static_cast<int64_t>(r) * r - static_cast<int64_t>(dx) * dx;
+    int hv = static_cast<int>(std::sqrt(static_cast<double>(v)));
+    while (static_cast<int64_t>(hv + 1) * (hv + 1) <= v)
+      ++hv;
+    while (static_cast<int64_t>(hv) * hv > v)
+      --hv;
+    half[dx] = hv;
+  }
+
+  BitMask out(w, h);
+  parallelFor(cv::Range(0, h), [&](const cv::Range &range) {
+    std::vector<uint64_t> v(words), ext(words + 2 * margin);
+    for (int y = range.start; y < range.end; ++y) {
+      uint64_t *o = out.row(y);
+      std::fill(o, o + words, Op::fill);
+      std::copy(src.row(y), src.row(y) + words, v.begin());
+
+      int dx = r;
+      for (int hh = 0; hh <= r && dx >= 0; ++hh) {
+        if (hh > 0) {
+          // 图外行是单位元，跳过即可
+          if (y - hh >= 0) {
+            const uint64_t *s = src.row(y - hh);
+            for (size_t i = 0; i < words; ++i)
+              v[i] = Op::apply(v[i], s[i]);
+          }
+          if (y + hh < h) {
+            const uint64_t *s = src.row(y + hh);
+            for (size_t i = 0; i < words; ++i)
+              v[i] = Op::apply(v[i], s[i]);
+          }
+        }
+        if (half[dx] != hh)
+          continue;
+
+        extendRow<Op>(v.data(), words, w, margin, ext.data());
+        for (; dx >= 0 && half[dx] == hh; --dx) {
+          for (size_t i = 0; i < words; ++i) {
+            uint64_t m = shiftedWord(ext.data(), margin, i, dx);
+            if (dx > 0)
+              m = Op::apply(m, shiftedWord(ext.data(), margin, i, -dx));
+            o[i] = Op::apply(o[i], m);
+          }
+        }
+      }
+      o[words - 1] &= tailMask(w);
+    }
+  });
+  dst = std::move(out);
+}
+
+} // namespace
+
+// ---------------- BitMask ----------------
+
+BitMask::BitMask(int width, int height, bool value) {
+  create(width, height);
+  fill(value);
+}
+
+void BitMask::create(int width, int height) {
+  width = std::max(0, width);
+  height = std::max(0, height);
+  if (width == _width && height == _height)
+    return;
+  _width = width;
+  _height = height;
+  _wordsPerRow = (static_cast<size_t>(width) + 63) / 64;
+  _words.assign(_wordsPerRow * height, 0);
+}
+
+void BitMask::fill(bool value) {
+  if (empty())
+    return;
+  std::fill(_words.begin(), _words.end(), value ? ~0ULL : 0);
+  if (value) {
+    const uint64_t tail = tailMask(_width);
+    for (int y = 0; y < _height; ++y)
+      row(y)[_wordsPerRow - 1] &= tail;
+  }
+}
+
+void BitMask::set(int x, int y, bool value) {
+  uint64_t &w = row(y)[x >> 6];
+  const uint64_t bit = 1ULL << (x & 63);
+  w = value ? (w | bit) : (w & ~bit);
+}
+
+void BitMask::setRange(int y, int x0, int x1, bool value) {
+  x0 = std::max(0, x0);
+  x1 = std::min(_width, x1);
+  if (x0 >= x1)
+    return;
+  uint64_t *r = row(y);
+  const int w0 = x0 >> 6, w1 = (x1 - 1) >> 6;
+  const uint64_t first = ~0ULL << (x0 & 63);
+  const uint64_t last = ~0ULL >> (63 - ((x1 - 1) & 63));
+  for (int i = w0; i <= w1; ++i) {
+    uint64_t m = ~0ULL;
+    if (i == w0)
+      m &= first;
+    if (i == w1)
+      m &= last;
+    r[i] = value ? (r[i] | m) : (r[i] & ~m);
+  }
+}
+
+size_t BitMask::count() const {
+  size_t n = 0;
+  for (uint64_t w : _words)
+    n += std::bitset<64>(w).count();
+  return n;
+}
+
+// ---------------- 压缩 / 展开 ----------------
+
+int thresholdToBits(const cv::Mat &src, int thresh, BitMask &dst,
+                    cv::Point origin) {
+  if (thresh >= 0)
+    return packMat<false>(src, static_cast<uint8_t>(std::min(thresh, 255)),
+                          dst, origin);
+
+  // 没有像素 <= thresh：只校验参数并把区域清零
+  int res = packMat<false>(src, 0, dst, origin);
+  if (res != 0)
+    return res;
+  for (int y = 0; y < src.rows; ++y)
+    dst.setRange(origin.y + y, origin.x, origin.x + src.cols, false);
+  return 0;
+}
+
+int packBits(const cv::Mat &src, BitMask &dst) {
+  dst = BitMask();
+  return packMat<true>(src, 0, dst, cv::Point());
+}
+
+void thresholdRowToBits(const uint8_t *src, int n, int thresh,
+                        uint64_t *dst) {
+  if (thresh < 0) {
+    std::fill(dst, dst + (n + 63) / 64, 0);
+    return;
+  }
+  packRowImpl<false>(src, n, static_cast<uint8_t>(std::min(thresh, 255)), dst);
+}
+
+void packRowBits(const uint8_t *src, int n, uint64_t *dst) {
+  packRowImpl<true>(src, n, 0, dst);
+}
+
+void unpackRow(const uint64_t *bits, int x0, int n, uint8_t *dst) {
+  for (int i = 0; i < n; ++i) {
+    const int x = x0 + i;
+    dst[i] = static_cast<uint8_t>(0 - ((bits[x >> 6] >> (x & 63)) & 1u));
+  }
+}
+
+int unpackBits(const BitMask &src, cv::Mat &dst, const cv::Rect &rect) {
+  if (src.empty())
+    return -1;
+  const cv::Rect full(0, 0, src.width(), src.height());
+  const cv::Rect r = rect.empty() ? full : rect;
+  if ((r & full) != r)
+    return -2;
+
+  dst.create(r.size(), CV_8UC1);
+  parallelFor(cv::Range(0, r.height), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y)
+      unpackRow(src.row(r.y + y), r.x, r.width, dst.ptr<uint8_t>(y));
+  });
+  return 0;
+}
+
+void fillOutside(BitMask &mask, const cv::Rect &roi, bool value) {
+  const int w = mask.width(), h = mask.height();
+  const int y0 = std::clamp(roi.y, 0, h);
+  const int y1 = std::clamp(roi.y + roi.height, y0, h);
+  for (int y = 0; y < h; ++y) {
+    if (y < y0 || y >= y1) {
+      mask.setRange(y, 0, w, value);
+    } else {
+      mask.setRange(y, 0, roi.x, value);
+      mask.setRange(y, roi.x + roi.width, w, value);
+    }
+  }
+}
+
+// ---------------- 行程 ----------------
+
+void extractRuns(const uint64_t *bits, int width, std::vector<BitRun> &runs) {
+  const size_t words = (static_cast<size_t>(width) + 63) / 64;
+  int start = -1;
+  for (size_t i = 0; i < words; ++i) {
+    uint64_t w = bits[i];
+    const int base = static_cast<int>(i * 64);
+    if (start >= 0) {
+      // 上一个字延续过来的区间，找第一个 0
+      const uint64_t zeros = ~w;
+      if (!zeros)
+        continue;
+      const int e = ctz64(zeros);
+      runs.push_back({start, base + e});
+      start = -1;
+      w &= ~0ULL << e;
+    }
+    while (w) {
+      const int s = ctz64(w);
+      const uint64_t zeros = ~w & (~0ULL << s);
+      if (!zeros) {
+        start = base + s;
+        break;
+      }
+      const int e = ctz64(zeros);
+      runs.push_back({base + s, base + e});
+      w &= ~0ULL << e;
+    }
+  }
+  if (start >= 0)
+    runs.push_back({start, width});
+}
+
+int copyBitRect(const BitMask &src, const cv::Rect &rect, BitMask &dst,
+                cv::Point origin) {
+  if (&src == &dst || src.empty() || rect.empty() || rect.x < 0 ||
+      rect.y < 0 || rect.x + rect.width > src.width() ||
+      rect.y + rect.height > src.height())
+    return -1;
+  if (dst.empty()) {
+    if (origin != cv::Point())
+      return -2;
+    dst.create(rect.width, rect.height);
+  }
+  if (origin.x < 0 || origin.y < 0 || origin.x + rect.width > dst.width() ||
+      origin.y + rect.height > dst.height())
+    return -2;
+
+  const size_t words = src.wordsPerRow();
+  parallelFor(cv::Range(0, rect.height), [&](const cv::Range &range) {
+    // read64 跨字读取，源行后补一个 0 字
+    std::vector<uint64_t> ext(words + 1, 0);
+    std::vector<uint64_t> tmp((rect.width + 63) / 64);
+    for (int y = range.start; y < range.end; ++y) {
+      std::copy(src.row(rect.y + y), src.row(rect.y + y) + words, ext.begin());
+      for (size_t i = 0; i < tmp.size(); ++i)
+        tmp[i] = read64(ext.data(), rect.x + static_cast<int64_t>(i) * 64);
+      copyBits(tmp.data(), rect.width, dst.row(origin.y + y), origin.x);
+    }
+  });
+  return 0;
+}
+
+int bitMorphology(const BitMask &src, BitMask &dst, int op, int radius,
+                  MorphShape shape) {
+  if (src.empty())
+    return -1;
+  if (radius < 0)
+    return -2;
+  if (radius == 0) {
+    if (&dst != &src)
+      dst = src;
+    return 0;
+  }
+
+  auto dilate = [&](const BitMask &in, BitMask &out) {
+    if (shape == MorphShape::DISK)
+      bitDisk<BitOr>(in, out, radius);
+    else
+      bitOctagon<BitOr>(in, out, radius);
+  };
+  auto erode = [&](const BitMask &in, BitMask &out) {
+    if (shape == MorphShape::DISK)
+      bitDisk<BitAnd>(in, out, radius);
+    else
+      bitOctagon<BitAnd>(in, out, radius);
+  };
+
+  BitMask tmp;
+  switch (op) {
+  case cv::MORPH_DILATE:
+    dilate(src, tmp);
+    break;
+  case cv::MORPH_ERODE:
+    erode(src, tmp);
+    break;
+  case cv::MORPH_CLOSE: {
+    BitMask mid;
+    dilate(src, mid);
+    erode(mid, tmp);
+    break;
+  }
+  case cv::MORPH_OPEN: {
+    BitMask mid;
+    erode(src, mid);
+    dilate(mid, tmp);
+    break;
+  }
+  default:
+    return -3;
+  }
+  dst = std::move(tmp);
+  return 0;
+}
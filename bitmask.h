@@ -0,0 +1,93 @@
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "morphology.h"
+
+// ---------------- 1 位蒙版 ----------------
+// 透明度 / 去杂点蒙版只有 0/255 两种值，按位存储内存和带宽都只有 CV_8UC1 的 1/8。
+// 每行 ceil(width / 64) 个 64 位字，第 x 个像素是字 x / 64 的第 x % 64 位
+// （低位在前）；每行末尾超出 width 的位恒为 0。
+// 只在交错写入输出通道 / 显示时才展开成字节。
+class BitMask {
+public:
+  BitMask() = default;
+  BitMask(int width, int height, bool value = false);
+
+  // 尺寸一致时沿用原缓冲（内容不变）
+  void create(int width, int height);
+  void fill(bool value);
+
+  bool empty() const { return _width <= 0 || _height <= 0; }
+  int width() const { return _width; }
+  int height() const { return _height; }
+  cv::Size size() const { return cv::Size(_width, _height); }
+  size_t wordsPerRow() const { return _wordsPerRow; }
+
+  uint64_t *row(int y) { return _words.data() + y * _wordsPerRow; }
+  const uint64_t *row(int y) const { return _words.data() + y * _wordsPerRow; }
+
+  bool get(int x, int y) const {
+    return (row(y)[x >> 6] >> (x & 63)) & 1u;
+  }
+  void set(int x, int y, bool value);
+  // 置 [x0, x1) 为 value
+  void setRange(int y, int x0, int x1, bool value);
+
+  // 置位像素数
+  size_t count() const;
+
+private:
+  int _width = 0;
+  int _height = 0;
+  size_t _wordsPerRow = 0;
+  std::vector<uint64_t> _words;
+};
+
+// 一行内连续置位像素 [x0, x1)
+struct BitRun {
+  int x0;
+  int x1;
+};
+
+// src (CV_8UC1) 中 <= thresh 的像素置 1（与 THRESH_BINARY_INV 的 255 一致），
+// 写到 dst 中以 origin 为左上角的区域；dst 为空时按 src 尺寸创建
+int thresholdToBits(const cv::Mat &src, int thresh, BitMask &dst,
+                    cv::Point origin = cv::Point());
+
+// src (CV_8UC1) 非 0 的像素置 1
+int packBits(const cv::Mat &src, BitMask &dst);
+
+// 单行压缩（dst 至少 ceil(n / 64) 个字）：<= thresh / 非 0 置 1
+void thresholdRowToBits(const uint8_t *src, int n, int thresh, uint64_t *dst);
+void packRowBits(const uint8_t *src, int n, uint64_t *dst);
+
+// 展开成 0/255；rect 为空时展开整幅
+int unpackBits(const BitMask &src, cv::Mat &dst, const cv::Rect &rect = {});
+
+// 展开一行中 [x0, x0 + n) 到 dst（0/255）
+void unpackRow(const uint64_t *bits, int x0, int n, uint8_t *dst);
+
+// 把 roi 以外的部分置为 value
+void fillOutside(BitMask &mask, const cv::Rect &roi, bool value);
+
+// 把 src 中 rect 区域拷到 dst 中以 origin 为左上角的区域，其余位不变；
+// dst 为空时按 rect 尺寸创建（origin 须为 (0,0)）
+int copyBitRect(const BitMask &src, const cv::Rect &rect, BitMask &dst,
+                cv::Point origin = cv::Point());
+
+// 用 ctz 逐段找出一行的置位区间（追加到 runs），连通域标记见 runmask.h
+void extractRuns(const uint64_t *bits, int width, std::vector<BitRun> &runs);
+
+// 位运算形态学，op / shape 含义同 fastMorphology：
+//   水平方向是整字移位后按位与/或，垂直方向是整行按位与/或
+//   DISK    : 对每个 dx 取半高 h(dx) 的竖直线段，再水平移 dx 合并（精确圆盘）
+//   OCTAGON : 四个方向线段按倍增移位合并（与 fastMorphology 相同分解）
+int bitMorphology(const BitMask &src, BitMask &dst, int op, int radius,
+                  MorphShape shape = MorphShape::DISK);
+
+#endif // BITMASK_H
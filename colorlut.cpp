@@ -0,0 +1,197 @@
+#include "colorlut.h"
+
+#include <fstream>
+
+#include "taskpool.h"
+
+#ifdef TIFFPROCESS_WITH_LCMS
+#include <lcms2.h>
+#endif
+
+static uint64_t fnv1a64(const std::vector<uint8_t> &data, uint64_t h) {
+  for (uint8_t b : data) {
+    h ^= b;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+std::vector<uint8_t> readIccProfile(const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f)
+    return {};
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(f),
+                              std::istreambuf_iterator<char>());
+}
+
+// ================= CmykRgbLut =================
+
+void CmykRgbLut::buildAxis() {
+  // 输入 0~255 映射到网格坐标，偏移量精度 1/256
+  for (int v = 0; v < 256; ++v) {
+    const int pos = v * (kGrid - 1) * 256 / 255;
+    int idx = pos >> 8;
+    int frac = pos & 255;
+    if (idx >= kGrid - 1) {
+      idx = kGrid - 2;
+      frac = 256;
+    }
+    _idx[v] = idx;
+    _frac[v] = frac;
+  }
+}
+
+bool CmykRgbLut::bake(const std::vector<uint8_t> &cmykProfile,
+                      const std::vector<uint8_t> &rgbProfile) {
+#ifdef TIFFPROCESS_WITH_LCMS
+  if (cmykProfile.empty())
+    return false;
+
+  cmsHPROFILE in = cmsOpenProfileFromMem(
+      cmykProfile.data(), static_cast<cmsUInt32Number>(cmykProfile.size()));
+  if (!in)
+    return false;
+  if (cmsGetColorSpace(in) != cmsSigCmykData) {
+    cmsCloseProfile(in);
+    return false;
+  }
+
+  cmsHPROFILE out =
+      rgbProfile.empty()
+          ? cmsCreate_sRGBProfile()
+          : cmsOpenProfileFromMem(
+                rgbProfile.data(),
+                static_cast<cmsUInt32Number>(rgbProfile.size()));
+  if (!out) {
+    cmsCloseProfile(in);
+    return false;
+  }
+
+  cmsHTRANSFORM xform =
+      cmsCreateTransform(in, TYPE_CMYK_16, out, TYPE_BGR_16, INTENT_PERCEPTUAL,
+                         cmsFLAGS_BLACKPOINTCOMPENSATION);
+  cmsCloseProfile(in);
+  cmsCloseProfile(out);
+  if (!xform)
+    return false;
+
+  // 网格点一次性送入 LittleCMS（0 = 无墨，65535 = 满墨）
+  const int n = kGrid;
+  const size_t nodes = static_cast<size_t>(n) * n * n * n;
+  std::vector<uint16_t> grid(nodes * 4);
+  uint16_t *g = grid.data();
+  for (int c = 0; c < n; ++c)
+    for (int m = 0; m < n; ++m)
+      for (int y = 0; y < n; ++y)
+        for (int k = 0; k < n; ++k) {
+          *g++ = static_cast<uint16_t>(c * 65535 / (n - 1));
+          *g++ = static_cast<uint16_t>(m * 65535 / (n - 1));
+          *g++ = static_cast<uint16_t>(y * 65535 / (n - 1));
+          *g++ = static_cast<uint16_t>(k * 65535 / (n - 1));
+        }
+
+  _table.resize(nodes * 3);
+  cmsDoTransform(xform, grid.data(), _table.data(),
+                 static_cast<cmsUInt32Number>(nodes));
+  cmsDeleteTransform(xform);
+
+  buildAxis();
+  return true;
+#else
+  (void)cmykProfile;
+  (void)rgbProfile;
+  return false;
+#endif
+}
+
+void CmykRgbLut::applyRow(const uint8_t *src, int spp, uint8_t *dst,
+                          int width) const {
+  constexpr int n = kGrid;
+  // 网格步长（以 uint16 计）
+  constexpr int sK = 3;
+  constexpr int sY = n * sK;
+  constexpr int sM = n * sY;
+  constexpr int sC = n * sM;
+
+  const uint16_t *lut = _table.data();
+
+  for (int x = 0; x < width; ++x, src += spp, dst += 3) {
+    const int fc = _frac[src[0]], fm = _frac[src[1]];
+    const int fy = _frac[src[2]], fk = _frac[src[3]];
+    const uint16_t *base = lut + _idx[src[0]] * sC + _idx[src[1]] * sM +
+                           _idx[src[2]] * sY + _idx[src[3]] * sK;
+
+    // CMY 三个轴按偏移量从大到小排序，确定四面体
+    int f0 = fc, f1 = fm, f2 = fy;
+    int s0 = sC, s1 = sM, s2 = sY;
+    if (f0 < f1) {
+      std::swap(f0, f1);
+      std::swap(s0, s1);
+    }
+    if (f1 < f2) {
+      std::swap(f1, f2);
+      std::swap(s1, s2);
+    }
+    if (f0 < f1) {
+      std::swap(f0, f1);
+      std::swap(s0, s1);
+    }
+
+    const uint16_t *p0 = base;
+    const uint16_t *p1 = p0 + s0;
+    const uint16_t *p2 = p1 + s1;
+    const uint16_t *p3 = p2 + s2;
+
+    for (int ch = 0; ch < 3; ++ch) {
+      // K 的两层分别做四面体插值（结果放大 256 倍）
+      const int a0 = p0[ch] * 256 + f0 * (p1[ch] - p0[ch]) +
+                     f1 * (p2[ch] - p1[ch]) + f2 * (p3[ch] - p2[ch]);
+      const int a1 = p0[ch + sK] * 256 + f0 * (p1[ch + sK] - p0[ch + sK]) +
+                     f1 * (p2[ch + sK] - p1[ch + sK]) +
+                     f2 * (p3[ch + sK] - p2[ch + sK]);
+      // K 线性插值；int64 防止 65535*256*256 溢出
+      const int64_t v =
+          static_cast<int64_t>(a0) * 256 + static_cast<int64_t>(fk) * (a1 - a0);
+      // 16 位 -> 8 位（四舍五入）
+      dst[ch] = static_cast<uint8_t>(
+          (v + (int64_t(257) << 15)) / (int64_t(257) << 16));
+    }
+  }
+}
+
+void CmykRgbLut::apply(const ConstPixelView &src, cv::Mat &bgr) const {
+  parallelFor(cv::Range(0, src.height), [&](const cv::Range &r) {
+    for (int y = r.start; y < r.end; ++y)
+      applyRow(src.row(y), src.spp, bgr.ptr<uint8_t>(y), src.width);
+  });
+}
+
+// ================= CmykRgbLutCache =================
+
+CmykRgbLutCache &CmykRgbLutCache::getInstance() {
+  static CmykRgbLutCache instance;
+  return instance;
+}
+
+std::shared_ptr<const CmykRgbLut>
+CmykRgbLutCache::get(const std::vector<uint8_t> &cmykProfile,
+                     const std::vector<uint8_t> &rgbProfile) {
+  if (cmykProfile.empty())
+    return nullptr;
+
+  uint64_t key = fnv1a64(cmykProfile, 1469598103934665603ull);
+  key = fnv1a64(rgbProfile, key ^ (rgbProfile.size() + 0x9E3779B97F4A7C15ull));
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _luts.find(key);
+  if (it != _luts.end())
+    return it->second;
+
+  // 烘焙失败也缓存（空指针），避免每次重试
+  auto lut = std::make_shared<CmykRgbLut>();
+  std::shared_ptr<const CmykRgbLut> res;
+  if (lut->bake(cmykProfile, rgbProfile))
+    res = lut;
+  _luts.emplace(key, res);
+  return res;
+}
@@ -0,0 +1,87 @@
+#ifndef COLORLUT_H
+#define COLORLUT_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "pixelview.h"
+
+// ---------------- CMYK -> RGB 颜色查找表 ----------------
+// 每对 (CMYK 配置文件, RGB 配置文件) 只用 LittleCMS 烘焙一次 4D 网格，
+// 之后逐像素做 “CMY 四面体插值 + K 线性插值”，全部为定点整数运算
+class CmykRgbLut {
+public:
+  static constexpr int kGrid = 17; // 每维网格点数
+
+  // 用 ICC 配置文件烘焙；rgbProfile 为空时使用 sRGB
+  // 未启用 LittleCMS（TIFFPROCESS_WITH_LCMS）时返回 false
+  bool bake(const std::vector<uint8_t> &cmykProfile,
+            const std::vector<uint8_t> &rgbProfile);
+
+  // 按任意函数烘焙（cmyk/rgb 取值 0~1），便于替换颜色模型
+  template <typename Fn> void bakeWith(Fn &&fn);
+
+  // 单行转换：src 为交错 CMYK(+extra)，步长 spp；dst 为 BGR
+  void applyRow(const uint8_t *src, int spp, uint8_t *dst, int width) const;
+
+  // 整幅并行转换，按行分段；src 为交错视图，bgr 需已按 src 尺寸创建
+  void apply(const ConstPixelView &src, cv::Mat &bgr) const;
+
+  bool empty() const { return _table.empty(); }
+
+private:
+  void buildAxis();
+
+  std::vector<uint16_t> _table; // [c][m][y][k] -> B,G,R（16 位）
+  int _idx[256] = {0};          // 输入值 -> 网格下标
+  int _frac[256] = {0};         // 输入值 -> 网格内偏移（0~256）
+};
+
+template <typename Fn> void CmykRgbLut::bakeWith(Fn &&fn) {
+  const int n = kGrid;
+  _table.resize(static_cast<size_t>(n) * n * n * n * 3);
+  uint16_t *p = _table.data();
+  for (int c = 0; c < n; ++c)
+    for (int m = 0; m < n; ++m)
+      for (int y = 0; y < n; ++y)
+        for (int k = 0; k < n; ++k) {
+          float rgb[3] = {0, 0, 0};
+          fn(c / float(n - 1), m / float(n - 1), y / float(n - 1),
+             k / float(n - 1), rgb);
+          // 存成 BGR，直接对应 OpenCV 输出顺序
+          for (int i = 0; i < 3; ++i) {
+            float v = std::min(1.0f, std::max(0.0f, rgb[2 - i]));
+            *p++ = static_cast<uint16_t>(v * 65535.0f + 0.5f);
+          }
+        }
+  buildAxis();
+}
+
+// ---------------- LUT 缓存 ----------------
+// 以配置文件内容的哈希为键，进程内共享
+class CmykRgbLutCache {
+public:
+  static CmykRgbLutCache &getInstance();
+
+  // 失败（无配置文件 / 未启用 LittleCMS / 配置文件无效）返回空
+  std::shared_ptr<const CmykRgbLut>
+  get(const std::vector<uint8_t> &cmykProfile,
+      const std::vector<uint8_t> &rgbProfile);
+
+private:
+  CmykRgbLutCache() = default;
+
+  std::mutex _mutex;
+  std::unordered_map<uint64_t, std::shared_ptr<const CmykRgbLut>> _luts;
+};
+
+// 读入整个 ICC 文件，失败返回空
+std::vector<uint8_t> readIccProfile(const std::string &path);
+
+#endif // COLORLUT_H
@@ -0,0 +1,80 @@
+#include "contentbounds.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "taskpool.h"
+
+cv::Rect findContentBounds(const ConstPixelView &view) {
+  if (view.empty() || !view.interleaved())
+    return {};
+
+  const uint8_t *data = view.data;
+  const int width = view.width, height = view.height, spp = view.spp;
+  const size_t rowBytes = view.rowBytes();
+  // 参考行：整行都是 (0,0) 像素，用 memcmp 快速跳过空白行
+  std::vector<uint8_t> ref(rowBytes);
+  for (int x = 0; x < width; ++x)
+    std::memcpy(ref.data() + static_cast<size_t>(x) * spp, data, spp);
+
+  int x0 = width, x1 = -1, y0 = height, y1 = -1;
+  std::mutex mutex;
+
+  parallelFor(cv::Range(0, height), [&](const cv::Range &r) {
+    int lx0 = width, lx1 = -1, ly0 = height, ly1 = -1;
+    for (int y = r.start; y < r.end; ++y) {
+      const uint8_t *row = view.row(y);
+      if (std::memcmp(row, ref.data(), rowBytes) == 0)
+        continue;
+
+      ly0 = std::min(ly0, y);
+      ly1 = std::max(ly1, y);
+      // 只需在已知范围之外继续找左右边界
+      int left = 0;
+      while (left < lx0 && std::memcmp(row + static_cast<size_t>(left) * spp,
+                                       data, spp) == 0)
+        ++left;
+      lx0 = std::min(lx0, left);
+      int right = width - 1;
+      while (right > lx1 && std::memcmp(row + static_cast<size_t>(right) * spp,
+                                        data, spp) == 0)
+        --right;
+      lx1 = std::max(lx1, right);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    x0 = std::min(x0, lx0);
+    x1 = std::max(x1, lx1);
+    y0 = std::min(y0, ly0);
+    y1 = std::max(y1, ly1);
+  });
+
+  if (y1 < 0)
+    return {};
+  return cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+cv::Rect findContentBounds(const cv::Mat &img) {
+  return findContentBounds(pixelView(img));
+}
+
+cv::Rect padRect(const cv::Rect &roi, int pad, cv::Size size) {
+  const int x0 = std::max(0, roi.x - pad);
+  const int y0 = std::max(0, roi.y - pad);
+  const int x1 = std::min(size.width, roi.x + roi.width + pad);
+  const int y1 = std::min(size.height, roi.y + roi.height + pad);
+  return cv::Rect(x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0));
+}
+
+void fillOutside(cv::Mat &img, const cv::Rect &roi, const cv::Scalar &value) {
+  const int w = img.cols, h = img.rows;
+  const int x1 = roi.x + roi.width, y1 = roi.y + roi.height;
+  if (roi.y > 0)
+    img(cv::Rect(0, 0, w, roi.y)).setTo(value);
+  if (y1 < h)
+    img(cv::Rect(0, y1, w, h - y1)).setTo(value);
+  if (roi.x > 0)
+    img(cv::Rect(0, roi.y, roi.x, roi.height)).setTo(value);
+  if (x1 < w)
+    img(cv::Rect(x1, roi.y, w - x1, roi.height)).setTo(value);
+}
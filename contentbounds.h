@@ -0,0 +1,23 @@
+#ifndef CONTENTBOUNDS_H
+#define CONTENTBOUNDS_H
+
+#include <opencv2/opencv.hpp>
+
+#include "pixelview.h"
+
+// ---------------- 内容区域 ----------------
+// 大画布 + 小图案的文件四周是大片均匀边距。先做一次行/列占用扫描找出
+// 内容外接矩形，各处理阶段只算矩形内，边距直接填常数。
+// 边距参考值取左上角像素：边距像素都与它相等。
+
+// 与 (0,0) 像素不同的像素的外接矩形；整幅均匀或非交错视图时返回空矩形
+cv::Rect findContentBounds(const ConstPixelView &view);
+cv::Rect findContentBounds(const cv::Mat &img);
+
+// 向外扩 pad 像素并裁到图像内
+cv::Rect padRect(const cv::Rect &roi, int pad, cv::Size size);
+
+// 把 roi 以外的部分填成 value（只写四条边距）
+void fillOutside(cv::Mat &img, const cv::Rect &roi, const cv::Scalar &value);
+
+#endif // CONTENTBOUNDS_H
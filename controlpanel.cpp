@@ -6,6 +6,8 @@
 #include <QFileDialog>
 #include <QLabel>
 #include <QMessageBox>
+#include <QSignalBlocker>
+#include <QSpinBox>
 
 #include "tiffprocessapi.h"
 #include "utils.h"
@@ -22,6 +24,13 @@ ControlPanel::ControlPanel(QWidget *parent) : QWidget(parent) {
   methodCombo->addItem("MAX_CHANNEL");
   methodCombo->setCurrentIndex(2);  // 默认选中第一个
 
+  // 预览分辨率：大图在缩小的代理上交互，生成 tiff 仍用原图
+  QComboBox *previewCombo = new QComboBox();
+  previewCombo->addItem("预览：原图", 1);
+  previewCombo->addItem("预览：1/2", 2);
+  previewCombo->addItem("预览：1/4", 4);
+  previewCombo->addItem("预览：1/8", 8);
+
   QPushButton *calcBlackness = new QPushButton("计算黑度");
 
   QLabel *blacknessLabel = new QLabel("去黑强度");
@@ -35,12 +44,48 @@ ControlPanel::ControlPanel(QWidget *parent) : QWidget(parent) {
   slider->setTickInterval(25);  // 刻度间隔
   slider->setTickPosition(QSlider::TicksBelow);
 
+  // 当前阈值下的透明比例，只查直方图
+  QLabel *fractionLabel = new QLabel("透明比例：-");
+  fractionLabel->setAlignment(Qt::AlignHCenter);
+
+  QComboBox *autoCombo = new QComboBox();
+  autoCombo->addItem("Otsu");
+  autoCombo->addItem("三角法");
+  autoCombo->addItem("百分位 99%");
+  QPushButton *autoThresh = new QPushButton("自动阈值");
+
   QLabel *noiseLabel = new QLabel("杂点大小");
   noiseLabel->setAlignment(Qt::AlignHCenter);
   clearSmallslider = new QSlider(Qt::Horizontal);
   clearSmallslider->setRange(1, 100);
   clearSmallslider->setValue(1);  // 默认值
   QPushButton *clearSmall = new QPushButton("去除杂点");
+
+  QLabel *whiteOffsetLabel = new QLabel("白墨收缩/外扩：0");
+  whiteOffsetLabel->setAlignment(Qt::AlignHCenter);
+  QSlider *whiteOffsetSlider = new QSlider(Qt::Horizontal);
+  whiteOffsetSlider->setRange(-50, 50);  // 负值收缩，正值外扩（像素）
+  whiteOffsetSlider->setValue(0);
+  whiteOffsetSlider->setTickInterval(10);
+  whiteOffsetSlider->setTickPosition(QSlider::TicksBelow);
+
+  // 撤销 / 重做去黑、去杂点的结果，快捷键 Ctrl+Z / Ctrl+Y
+  undoBtn = new QPushButton("撤销");
+  undoBtn->setShortcut(QKeySequence::Undo);
+  redoBtn = new QPushButton("重做");
+  redoBtn->setShortcut(QKeySequence::Redo);
+  QHBoxLayout *historyLayout = new QHBoxLayout();
+  historyLayout->addWidget(undoBtn);
+  historyLayout->addWidget(redoBtn);
+
+  // 撤销记录占用内存上限，超出时丢弃最旧的记录
+  QSpinBox *historyLimit = new QSpinBox();
+  historyLimit->setPrefix("撤销内存上限：");
+  historyLimit->setSuffix(" MB");
+  historyLimit->setRange(16, 8192);
+  historyLimit->setSingleStep(64);
+  historyLimit->setValue(512);  // 与 MaskHistory 默认一致
+
   QPushButton *showWhite = new QPushButton("显示白色");
   QPushButton *generateNew = new QPushButton("生成tiff");
   QPushButton *testbtn = new QPushButton("test");
@@ -48,17 +93,33 @@ ControlPanel::ControlPanel(QWidget *parent) : QWidget(parent) {
   // 添加控件到布局
   layout->addWidget(openBtn);
   layout->addWidget(methodCombo);  // 下拉框在按钮上方
+  layout->addWidget(previewCombo);
   layout->addWidget(calcBlackness);
   layout->addWidget(blacknessLabel);
   layout->addWidget(slider);
+  layout->addWidget(fractionLabel);
+  layout->addWidget(autoCombo);
+  layout->addWidget(autoThresh);
   layout->addWidget(noiseLabel);
   layout->addWidget(clearSmallslider);
   layout->addWidget(clearSmall);
+  layout->addWidget(whiteOffsetLabel);
+  layout->addWidget(whiteOffsetSlider);
+  layout->addLayout(historyLayout);
+  layout->addWidget(historyLimit);
   // layout->addWidget(showWhite);
   layout->addWidget(generateNew);
   layout->addWidget(testbtn);
 
   layout->addStretch();  // 控件靠上
+  updateHistoryButtons();
+
+  auto updateFraction = [=](int thresh) {
+    double fraction =
+        tiffProcessAPI::getInstance().transparentFraction(thresh);
+    fractionLabel->setText(
+        QString("透明比例：%1%").arg(fraction * 100.0, 0, 'f', 2));
+  };
 
   // 信号连接
   connect(openBtn, &QPushButton::clicked, this,
@@ -67,24 +128,87 @@ ControlPanel::ControlPanel(QWidget *parent) : QWidget(parent) {
     int methodIndex = methodCombo->currentIndex();
     BlacknessMethod method = static_cast<BlacknessMethod>(methodIndex);
     int res = tiffProcessAPI::getInstance().calBackness(method);
+    updateHistoryButtons();
     if (res != 0) return;
+    updateFraction(slider->value());
     QMessageBox::information(this, tr("提示"), tr("黑度计算完成"));
   });
 
+  // 切换预览分辨率后黑度和蒙版都要在新尺寸上重算
+  connect(previewCombo, &QComboBox::currentIndexChanged, this, [=](int index) {
+    tiffProcessAPI &api = tiffProcessAPI::getInstance();
+    if (0 != api.setPreviewScale(previewCombo->itemData(index).toInt()))
+      return;
+    BlacknessMethod method =
+        static_cast<BlacknessMethod>(methodCombo->currentIndex());
+    int res = api.calBackness(method);
+    if (res == 0) {
+      updateFraction(slider->value());
+      res = api.removeBlack(slider->value());
+    }
+    updateHistoryButtons();
+    if (0 != res) return;
+    emit removeBlackFinished();
+  });
+
+  connect(autoThresh, &QPushButton::clicked, this, [=]() {
+    AutoThresholdMode mode =
+        static_cast<AutoThresholdMode>(autoCombo->currentIndex());
+    int thresh = tiffProcessAPI::getInstance().autoBlacknessThresh(mode, 99.0);
+    if (thresh < 0) return;
+    // 自动阈值可能低于常用范围，必要时放宽滑块下限
+    if (thresh < slider->minimum()) slider->setMinimum(thresh);
+    slider->setValue(thresh);
+    updateFraction(thresh);
+  });
+
   connect(slider, &QSlider::valueChanged, this, [=](int value) {
-    if (0 != tiffProcessAPI::getInstance().removeBlack(value)) return;
+    updateFraction(value);
+    int res = tiffProcessAPI::getInstance().removeBlack(value);
+    updateHistoryButtons();
+    if (0 != res) return;
     emit removeBlackFinished();
   });
 
   connect(clearSmall, &QPushButton::clicked, this, [=]() {
     int kernel = clearSmallslider->value();
     int res = tiffProcessAPI::getInstance().removeSmallByArea(kernel);
+    updateHistoryButtons();
+    if (res != 0) return;
+    emit removeBlackFinished();
+  });
+  // 撤销 / 重做后滑块跟随恢复出的去黑阈值，不再触发重新去黑
+  auto restoreHistory = [=](bool redo) {
+    tiffProcessAPI &api = tiffProcessAPI::getInstance();
+    int res = redo ? api.redo() : api.undo();
+    updateHistoryButtons();
     if (res != 0) return;
+    int thresh = api.blackThresh();
+    if (thresh >= 0) {
+      QSignalBlocker blocker(slider);
+      if (thresh < slider->minimum()) slider->setMinimum(thresh);
+      slider->setValue(thresh);
+      updateFraction(thresh);
+    }
     emit removeBlackFinished();
+  };
+  connect(undoBtn, &QPushButton::clicked, this,
+          [=]() { restoreHistory(false); });
+  connect(redoBtn, &QPushButton::clicked, this,
+          [=]() { restoreHistory(true); });
+  connect(historyLimit, &QSpinBox::valueChanged, this, [=](int mb) {
+    tiffProcessAPI::getInstance().setHistoryLimit(size_t(mb) << 20);
+    updateHistoryButtons();  // 调小上限会丢弃记录
+  });
+
+  connect(whiteOffsetSlider, &QSlider::valueChanged, this, [=](int value) {
+    whiteOffsetLabel->setText(QString("白墨收缩/外扩：%1").arg(value));
+    tiffProcessAPI::getInstance().setWhiteOffset(value);
   });
   connect(showWhite, &QPushButton::clicked, this, [=]() {
     int res = tiffProcessAPI::getInstance().generateWhiteCompensation(
         slider->value());
+    updateHistoryButtons();
     if (0 != res) return;
     emit showWhiteClicked();
   });
@@ -112,3 +236,9 @@ ControlPanel::ControlPanel(QWidget *parent) : QWidget(parent) {
   connect(testbtn, &QPushButton::clicked, this,
           [=]() { return tiffProcessAPI::getInstance().test(); });
 }
+
+void ControlPanel::updateHistoryButtons() {
+  const tiffProcessAPI &api = tiffProcessAPI::getInstance();
+  undoBtn->setEnabled(api.canUndo());
+  redoBtn->setEnabled(api.canRedo());
+}
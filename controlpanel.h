@@ -19,8 +19,16 @@ class ControlPanel : public QWidget {
 
   void showWhiteClicked();
 
+ public slots:
+  // 按 tiffProcessAPI 的撤销 / 重做记录刷新按钮可用状态，
+  // 在面板外改动蒙版（如打开新图）后也要调用
+  void updateHistoryButtons();
+
  private:
   QSlider *slider;
 
+  QPushButton *undoBtn;
+  QPushButton *redoBtn;
+
   QSlider *clearSmallslider;
 };
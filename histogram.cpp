@@ -0,0 +1,137 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+void BlacknessHistogram::merge(const BlacknessHistogram &other) {
+  for (int i = 0; i < 256; ++i)
+    bins[i] += other.bins[i];
+}
+
+uint64_t BlacknessHistogram::total() const {
+  uint64_t sum = 0;
+  for (uint64_t v : bins)
+    sum += v;
+  return sum;
+}
+
+uint64_t BlacknessHistogram::countAbove(int thresh) const {
+  uint64_t sum = 0;
+  for (int i = std::max(0, thresh + 1); i < 256; ++i)
+    sum += bins[i];
+  return sum;
+}
+
+double BlacknessHistogram::transparentFraction(int thresh) const {
+  const uint64_t n = total();
+  if (n == 0)
+    return 0.0;
+  return static_cast<double>(countAbove(thresh)) / static_cast<double>(n);
+}
+
+int otsuThreshold(const BlacknessHistogram &hist) {
+  const uint64_t n = hist.total();
+  if (n == 0)
+    return -1;
+
+  double sumAll = 0.0;
+  for (int i = 0; i < 256; ++i)
+    sumAll += static_cast<double>(i) * hist.bins[i];
+
+  // 类 0 = [0, t]，类 1 = (t, 255]
+  double w0 = 0.0, sum0 = 0.0, best = -1.0;
+  int thresh = 0;
+  for (int t = 0; t < 255; ++t) {
+    w0 += static_cast<double>(hist.bins[t]);
+    sum0 += static_cast<double>(t) * hist.bins[t];
+    const double w1 = static_cast<double>(n) - w0;
+    if (w0 == 0.0 || w1 == 0.0)
+      continue;
+    const double mu0 = sum0 / w0;
+    const double mu1 = (sumAll - sum0) / w1;
+    const double between = w0 * w1 * (mu0 - mu1) * (mu0 - mu1);
+    if (between > best) {
+      best = between;
+      thresh = t;
+    }
+  }
+  return thresh;
+}
+
+int triangleThreshold(const BlacknessHistogram &hist) {
+  std::array<uint64_t, 256> h = hist.bins;
+
+  int left = 0;
+  while (left < 256 && h[left] == 0)
+    ++left;
+  if (left == 256)
+    return -1;
+  int right = 255;
+  while (right > 0 && h[right] == 0)
+    --right;
+  if (left > 0)
+    --left;
+  if (right < 255)
+    ++right;
+
+  int peak = static_cast<int>(std::max_element(h.begin(), h.end()) - h.begin());
+
+  // 统一成长尾在左侧
+  bool flipped = false;
+  if (peak - left < right - peak) {
+    flipped = true;
+    std::reverse(h.begin(), h.end());
+    left = 255 - right;
+    peak = 255 - peak;
+  }
+
+  int thresh = left;
+  if (peak > left) {
+    // 点到 (left, 0)-(peak, h[peak]) 连线的距离（未归一化）
+    const double a = static_cast<double>(h[peak]);
+    const double b = static_cast<double>(left - peak);
+    double dist = 0.0;
+    for (int i = left + 1; i <= peak; ++i) {
+      const double d = a * i + b * static_cast<double>(h[i]);
+      if (d > dist) {
+        dist = d;
+        thresh = i;
+      }
+    }
+    --thresh;
+  }
+
+  if (flipped)
+    thresh = 255 - thresh;
+  return std::clamp(thresh, 0, 255);
+}
+
+int percentileThreshold(const BlacknessHistogram &hist, double percentile) {
+  const uint64_t n = hist.total();
+  if (n == 0)
+    return -1;
+
+  const double p = std::clamp(percentile, 0.0, 100.0) / 100.0;
+  const uint64_t target =
+      static_cast<uint64_t>(std::ceil(p * static_cast<double>(n)));
+  uint64_t acc = 0;
+  for (int t = 0; t < 256; ++t) {
+    acc += hist.bins[t];
+    if (acc >= target && acc > 0)
+      return t;
+  }
+  return 255;
+}
+
+int autoThreshold(const BlacknessHistogram &hist, AutoThresholdMode mode,
+                  double percentile) {
+  switch (mode) {
+  case AutoThresholdMode::OTSU:
+    return otsuThreshold(hist);
+  case AutoThresholdMode::TRIANGLE:
+    return triangleThreshold(hist);
+  case AutoThresholdMode::PERCENTILE:
+    return percentileThreshold(hist, percentile);
+  }
+  return -1;
+}
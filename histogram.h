@@ -0,0 +1,38 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <array>
+#include <cstdint>
+
+// ---------------- 黑度直方图 / 自动阈值 ----------------
+// 直方图在 calcBlackness 中顺带统计（每个线程一份，结束时合并），
+// 之后选阈值、估算透明比例都只看 256 个桶，不再访问像素
+
+struct BlacknessHistogram {
+  std::array<uint64_t, 256> bins{};
+
+  void clear() { bins.fill(0); }
+  void merge(const BlacknessHistogram &other);
+  uint64_t total() const;
+  // 黑度 > thresh 的像素数（removeBlack 中变为透明的部分）
+  uint64_t countAbove(int thresh) const;
+  // 透明像素比例（0~1），直方图为空时返回 0
+  double transparentFraction(int thresh) const;
+};
+
+enum class AutoThresholdMode {
+  OTSU = 0,  // 类间方差最大
+  TRIANGLE,  // 峰值到长尾端点连线的最远点，适合单峰 + 长尾
+  PERCENTILE // 累计比例达到 percentile% 的黑度值
+};
+
+// 返回阈值（0~255），直方图为空返回 -1
+int otsuThreshold(const BlacknessHistogram &hist);
+int triangleThreshold(const BlacknessHistogram &hist);
+int percentileThreshold(const BlacknessHistogram &hist, double percentile);
+
+// percentile 只在 PERCENTILE 模式下使用（0~100）
+int autoThreshold(const BlacknessHistogram &hist, AutoThresholdMode mode,
+                  double percentile = 99.0);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,409 @@
+#include "hotfolder.h"
+
+#include <algorithm>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "batchrunner.h"
+#include "utils.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool isTiffName(const fs::path &p) {
+  const std::string name = p.filename().string();
+  if (name.empty() || name[0] == '.' || name[0] == '~')
+    return false; // 隐藏文件 / 编辑器临时文件
+  std::string ext = p.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == ".tif" || ext == ".tiff";
+}
+
+int64_t mtimeOf(const fs::path &p) {
+  std::error_code ec;
+  const auto t = fs::last_write_time(p, ec);
+  return ec ? 0 : static_cast<int64_t>(t.time_since_epoch().count());
+}
+
+// 目标已存在时加序号：a.tif -> a_1.tif
+fs::path uniquePath(const fs::path &dir, const fs::path &name) {
+  fs::path target = dir / name;
+  std::error_code ec;
+  for (int i = 1; fs::exists(target, ec); ++i)
+    target = dir / (name.stem().string() + "_" + std::to_string(i) +
+                    name.extension().string());
+  return target;
+}
+
+// 改名失败（跨盘）时复制后删除
+bool moveFile(const fs::path &from, const fs::path &to) {
+  std::error_code ec;
+  fs::rename(from, to, ec);
+  if (!ec)
+    return true;
+  if (!fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec))
+    return false;
+  return fs::remove(from, ec);
+}
+
+std::atomic<HotFolder *> g_running{nullptr};
+
+void onSignal(int) {
+  if (HotFolder *h = g_running.load())
+    h->stop();
+}
+
+} // namespace
+
+// ---------------- 配置 ----------------
+
+int loadHotFolderConfig(const std::string &path, HotFolderConfig &config) {
+  std::ifstream in(path);
+  if (!in)
+    return -1;
+  nlohmann::json j = nlohmann::json::parse(in, nullptr, false);
+  if (j.is_discarded() || !j.is_object())
+    return -2;
+
+  // 字段类型不符返回 -4，不抛 json::type_error
+  const auto input = j.value("input", nlohmann::json());
+  if (input.is_string()) {
+    config.inputDirs = {input.get<std::string>()};
+  } else if (input.is_array()) {
+    for (const auto &d : input) {
+      if (!d.is_string())
+        return -4;
+      config.inputDirs.push_back(d.get<std::string>());
+    }
+  } else if (!input.is_null()) {
+    return -4;
+  }
+  if (!readJsonField(j, "output", config.outputDir) ||
+      !readJsonField(j, "error", config.errorDir))
+    return -4;
+  if (config.inputDirs.empty() || config.outputDir.empty() ||
+      config.errorDir.empty())
+    return -3;
+
+  if (!readJsonField(j, "archive", config.archiveDir) ||
+      !readJsonField(j, "templates", config.templateDir) ||
+      !readJsonField(j, "cmykProfile", config.cmykProfile) ||
+      !readJsonField(j, "rgbProfile", config.rgbProfile))
+    return -4;
+
+  if (readPageParams(j, config.params) != 0 ||
+      readCacheConfig(j.value("cache", nlohmann::json()), config.cache) != 0)
+    return -4;
+
+  int64_t memoryMB = config.memoryBudget >> 20;
+  if (!readJsonField(j, "settleMs", config.settleMs) ||
+      !readJsonField(j, "scanMs", config.scanMs) ||
+      !readJsonField(j, "rescanMs", config.rescanMs) ||
+      !readJsonField(j, "maxQueued", config.maxQueued) ||
+      !readJsonField(j, "maxJobs", config.maxJobs) ||
+      !readJsonField(j, "memoryMB", memoryMB) ||
+      !readJsonField(j, "threads", config.threads))
+    return -4;
+  // 左移 20 位不能溢出
+  if (memoryMB <= 0 || memoryMB > (INT64_MAX >> 20))
+    return -4;
+  config.memoryBudget = memoryMB << 20;
+  config.settleMs = std::max(0, config.settleMs);
+  config.scanMs = std::max(50, config.scanMs);
+  config.rescanMs = std::max(config.scanMs, config.rescanMs);
+  config.maxQueued = std::max(1, config.maxQueued);
+  config.maxJobs = std::max(1, config.maxJobs);
+  return 0;
+}
+
+// ---------------- HotFolder ----------------
+
+HotFolder::HotFolder(HotFolderConfig config)
+    : _config(std::move(config)), _cache(_config.cache) {}
+
+HotFolder::~HotFolder() {
+  // 剩余任务由 _jobs 析构时等待（不抛出），它最后声明、最先析构
+#ifdef __linux__
+  if (_inotify >= 0)
+    close(_inotify);
+#endif
+}
+
+int HotFolder::run() {
+  std::error_code ec;
+  for (const std::string &dir : {_config.outputDir, _config.errorDir,
+                                 _config.archiveDir}) {
+    if (!dir.empty())
+      fs::create_directories(dir, ec);
+  }
+  for (const std::string &dir : _config.inputDirs) {
+    if (!fs::is_directory(dir, ec)) {
+      DEBUG << "[HotFolder] input dir not found:" << dir.c_str();
+      return -1;
+    }
+  }
+
+  if (_config.threads > 0)
+    TaskPool::getInstance().configure(_config.threads);
+  if (!_config.cmykProfile.empty() || !_config.rgbProfile.empty())
+    tiffProcess::getInstance().setColorProfiles(_config.cmykProfile,
+                                                _config.rgbProfile);
+  if (!_config.templateDir.empty())
+    DEBUG << "[HotFolder] templates:"
+          << _templates.loadDirectory(_config.templateDir);
+
+#ifdef __linux__
+  _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_inotify >= 0) {
+    for (const std::string &dir : _config.inputDirs) {
+      const int wd = inotify_add_watch(
+          _inotify, dir.c_str(),
+          IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+      if (wd >= 0)
+        _watches[wd] = dir;
+    }
+  }
+#endif
+
+  // 启动前就在目录里的文件也要处理
+  scanDirectories();
+  Clock::time_point lastScan = Clock::now();
+
+  while (!_stop) {
+    watch();
+    const Clock::time_point now = Clock::now();
+    const int rescan = _watches.empty() ? _config.scanMs : _config.rescanMs;
+    if (now - lastScan >= std::chrono::milliseconds(rescan)) {
+      scanDirectories();
+      lastScan = now;
+    }
+    settle(now);
+    dispatch();
+  }
+
+  DEBUG << "[HotFolder] stopping, waiting for" << _running << "jobs";
+  _jobs.wait();
+  return 0;
+}
+
+// 等待 inotify 事件（最多 scanMs），把相关文件登记为待稳定
+void HotFolder::watch() {
+#ifdef __linux__
+  if (_inotify >= 0 && !_watches.empty()) {
+    pollfd pfd{_inotify, POLLIN, 0};
+    if (poll(&pfd, 1, _config.scanMs) <= 0)
+      return;
+    alignas(inotify_event) char buf[16 * 1024];
+    ssize_t len;
+    while ((len = read(_inotify, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + len;) {
+        const auto *e = reinterpret_cast<const inotify_event *>(p);
+        auto it = _watches.find(e->wd);
+        if (it != _watches.end() && e->len > 0 && !(e->mask & IN_ISDIR))
+          notice((fs::path(it->second) / e->name).string());
+        p += sizeof(inotify_event) + e->len;
+      }
+    }
+    return;
+  }
+#endif
+  std::this_thread::sleep_for(std::chrono::milliseconds(_config.scanMs));
+}
+
+void HotFolder::scanDirectories() {
+  for (const std::string &dir : _config.inputDirs) {
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+      if (entry.is_regular_file(ec))
+        notice(entry.path().string());
+    }
+  }
+}
+
+void HotFolder::notice(const std::string &path) {
+  if (!isTiffName(path) || _pending.count(path))
+    return;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_active.count(path) || _stuck.count(path))
+      return;
+  }
+  std::error_code ec;
+  const uintmax_t size = fs::file_size(path, ec);
+  if (ec)
+    return;
+  _pending[path] = {size, mtimeOf(path), Clock::now()};
+}
+
+// 大小 / 修改时间 settleMs 内未变的文件进入队列；队列满时留在 _pending
+void HotFolder::settle(Clock::time_point now) {
+  const auto settleTime = std::chrono::milliseconds(_config.settleMs);
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    std::error_code ec;
+    const uintmax_t size = fs::file_size(it->first, ec);
+    if (ec) { // 已被删除 / 移走
+      it = _pending.erase(it);
+      continue;
+    }
+    Pending &p = it->second;
+    const int64_t mtime = mtimeOf(it->first);
+    if (size != p.size || mtime != p.mtime) {
+      p = {size, mtime, now};
+      ++it;
+      continue;
+    }
+    if (now - p.since < settleTime ||
+        static_cast<int>(_queue.size()) >= _config.maxQueued) {
+      ++it;
+      continue;
+    }
+
+    Job job{it->first, estimateTiffMemory(it->first), ++_nextJobId};
+    if (job.memory < 0) {
+      // 写完仍打不开：不是有效 TIFF
+      finish(job, -1);
+    } else {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _active.insert(job.path);
+      _queue.push_back(std::move(job));
+    }
+    it = _pending.erase(it);
+  }
+}
+
+// 按并发数和内存预算启动排队的文件（先进先出，不插队）
+void HotFolder::dispatch() {
+  while (!_queue.empty()) {
+    const Job &job = _queue.front();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_running >= _config.maxJobs)
+        return;
+      if (_running > 0 && _memoryInUse + job.memory > _config.memoryBudget)
+        return;
+      ++_running;
+      _memoryInUse += job.memory;
+    }
+    DEBUG << "[HotFolder] start" << job.path.c_str() << "est"
+          << (job.memory >> 20) << "MB";
+    _jobs.run([this, job] { process(job); });
+    _queue.pop_front();
+  }
+}
+
+void HotFolder::process(const Job &job) {
+  // 无论成功、失败还是抛异常都要归还并发数和内存预算，否则调度会一直等下去
+  struct Release {
+    HotFolder *self;
+    const Job &job;
+    ~Release() {
+      std::lock_guard<std::mutex> lock(self->_mutex);
+      --self->_running;
+      self->_memoryInUse -= job.memory;
+    }
+  } release{this, job};
+
+  // 异常不能漏到 _jobs：会取消整个组，之后提交的作业都被跳过
+  const fs::path src(job.path);
+  fs::path part;
+  int res;
+  try {
+    // 不同输入目录可能有同名文件，临时文件名带上作业序号
+    part = fs::path(_config.outputDir) /
+           (src.filename().string() + "." + std::to_string(job.id) + ".part");
+
+    // 文件内逐页处理（workers = 1），页内各阶段在线程池上并行；
+    // 同样的稿件和参数处理过时直接取缓存
+    res = processWithCache(
+        &_cache, job.path, part.string(), _config.params, _templates,
+        [&](const std::string &dst) {
+          return tiffProcess::getInstance().genernateMultiPageTiff(
+              job.path, dst, {}, _config.params, _templates, 1);
+        });
+
+    if (res == 0) {
+      std::lock_guard<std::mutex> lock(_moveMutex);
+      const fs::path out = uniquePath(_config.outputDir, src.filename());
+      std::error_code ec;
+      fs::rename(part, out, ec);
+      if (ec)
+        res = -20;
+      else
+        DEBUG << "[HotFolder] done" << out.string().c_str();
+    }
+  } catch (...) {
+    res = -6;
+  }
+
+  std::error_code ec;
+  if (res != 0 && !part.empty())
+    fs::remove(part, ec);
+  try {
+    finish(job, res);
+  } catch (...) {
+    // 原文件状态不明，不再登记，避免反复处理
+    std::lock_guard<std::mutex> lock(_mutex);
+    _active.erase(job.path);
+    _stuck.insert(job.path);
+  }
+}
+
+// 把原文件移出输入目录并释放占用
+void HotFolder::finish(const Job &job, int result) {
+  const fs::path src(job.path);
+  fs::path target;
+  bool moved;
+  {
+    std::lock_guard<std::mutex> lock(_moveMutex);
+    std::error_code ec;
+    if (result == 0) {
+      moved = _config.archiveDir.empty()
+                  ? fs::remove(src, ec)
+                  : moveFile(src,
+                             uniquePath(_config.archiveDir, src.filename()));
+    } else {
+      target = uniquePath(_config.errorDir, src.filename());
+      moved = moveFile(src, target);
+    }
+  }
+  if (result != 0) {
+    std::ofstream log(target.string() + ".error.txt");
+    log << "source: " << job.path << "\nerror: " << result << "\n";
+    DEBUG << "[HotFolder] failed" << job.path.c_str() << result;
+  }
+  if (!moved)
+    DEBUG << "[HotFolder] cannot move" << job.path.c_str();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _active.erase(job.path);
+  if (!moved)
+    _stuck.insert(job.path);
+}
+
+// ---------------- 入口 ----------------
+
+int runHotFolder(const std::string &configPath) {
+  HotFolderConfig config;
+  int res = loadHotFolderConfig(configPath, config);
+  if (res != 0) {
+    DEBUG << "[HotFolder] bad config" << configPath.c_str() << res;
+    return res;
+  }
+
+  HotFolder folder(std::move(config));
+  g_running = &folder;
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+  res = folder.run();
+  g_running = nullptr;
+  return res;
+}
@@ -0,0 +1,115 @@
+#ifndef HOTFOLDER_H
+#define HOTFOLDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "pstemplate.h"
+#include "resultcache.h"
+#include "taskpool.h"
+#include "tiffprocess.h"
+
+// ---------------- 热文件夹 ----------------
+// 无界面常驻模式：监视输入目录（Linux 用 inotify，其他平台及网络共享靠定时扫描兜底），
+// 文件大小 / 修改时间在 settleMs 内不再变化才认为写完，进入有界队列后按配置处理：
+//   成功：结果写入 outputDir（先写 .part 再改名），原文件移到 archiveDir（为空则删除）
+//   失败：原文件移到 errorDir，旁边写 <文件名>.error.txt
+// 背压：队列满时新文件留在输入目录等待，不再登记；同时处理的文件按估算内存
+// （各页解码后的大小）累计不超过 memoryBudget，单个超限的文件只在空闲时单独处理。
+
+struct HotFolderConfig {
+  std::vector<std::string> inputDirs;
+  std::string outputDir;
+  std::string errorDir;
+  std::string archiveDir;  // 为空时处理成功后删除原文件
+  std::string templateDir; // Photoshop 模板目录，按通道布局选择
+  std::string cmykProfile; // ICC（TIFF 未嵌入时使用）
+  std::string rgbProfile;
+  TiffPageParams params;
+  ResultCacheConfig cache; // 结果缓存，dir 为空不启用
+
+  int settleMs = 2000;  // 文件保持不变多久算写完
+  int scanMs = 1000;    // 轮询间隔
+  int rescanMs = 10000; // 有 inotify 时整目录重扫的间隔（网络共享收不到事件）
+  int maxQueued = 32;   // 排队（未开始处理）文件数上限
+  int maxJobs = 2;      // 同时处理的文件数
+  int64_t memoryBudget = int64_t(4) << 30;
+  int threads = 0; // 线程池线程数，<= 0 取 CPU 核数
+};
+
+// 读取 JSON 配置，失败返回负数
+int loadHotFolderConfig(const std::string &path, HotFolderConfig &config);
+
+class HotFolder {
+public:
+  explicit HotFolder(HotFolderConfig config);
+  ~HotFolder();
+
+  HotFolder(const HotFolder &) = delete;
+  HotFolder &operator=(const HotFolder &) = delete;
+
+  // 阻塞运行直到 stop()；正在处理的文件处理完才返回，排队的留在输入目录
+  int run();
+
+  // 可在其他线程或信号处理中调用
+  void stop() { _stop = true; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Pending {
+    uintmax_t size = 0;
+    int64_t mtime = 0;
+    Clock::time_point since; // 最近一次变化的时间
+  };
+
+  struct Job {
+    std::string path;
+    int64_t memory = 0;
+    uint64_t id = 0; // 登记序号，用于区分同名文件的临时输出
+  };
+
+  void watch();
+  void scanDirectories();
+  void notice(const std::string &path);
+  void settle(Clock::time_point now);
+  void dispatch();
+  void process(const Job &job);
+  void finish(const Job &job, int result);
+
+  HotFolderConfig _config;
+  PsTemplateRegistry _templates;
+  ResultCache _cache;
+  std::atomic<bool> _stop{false};
+
+  int _inotify = -1;
+  std::map<int, std::string> _watches; // inotify wd -> 目录
+
+  std::map<std::string, Pending> _pending; // 尚未稳定的文件
+  std::deque<Job> _queue;                  // 已稳定，等待处理
+  uint64_t _nextJobId = 0;
+
+  std::mutex _mutex; // 以下由处理任务更新
+  std::set<std::string> _active; // 排队 + 处理中（仍在输入目录）
+  std::set<std::string> _stuck;  // 处理完但移不走的原文件，不再登记
+  int _running = 0;
+  int64_t _memoryInUse = 0;
+
+  // 并行的作业各自找空闲文件名再改名，查找和改名要一起做，
+  // 否则同名文件可能选中同一个目标而互相覆盖
+  std::mutex _moveMutex;
+
+  TaskGroup _jobs; // 处理任务在共用线程池上运行
+};
+
+// 无界面入口：加载配置并运行，Ctrl+C / SIGTERM 停止
+int runHotFolder(const std::string &configPath);
+
+#endif // HOTFOLDER_H
@@ -0,0 +1,119 @@
+#include "kernelregistry.h"
+
+#include <cctype>
+#include <cstdlib>
+
+#include "utils.h"
+
+namespace {
+
+std::string envName(const std::string &stage) {
+  std::string name = "TIFFPROCESS_KERNEL_";
+  for (char c : stage)
+    name += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  return name;
+}
+
+} // namespace
+
+KernelRegistry &KernelRegistry::getInstance() {
+  static KernelRegistry instance;
+  return instance;
+}
+
+KernelRegistry::KernelRegistry() {
+  if (const char *v = std::getenv("TIFFPROCESS_KERNEL_VERIFY"))
+    _verifyEvery = std::max(0, std::atoi(v));
+}
+
+void KernelRegistry::add(const std::string &stage, const std::string &variant,
+                         bool isDefault) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Stage &s = _stages[stage];
+  if (s.variants.empty()) {
+    s.defaultVariant = variant;
+    if (const char *env = std::getenv(envName(stage).c_str()))
+      s.envVariant = env;
+  }
+  s.variants.push_back(variant);
+  if (isDefault)
+    s.defaultVariant = variant;
+}
+
+std::vector<std::string> KernelRegistry::stages() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<std::string> names;
+  for (const auto &kv : _stages)
+    names.push_back(kv.first);
+  return names;
+}
+
+std::vector<std::string>
+KernelRegistry::variants(const std::string &stage) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _stages.find(stage);
+  return it == _stages.end() ? std::vector<std::string>{} : it->second.variants;
+}
+
+std::string KernelRegistry::reference(const std::string &stage) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _stages.find(stage);
+  return it == _stages.end() ? std::string{} : it->second.variants.front();
+}
+
+int KernelRegistry::select(const std::string &stage,
+                           const std::string &variant) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _stages.find(stage);
+  if (it == _stages.end())
+    return -1;
+  Stage &s = it->second;
+  if (!variant.empty() &&
+      std::find(s.variants.begin(), s.variants.end(), variant) ==
+          s.variants.end())
+    return -1;
+  s.configVariant = variant;
+  return 0;
+}
+
+std::string KernelRegistry::selected(const std::string &stage) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _stages.find(stage);
+  if (it == _stages.end())
+    return {};
+  const Stage &s = it->second;
+  auto known = [&](const std::string &name) {
+    return !name.empty() && std::find(s.variants.begin(), s.variants.end(),
+                                      name) != s.variants.end();
+  };
+  if (known(s.envVariant))
+    return s.envVariant;
+  if (known(s.configVariant))
+    return s.configVariant;
+  return s.defaultVariant;
+}
+
+void KernelRegistry::reportMismatch(const KernelMismatch &m) {
+  const size_t n = ++_mismatchCount;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_mismatches.size() < kMaxRecords)
+      _mismatches.push_back(m);
+  }
+  // 同一批数据可能连续出错，只打印前几条
+  if (n <= 16)
+    DEBUG << "[Kernel] mismatch" << m.stage.c_str() << m.variant.c_str()
+          << "row" << m.row << "offset" << static_cast<int>(m.offset) << "got"
+          << static_cast<int>(m.got) << "expect" << static_cast<int>(m.expect);
+}
+
+std::vector<KernelMismatch> KernelRegistry::mismatches() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _mismatches;
+}
+
+void KernelRegistry::clearMismatches() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _mismatches.clear();
+  _mismatchCount = 0;
+}
@@ -0,0 +1,148 @@
+#ifndef KERNELREGISTRY_H
+#define KERNELREGISTRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ---------------- 内核变体注册表 ----------------
+// 同一处理阶段可以有多种实现（scalar 参考实现、sse2、lut ...），按名字登记后运行时选择：
+//   环境变量 TIFFPROCESS_KERNEL_<STAGE>=<variant>（如 TIFFPROCESS_KERNEL_BLACKNESS=scalar）
+//   配置：KernelRegistry::select
+// 优先级：环境变量 > 配置 > 默认实现，便于现场直接退回参考实现。
+//
+// 校验模式：TIFFPROCESS_KERNEL_VERIFY=<N>（或 setVerify(N)）时每 N 个行带
+// （kBandRows 行）抽一个，在其中各行上同时运行参考实现逐字节比较；
+// 不一致时记录并打印，输出改用参考实现的结果。
+
+struct KernelMismatch {
+  std::string stage;
+  std::string variant;
+  int row;        // 出错行（相对于该次调用的输入）
+  size_t offset;  // 行内第一个不同字节
+  uint8_t got;
+  uint8_t expect;
+};
+
+class KernelRegistry {
+public:
+  static KernelRegistry &getInstance();
+
+  static constexpr int kBandRows = 64;
+
+  // 登记变体；每个阶段第一个登记的是参考实现，isDefault 为未选择时使用的实现
+  void add(const std::string &stage, const std::string &variant,
+           bool isDefault);
+
+  std::vector<std::string> stages() const;
+  std::vector<std::string> variants(const std::string &stage) const;
+  std::string reference(const std::string &stage) const;
+
+  // 配置选择；阶段或变体未登记返回 -1，空名字恢复默认
+  int select(const std::string &stage, const std::string &variant);
+
+  // 当前使用的变体名
+  std::string selected(const std::string &stage) const;
+
+  // 每 everyBands 个行带校验一个，0 关闭
+  void setVerify(int everyBands) { _verifyEvery = std::max(0, everyBands); }
+  int verifyEvery() const { return _verifyEvery; }
+  bool verifyRow(int row) const {
+    const int every = _verifyEvery;
+    return every > 0 && (row / kBandRows) % every == 0;
+  }
+
+  void reportMismatch(const KernelMismatch &m);
+  size_t mismatchCount() const { return _mismatchCount; }
+  // 最多保留前 kMaxRecords 条
+  std::vector<KernelMismatch> mismatches() const;
+  void clearMismatches();
+
+private:
+  KernelRegistry();
+  ~KernelRegistry() = default;
+
+  KernelRegistry(const KernelRegistry &) = delete;
+  KernelRegistry &operator=(const KernelRegistry &) = delete;
+
+  struct Stage {
+    std::vector<std::string> variants; // [0] 为参考实现
+    std::string defaultVariant;
+    std::string envVariant; // 登记时读取的环境变量
+    std::string configVariant;
+  };
+
+  static constexpr size_t kMaxRecords = 256;
+
+  mutable std::mutex _mutex;
+  std::map<std::string, Stage> _stages;
+  std::atomic<int> _verifyEvery{0};
+  std::atomic<size_t> _mismatchCount{0};
+  std::vector<KernelMismatch> _mismatches;
+};
+
+// 一个阶段的函数表，Fn 为行内核的函数指针类型；variants[0] 为参考实现
+template <typename Fn> class KernelStage {
+public:
+  struct Variant {
+    const char *name;
+    Fn fn;
+  };
+
+  // 本次调用使用的实现；verify 为 true 时需在抽样行上调用 check
+  struct Resolved {
+    Fn fn;
+    Fn reference;
+    const char *variant;
+    bool verify;
+  };
+
+  KernelStage(const char *stage, std::vector<Variant> variants,
+              const char *defaultVariant)
+      : _stage(stage), _variants(std::move(variants)) {
+    for (const Variant &v : _variants)
+      KernelRegistry::getInstance().add(
+          _stage, v.name, std::strcmp(v.name, defaultVariant) == 0);
+  }
+
+  const char *name() const { return _stage; }
+
+  Resolved resolve() const {
+    KernelRegistry &registry = KernelRegistry::getInstance();
+    const std::string selected = registry.selected(_stage);
+    Resolved k{_variants[0].fn, _variants[0].fn, _variants[0].name, false};
+    for (const Variant &v : _variants) {
+      if (selected == v.name) {
+        k.fn = v.fn;
+        k.variant = v.name;
+      }
+    }
+    k.verify = k.fn != k.reference && registry.verifyEvery() > 0;
+    return k;
+  }
+
+  // 比较选中实现与参考实现的一行输出；不一致时记录，并用参考结果覆盖
+  bool check(const Resolved &k, int row, uint8_t *got, const uint8_t *expect,
+             size_t n) const {
+    if (std::memcmp(got, expect, n) == 0)
+      return true;
+    size_t i = 0;
+    while (got[i] == expect[i])
+      ++i;
+    KernelRegistry::getInstance().reportMismatch(
+        {_stage, k.variant, row, i, got[i], expect[i]});
+    std::memcpy(got, expect, n);
+    return false;
+  }
+
+private:
+  const char *_stage;
+  std::vector<Variant> _variants;
+};
+
+#endif // KERNELREGISTRY_H
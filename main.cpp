@@ -1,9 +1,42 @@
 #include <QApplication>
 #include <opencv2/opencv.hpp>
 
+#include <cstring>
+
+#include "batchrunner.h"
+#include "hotfolder.h"
 #include "mainwindow.h"
 
+#ifdef _WIN32
+#include <windows.h>
+
+#include <cstdio>
+
+// 程序按 Windows 子系统链接，没有控制台：无界面模式挂到启动它的控制台
+// （没有则新建一个），日志才有地方输出，Ctrl+C 也才能送达
+static void attachConsole() {
+  if (!AttachConsole(ATTACH_PARENT_PROCESS) && !AllocConsole())
+    return;
+  std::freopen("CONOUT$", "w", stdout);
+  std::freopen("CONOUT$", "w", stderr);
+  std::freopen("CONIN$", "r", stdin);
+}
+#else
+static void attachConsole() {}
+#endif
+
 int main(int argc, char* argv[]) {
+  // 无界面热文件夹模式：tiffProcessDemo --hotfolder <config.json>
+  if (argc >= 3 && std::strcmp(argv[1], "--hotfolder") == 0) {
+    attachConsole();
+    return runHotFolder(argv[2]);
+  }
+  // 批量作业：tiffProcessDemo --batch <manifest.json> [report.json]
+  if (argc >= 3 && std::strcmp(argv[1], "--batch") == 0) {
+    attachConsole();
+    return runBatch(argv[2], argc >= 4 ? argv[3] : "");
+  }
+
   qputenv("QT_IMAGEIO_MAXALLOC",
           QByteArray::number(1024 * 1024 * 1024));  // 1GB
 
@@ -36,17 +36,19 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
       QByteArray path = fileName.toLocal8Bit();
       const char *cpath = path.constData();
       if (getFileType(fileName) == "TIFF") {
+        // openTiffImage 内部已设置为当前图像（含预览代理）
         cv::Mat openimage = tiffProcessAPI::getInstance().openTiffImage(
             std::string_view(cpath));
         QPixmap pix = cvMatToQPixmap(openimage);
         imageView->setImage(pix);
-        tiffProcessAPI::getInstance().setcvMatImage(openimage);
+        controlPanel->updateHistoryButtons(); // 新图清空了撤销记录
         return;
       }
       QPixmap pix(fileName);
       imageView->setImage(pix); // 左侧显示图像
       cv::Mat input = cv::imread(cpath, cv::IMREAD_UNCHANGED);
       tiffProcessAPI::getInstance().setcvMatImage(input); // 左侧显示图像
+      controlPanel->updateHistoryButtons();
     }
   });
 
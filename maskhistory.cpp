@@ -0,0 +1,331 @@
+#include "maskhistory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "taskpool.h"
+
+namespace {
+
+constexpr int kTileSize = 256;
+constexpr int kTileWords = kTileSize / 64;
+
+// PackBits（与 TIFF 的 PackBits 压缩相同）：
+//   n in [0, 127]   : 其后 n + 1 个字节原样复制
+//   n in [-127, -1] : 其后 1 个字节重复 1 - n 次
+void packBitsEncode(const uint8_t *src, size_t n, std::vector<uint8_t> &out) {
+  out.clear();
+  size_t i = 0;
+  while (i < n) {
+    size_t run = 1;
+    while (i + run < n && run < 128 && src[i + run] == src[i])
+      ++run;
+    if (run >= 2) {
+      out.push_back(static_cast<uint8_t>(257 - run));
+      out.push_back(src[i]);
+      i += run;
+      continue;
+    }
+    // 原样段：直到出现至少 3 个相同字节或满 128 个
+    const size_t start = i;
+    while (i < n && i - start < 128) {
+      if (i + 2 < n && src[i] == src[i + 1] && src[i] == src[i + 2])
+        break;
+      ++i;
+    }
+    out.push_back(static_cast<uint8_t>(i - start - 1));
+    out.insert(out.end(), src + start, src + i);
+  }
+}
+
+bool packBitsDecode(const std::vector<uint8_t> &src, uint8_t *dst,
+                    size_t size) {
+  const size_t n = src.size();
+  size_t i = 0, o = 0;
+  while (i < n) {
+    const int c = static_cast<int8_t>(src[i++]);
+    if (c >= 0) {
+      const size_t len = static_cast<size_t>(c) + 1;
+      if (i + len > n || o + len > size)
+        return false;
+      std::memcpy(dst + o, src.data() + i, len);
+      i += len;
+      o += len;
+    } else if (c != -128) {
+      const size_t len = static_cast<size_t>(1 - c);
+      if (i >= n || o + len > size)
+        return false;
+      std::memset(dst + o, src[i++], len);
+      o += len;
+    }
+  }
+  return o == size;
+}
+
+// 不解码，直接判断 src 压缩的内容是否就是 raw（遇到不同立即返回）
+bool packBitsEquals(const std::vector<uint8_t> &src, const uint8_t *raw,
+                    size_t size) {
+  const size_t n = src.size();
+  size_t i = 0, o = 0;
+  while (i < n) {
+    const int c = static_cast<int8_t>(src[i++]);
+    if (c >= 0) {
+      const size_t len = static_cast<size_t>(c) + 1;
+      if (i + len > n || o + len > size ||
+          std::memcmp(raw + o, src.data() + i, len) != 0)
+        return false;
+      i += len;
+      o += len;
+    } else if (c != -128) {
+      const size_t len = static_cast<size_t>(1 - c);
+      if (i >= n || o + len > size)
+        return false;
+      const uint8_t v = src[i++];
+      for (size_t k = 0; k < len; ++k)
+        if (raw[o + k] != v)
+          return false;
+      o += len;
+    }
+  }
+  return o == size;
+}
+
+} // namespace
+
+// ---------------- TiledLayer ----------------
+
+cv::Rect TiledLayer::tileRect(size_t i) const {
+  const int tx = static_cast<int>(i % _tilesX);
+  const int ty = static_cast<int>(i / _tilesX);
+  const int x = tx * kTileSize, y = ty * kTileSize;
+  return cv::Rect(x, y, std::min(kTileSize, _width - x),
+                  std::min(kTileSize, _height - y));
+}
+
+bool TiledLayer::sameLayout(const TiledLayer *other) const {
+  return other && other->_bits == _bits && other->_width == _width &&
+         other->_height == _height;
+}
+
+TiledLayer::TiledLayer(const BitMask &mask, const TiledLayer *prev)
+    : _bits(true), _width(mask.width()), _height(mask.height()) {
+  if (mask.empty()) {
+    _width = _height = 0;
+    return;
+  }
+  _tilesX = (_width + kTileSize - 1) / kTileSize;
+  const int tilesY = (_height + kTileSize - 1) / kTileSize;
+  _tiles.resize(static_cast<size_t>(_tilesX) * tilesY);
+  const bool share = sameLayout(prev);
+
+  parallelFor(cv::Range(0, static_cast<int>(_tiles.size())),
+              [&](const cv::Range &range) {
+                thread_local std::vector<uint8_t> raw;
+                std::vector<uint8_t> packed;
+                for (int i = range.start; i < range.end; ++i) {
+                  const cv::Rect r = tileRect(i);
+                  const size_t w0 = r.x / 64;
+                  const size_t words =
+                      std::min<size_t>(kTileWords, mask.wordsPerRow() - w0);
+                  raw.resize(words * 8 * r.height);
+                  for (int y = 0; y < r.height; ++y)
+                    std::memcpy(raw.data() + y * words * 8,
+                                mask.row(r.y + y) + w0, words * 8);
+                  // 先与上一状态的块比较，没变的块不再压缩
+                  if (share && packBitsEquals(*prev->_tiles[i], raw.data(),
+                                              raw.size())) {
+                    _tiles[i] = prev->_tiles[i];
+                    continue;
+                  }
+                  packBitsEncode(raw.data(), raw.size(), packed);
+                  _tiles[i] = std::make_shared<const std::vector<uint8_t>>(
+                      std::move(packed));
+                }
+              });
+}
+
+TiledLayer::TiledLayer(const cv::Mat &mat, const TiledLayer *prev)
+    : _bits(false), _width(mat.cols), _height(mat.rows) {
+  if (mat.empty() || mat.type() != CV_8UC1) {
+    _width = _height = 0;
+    return;
+  }
+  _tilesX = (_width + kTileSize - 1) / kTileSize;
+  const int tilesY = (_height + kTileSize - 1) / kTileSize;
+  _tiles.resize(static_cast<size_t>(_tilesX) * tilesY);
+  const bool share = sameLayout(prev);
+
+  parallelFor(cv::Range(0, static_cast<int>(_tiles.size())),
+              [&](const cv::Range &range) {
+                thread_local std::vector<uint8_t> raw;
+                std::vector<uint8_t> packed;
+                for (int i = range.start; i < range.end; ++i) {
+                  const cv::Rect r = tileRect(i);
+                  raw.resize(static_cast<size_t>(r.width) * r.height);
+                  for (int y = 0; y < r.height; ++y)
+                    std::memcpy(raw.data() + y * r.width,
+                                mat.ptr<uint8_t>(r.y + y) + r.x, r.width);
+                  // 先与上一状态的块比较，没变的块不再压缩
+                  if (share && packBitsEquals(*prev->_tiles[i], raw.data(),
+                                              raw.size())) {
+                    _tiles[i] = prev->_tiles[i];
+                    continue;
+                  }
+                  packBitsEncode(raw.data(), raw.size(), packed);
+                  _tiles[i] = std::make_shared<const std::vector<uint8_t>>(
+                      std::move(packed));
+                }
+              });
+}
+
+int TiledLayer::restore(BitMask &dst, const TiledLayer *current) const {
+  if (_width == 0) {
+    dst = BitMask();
+    return 0;
+  }
+  if (!_bits)
+    return -1;
+  const bool partial =
+      sameLayout(current) && dst.size() == cv::Size(_width, _height);
+  if (!partial)
+    dst.create(_width, _height);
+
+  std::atomic<bool> failed{false};
+  parallelFor(cv::Range(0, static_cast<int>(_tiles.size())),
+              [&](const cv::Range &range) {
+                thread_local std::vector<uint8_t> raw;
+                for (int i = range.start; i < range.end; ++i) {
+                  if (partial && current->_tiles[i] == _tiles[i])
+                    continue;
+                  const cv::Rect r = tileRect(i);
+                  const size_t w0 = r.x / 64;
+                  const size_t words =
+                      std::min<size_t>(kTileWords, dst.wordsPerRow() - w0);
+                  raw.resize(words * 8 * r.height);
+                  if (!packBitsDecode(*_tiles[i], raw.data(), raw.size())) {
+                    failed = true;
+                    continue;
+                  }
+                  for (int y = 0; y < r.height; ++y)
+                    std::memcpy(dst.row(r.y + y) + w0,
+                                raw.data() + y * words * 8, words * 8);
+                }
+              });
+  return failed ? -2 : 0;
+}
+
+int TiledLayer::restore(cv::Mat &dst, const TiledLayer *current) const {
+  if (_width == 0) {
+    dst.release();
+    return 0;
+  }
+  if (_bits)
+    return -1;
+  const bool partial = sameLayout(current) && dst.type() == CV_8UC1 &&
+                       dst.size() == cv::Size(_width, _height);
+  if (!partial)
+    dst.create(_height, _width, CV_8UC1);
+
+  std::atomic<bool> failed{false};
+  parallelFor(cv::Range(0, static_cast<int>(_tiles.size())),
+              [&](const cv::Range &range) {
+                thread_local std::vector<uint8_t> raw;
+                for (int i = range.start; i < range.end; ++i) {
+                  if (partial && current->_tiles[i] == _tiles[i])
+                    continue;
+                  const cv::Rect r = tileRect(i);
+                  raw.resize(static_cast<size_t>(r.width) * r.height);
+                  if (!packBitsDecode(*_tiles[i], raw.data(), raw.size())) {
+                    failed = true;
+                    continue;
+                  }
+                  for (int y = 0; y < r.height; ++y)
+                    std::memcpy(dst.ptr<uint8_t>(r.y + y) + r.x,
+                                raw.data() + y * r.width, r.width);
+                }
+              });
+  return failed ? -2 : 0;
+}
+
+size_t TiledLayer::bytes(const TiledLayer *except) const {
+  const bool shared = sameLayout(except);
+  size_t sum = 0;
+  for (size_t i = 0; i < _tiles.size(); ++i)
+    if (!shared || except->_tiles[i] != _tiles[i])
+      sum += _tiles[i]->size();
+  return sum;
+}
+
+// ---------------- MaskHistory ----------------
+
+MaskHistory::MaskHistory(size_t maxBytes) : _maxBytes(maxBytes) {}
+
+void MaskHistory::setMaxBytes(size_t maxBytes) {
+  _maxBytes = maxBytes;
+  evict();
+}
+
+void MaskHistory::clear() {
+  _states.clear();
+  _bytes.clear();
+  _index = 0;
+  _total = 0;
+}
+
+size_t MaskHistory::stateBytes(size_t i) const {
+  const MaskState &s = _states[i];
+  const MaskState *prev = i > 0 ? &_states[i - 1] : nullptr;
+  return s.transparent.bytes(prev ? &prev->transparent : nullptr) +
+         s.processTransparent.bytes(prev ? &prev->processTransparent
+                                         : nullptr) +
+         s.white.bytes(prev ? &prev->white : nullptr);
+}
+
+void MaskHistory::push(MaskState state) {
+  while (canRedo()) {
+    _total -= _bytes.back();
+    _states.pop_back();
+    _bytes.pop_back();
+  }
+  _states.push_back(std::move(state));
+  _bytes.push_back(stateBytes(_states.size() - 1));
+  _total += _bytes.back();
+  _index = _states.size() - 1;
+  evict();
+}
+
+const MaskState *MaskHistory::current() const {
+  return _states.empty() ? nullptr : &_states[_index];
+}
+
+const MaskState *MaskHistory::undo() {
+  if (!canUndo())
+    return nullptr;
+  return &_states[--_index];
+}
+
+const MaskState *MaskHistory::redo() {
+  if (!canRedo())
+    return nullptr;
+  return &_states[++_index];
+}
+
+void MaskHistory::evict() {
+  // 先丢最旧的撤销记录；丢掉后新的最旧状态独占它所有的块
+  while (_total > _maxBytes && _index > 0) {
+    _total -= _bytes.front();
+    _states.pop_front();
+    _bytes.pop_front();
+    --_index;
+    _total -= _bytes.front();
+    _bytes.front() = stateBytes(0);
+    _total += _bytes.front();
+  }
+  // 仍超出时丢重做记录，当前状态保留
+  while (_total > _maxBytes && canRedo()) {
+    _total -= _bytes.back();
+    _states.pop_back();
+    _bytes.pop_back();
+  }
+}
@@ -0,0 +1,93 @@
+#ifndef MASKHISTORY_H
+#define MASKHISTORY_H
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "bitmask.h"
+
+// ---------------- 撤销 / 重做 ----------------
+// 蒙版状态按 256x256 像素切块，每块用 PackBits 压缩（蒙版基本是大段 0 / 255，
+// 压缩后通常只有原来的几十分之一）。新状态的每块先直接与上一状态的压缩块比较，
+// 相同的块共用（写时复制），只有改动过的块才压缩、占新内存；
+// 切换状态时也只解码不同的块。
+// 历史总大小超过上限时从最旧的状态开始丢弃，当前状态总是保留。
+
+// 一层蒙版（BitMask 或 CV_8UC1）的分块快照，块只读、可在快照间共用
+class TiledLayer {
+public:
+  TiledLayer() = default;
+  // prev 尺寸与类型相同时，内容未变的块与 prev 共用
+  TiledLayer(const BitMask &mask, const TiledLayer *prev);
+  TiledLayer(const cv::Mat &mat, const TiledLayer *prev);
+
+  // 解码到 dst（空快照得到空蒙版）。
+  // current 与本快照尺寸类型相同且 dst 当前内容就是 current 时，只解码不同的块
+  int restore(BitMask &dst, const TiledLayer *current = nullptr) const;
+  int restore(cv::Mat &dst, const TiledLayer *current = nullptr) const;
+
+  // 压缩后的字节数；except 非空时不计与 except 共用的块
+  size_t bytes(const TiledLayer *except = nullptr) const;
+
+private:
+  using Tile = std::shared_ptr<const std::vector<uint8_t>>;
+
+  bool sameLayout(const TiledLayer *other) const;
+  cv::Rect tileRect(size_t i) const;
+
+  bool _bits = false; // BitMask / CV_8UC1
+  int _width = 0;
+  int _height = 0;
+  int _tilesX = 0;
+  std::vector<Tile> _tiles;
+};
+
+// 一次操作后的完整状态
+struct MaskState {
+  TiledLayer transparent;
+  TiledLayer processTransparent;
+  TiledLayer white;
+  int blackThresh = -1;
+  bool showProcessed = false; // 预览显示去杂点后的蒙版
+};
+
+class MaskHistory {
+public:
+  explicit MaskHistory(size_t maxBytes = size_t(512) << 20);
+
+  void setMaxBytes(size_t maxBytes);
+  size_t maxBytes() const { return _maxBytes; }
+  size_t bytes() const { return _total; }
+
+  void clear();
+
+  // 在当前位置之后追加新状态（丢弃重做记录），超出上限时淘汰
+  void push(MaskState state);
+
+  // 当前状态，没有记录时为空
+  const MaskState *current() const;
+
+  bool canUndo() const { return _index > 0; }
+  bool canRedo() const { return _index + 1 < _states.size(); }
+
+  // 移动到上一个 / 下一个状态并返回它，不能移动返回空
+  const MaskState *undo();
+  const MaskState *redo();
+
+private:
+  // 状态 i 独占的字节数（与上一状态共用的块算在上一状态）
+  size_t stateBytes(size_t i) const;
+  void evict();
+
+  std::deque<MaskState> _states;
+  std::deque<size_t> _bytes;
+  size_t _index = 0;
+  size_t _total = 0;
+  size_t _maxBytes;
+};
+
+#endif // MASKHISTORY_H
@@ -0,0 +1,297 @@
+#include "maxtree.h"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <limits>
+
+#include "taskpool.h"
+
+namespace {
+
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+// 每条带约 256K 像素：条带内按水平顺序访问是随机的，工作集要留在缓存里
+constexpr int kStripPixels = 1 << 18;
+
+struct Strip {
+  int y0 = 0;
+  int y1 = 0;
+  int width = 0;
+  uint32_t begin() const { return uint32_t(y0) * width; }
+  uint32_t end() const { return uint32_t(y1) * width; }
+};
+
+uint32_t findRoot(uint32_t *zpar, uint32_t p) {
+  uint32_t r = p;
+  while (zpar[r] != r)
+    r = zpar[r];
+  while (zpar[p] != r) {
+    const uint32_t next = zpar[p];
+    zpar[p] = r;
+    p = next;
+  }
+  return r;
+}
+
+// 同水平链的顶端（该水平连通域的代表像素）
+inline uint32_t levelRoot(const uint8_t *f, const uint32_t *parent,
+                          uint32_t x) {
+  while (parent[x] != x && f[parent[x]] == f[x])
+    x = parent[x];
+  return x;
+}
+
+inline bool isCanonical(const uint8_t *f, const uint32_t *parent, uint32_t p) {
+  return parent[p] == p || f[parent[p]] != f[p];
+}
+
+// 条带内建树：计数排序后按水平从低到高加入像素，
+// 与已加入的 8 邻域所在子树的根合并，根挂到新像素下
+void buildStrip(const uint8_t *f, const Strip &s, uint32_t *parent,
+                uint32_t *zpar) {
+  const int w = s.width;
+  const uint32_t begin = s.begin(), end = s.end();
+
+  uint32_t start[257] = {};
+  for (uint32_t p = begin; p < end; ++p)
+    ++start[f[p] + 1];
+  for (int v = 0; v < 256; ++v)
+    start[v + 1] += start[v];
+  thread_local std::vector<uint32_t> order;
+  order.resize(end - begin);
+  for (uint32_t p = begin; p < end; ++p)
+    order[start[f[p]]++] = p;
+
+  std::fill(zpar + begin, zpar + end, kNone);
+  for (const uint32_t p : order) {
+    parent[p] = p;
+    zpar[p] = p;
+    const int y = static_cast<int>(p / w), x = static_cast<int>(p % w);
+    for (int ny = std::max(s.y0, y - 1); ny <= std::min(s.y1 - 1, y + 1);
+         ++ny) {
+      for (int nx = std::max(0, x - 1); nx <= std::min(w - 1, x + 1); ++nx) {
+        const uint32_t q = static_cast<uint32_t>(ny) * w + nx;
+        if (q == p || zpar[q] == kNone)
+          continue;
+        const uint32_t r = findRoot(zpar, q);
+        if (r != p) {
+          parent[r] = p;
+          zpar[r] = p;
+        }
+      }
+    }
+  }
+
+  // 逆序（父节点先处理）把同水平的父节点上提到代表像素
+  for (size_t i = order.size(); i-- > 0;) {
+    const uint32_t p = order[i];
+    const uint32_t q = parent[p];
+    if (f[parent[q]] == f[q])
+      parent[p] = parent[q];
+  }
+}
+
+// 合并相邻像素 a、b 所在的两棵树：
+// 从两者中较低的代表节点往上走，按水平把另一条祖先链交错插入
+void connect(const uint8_t *f, uint32_t *parent, uint32_t a, uint32_t b) {
+  uint32_t x = levelRoot(f, parent, a);
+  uint32_t y = levelRoot(f, parent, b);
+  if (f[x] > f[y])
+    std::swap(x, y);
+  while (x != y && y != kNone) {
+    const uint32_t z =
+        parent[x] == x ? kNone : levelRoot(f, parent, parent[x]);
+    if (z != kNone && f[z] <= f[y]) {
+      x = z;
+      continue;
+    }
+    parent[x] = y;
+    x = y;
+    y = z;
+  }
+}
+
+} // namespace
+
+void MaxTree::clear() {
+  _width = _height = 0;
+  std::vector<uint32_t>().swap(_nodeOf);
+  std::vector<uint8_t>().swap(_level);
+  std::vector<uint32_t>().swap(_parent);
+  std::vector<uint32_t>().swap(_area);
+  std::fill(_levelStart, _levelStart + 257, 0);
+}
+
+int MaxTree::build(const cv::Mat &image) {
+  clear();
+  if (image.empty() || image.type() != CV_8UC1)
+    return -1;
+  const int w = image.cols, h = image.rows;
+  if (static_cast<uint64_t>(w) * h >= uint64_t(INT_MAX))
+    return -2;
+  const uint32_t n = static_cast<uint32_t>(w) * h;
+
+  const cv::Mat img = image.isContinuous() ? image : image.clone();
+  const uint8_t *f = img.data;
+
+  std::vector<uint32_t> parent(n), zpar(n);
+
+  // -------- 各条带独立建树 --------
+  const int rows = std::max(2, (kStripPixels + w - 1) / w);
+  const int strips = std::max(1, h / rows);
+  std::vector<Strip> strip(strips);
+  for (int k = 0; k < strips; ++k) {
+    strip[k].y0 = static_cast<int>(int64_t(h) * k / strips);
+    strip[k].y1 = static_cast<int>(int64_t(h) * (k + 1) / strips);
+    strip[k].width = w;
+  }
+  parallelFor(
+      cv::Range(0, strips),
+      [&](const cv::Range &range) {
+        for (int k = range.start; k < range.end; ++k)
+          buildStrip(f, strip[k], parent.data(), zpar.data());
+      },
+      1);
+
+  // -------- 相邻条带两两合并 --------
+  // 第 step 轮合并边界 (2i + 1) * step 两侧，各边界涉及的条带互不相交，可并行
+  for (int step = 1; step < strips; step *= 2) {
+    const int pairs = (strips - step + 2 * step - 1) / (2 * step);
+    parallelFor(
+        cv::Range(0, pairs),
+        [&](const cv::Range &range) {
+          for (int i = range.start; i < range.end; ++i) {
+            const int yb = strip[(2 * i + 1) * step].y0;
+            const uint32_t up = static_cast<uint32_t>(yb - 1) * w;
+            const uint32_t down = static_cast<uint32_t>(yb) * w;
+            for (int x = 0; x < w; ++x)
+              for (int nx = std::max(0, x - 1); nx <= std::min(w - 1, x + 1);
+                   ++nx)
+                connect(f, parent.data(), up + x, down + nx);
+          }
+        },
+        1);
+  }
+
+  // -------- 压缩同水平节点 --------
+  // 之后非代表像素直接指向所在水平的代表像素
+  for (uint32_t p = 0; p < n; ++p) {
+    const uint32_t r = levelRoot(f, parent.data(), p);
+    for (uint32_t x = p; x != r;) {
+      const uint32_t next = parent[x];
+      parent[x] = r;
+      x = next;
+    }
+  }
+
+  // -------- 按水平升序给代表像素编号 --------
+  // 各条带按行扫描统计每个水平的代表像素数，前缀和得到 (水平, 条带) 的起始编号，
+  // 同一水平内按条带、行顺序编号；全程顺序访问
+  std::vector<std::array<uint32_t, 256>> base(strips);
+  parallelFor(
+      cv::Range(0, strips),
+      [&](const cv::Range &range) {
+        for (int k = range.start; k < range.end; ++k) {
+          base[k].fill(0);
+          for (uint32_t p = strip[k].begin(); p < strip[k].end(); ++p)
+            if (isCanonical(f, parent.data(), p))
+              ++base[k][f[p]];
+        }
+      },
+      1);
+  uint32_t count = 0;
+  for (int v = 0; v < 256; ++v) {
+    _levelStart[v] = count;
+    for (int k = 0; k < strips; ++k) {
+      const uint32_t c = base[k][v];
+      base[k][v] = count;
+      count += c;
+    }
+  }
+  _levelStart[256] = count;
+
+  uint32_t *nodeOf = zpar.data();
+  parallelFor(
+      cv::Range(0, strips),
+      [&](const cv::Range &range) {
+        for (int k = range.start; k < range.end; ++k)
+          for (uint32_t p = strip[k].begin(); p < strip[k].end(); ++p)
+            if (isCanonical(f, parent.data(), p))
+              nodeOf[p] = base[k][f[p]]++;
+      },
+      1);
+
+  // 非代表像素取所在代表像素的编号；代表像素的父节点若不是代表像素，
+  // 压缩后它的 parent 就是代表像素
+  _level.resize(count);
+  _parent.resize(count);
+  parallelFor(
+      cv::Range(0, strips),
+      [&](const cv::Range &range) {
+        for (int k = range.start; k < range.end; ++k)
+          for (uint32_t p = strip[k].begin(); p < strip[k].end(); ++p) {
+            if (!isCanonical(f, parent.data(), p)) {
+              nodeOf[p] = nodeOf[parent[p]];
+              continue;
+            }
+            uint32_t pc = parent[p];
+            if (!isCanonical(f, parent.data(), pc))
+              pc = parent[pc];
+            const uint32_t id = nodeOf[p];
+            _level[id] = f[p];
+            _parent[id] = pc == p ? id : nodeOf[pc];
+          }
+      },
+      1);
+
+  // -------- 面积：自身像素 + 子节点（父节点编号更大，升序累加即可） --------
+  _area.assign(count, 0);
+  for (uint32_t p = 0; p < n; ++p)
+    ++_area[nodeOf[p]];
+  for (uint32_t id = 0; id < count; ++id)
+    if (_parent[id] != id)
+      _area[_parent[id]] += _area[id];
+
+  _nodeOf = std::move(zpar);
+  _width = w;
+  _height = h;
+  return 0;
+}
+
+int MaxTree::reconstruct(int thresh, int minArea, BitMask &dst) const {
+  if (empty())
+    return -1;
+  dst.create(_width, _height);
+
+  // 水平 <= thresh 的节点编号为 [0, live)
+  const int t = std::clamp(thresh, -1, 255);
+  const uint32_t live = t < 0 ? 0 : _levelStart[t + 1];
+
+  // 从根往下：像素在 thresh 上的连通域是其节点水平 <= thresh 的最高祖先，
+  // 父节点仍 <= thresh 时沿用父节点的结果，否则看自身面积
+  std::vector<uint8_t> keep(live);
+  for (uint32_t id = live; id-- > 0;) {
+    const uint32_t par = _parent[id];
+    keep[id] = par != id && par < live
+                   ? keep[par]
+                   : (int64_t(_area[id]) >= minArea ? 1 : 0);
+  }
+
+  parallelFor(cv::Range(0, _height), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uint32_t *node = _nodeOf.data() + size_t(y) * _width;
+      uint64_t *d = dst.row(y);
+      for (size_t i = 0; i < dst.wordsPerRow(); ++i) {
+        const int x0 = static_cast<int>(i * 64);
+        const int len = std::min(64, _width - x0);
+        uint64_t word = 0;
+        for (int b = 0; b < len; ++b) {
+          const uint32_t id = node[x0 + b];
+          word |= uint64_t(id < live && keep[id]) << b;
+        }
+        d[i] = word;
+      }
+    }
+  });
+  return 0;
+}
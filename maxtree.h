@@ -0,0 +1,46 @@
+#ifndef MAXTREE_H
+#define MAXTREE_H
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "bitmask.h"
+
+// ---------------- 组件树 ----------------
+// 去黑阈值 + 去杂点面积合起来就是黑度图上的面积开运算：
+// 透明像素为 黑度 <= thresh，再删掉面积 < minArea 的 8 连通域。
+// 黑度图只需建一次下水平集的组件树（即反相图的 max-tree）：
+//   每个节点是某个水平 v 上 {黑度 <= v} 的一个连通域，父节点水平更高、面积更大；
+// 之后任意 (thresh, minArea) 从根往下线性扫一遍节点即可得到蒙版，不再阈值化 / 标记。
+// 建树：按行分条带并行，各条带内计数排序后用并查集（Berger 算法）自底向上建树，
+// 相邻条带沿边界行两两合并（Wilkinson 的合并算法），最后压缩同水平的节点并统计面积。
+// 像素数须小于 2^31。
+class MaxTree {
+public:
+  // image 为 CV_8UC1；失败返回负数（此时树为空）
+  int build(const cv::Mat &image);
+  void clear();
+
+  bool empty() const { return _width <= 0 || _height <= 0; }
+  int width() const { return _width; }
+  int height() const { return _height; }
+  size_t nodeCount() const { return _level.size(); }
+
+  // 黑度 <= thresh 且所在连通域面积 >= minArea 的像素置位，dst 按图像尺寸创建；
+  // 结果与 thresholdToBits + 按面积删除连通域一致
+  int reconstruct(int thresh, int minArea, BitMask &dst) const;
+
+private:
+  int _width = 0;
+  int _height = 0;
+  std::vector<uint32_t> _nodeOf; // 像素 -> 节点
+  // 节点按水平升序编号，父节点编号总是更大；根节点的父节点是自己
+  std::vector<uint8_t> _level;
+  std::vector<uint32_t> _parent;
+  std::vector<uint32_t> _area;
+  uint32_t _levelStart[257] = {}; // 水平 v 的节点为 [_levelStart[v], _levelStart[v + 1])
+};
+
+#endif // MAXTREE_H
@@ -0,0 +1,434 @@
+#include "morphology.h"
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "taskpool.h"
+
+namespace {
+
+struct MaxOp {
+  static constexpr uint8_t pad = 0; // 膨胀时图外视为背景
+  static uint8_t apply(uint8_t a, uint8_t b) { return a > b ? a : b; }
+};
+
+struct MinOp {
+  static constexpr uint8_t pad = 255; // 腐蚀时图外视为前景
+  static uint8_t apply(uint8_t a, uint8_t b) { return a < b ? a : b; }
+};
+
+// van Herk / Gil-Werman 一维滤波：窗口 k=2r+1，按 k 分块做前缀/后缀极值，
+// 每个输出只需一次比较，与 r 无关
+// ext/g/h 为调用方提供的临时缓冲，长度至少 n + 2r + k
+template <typename Op>
+void vhgw1D(const uint8_t *in, uint8_t *out, int n, int r, uint8_t *ext,
+            uint8_t *g, uint8_t *h) {
+  const int k = 2 * r + 1;
+  const int len = n + 2 * r;
+  const int padded = (len + k - 1) / k * k;
+
+  std::fill(ext, ext + r, Op::pad);
+  std::copy(in, in + n, ext + r);
+  std::fill(ext + r + n, ext + padded, Op::pad);
+
+  for (int b = 0; b < padded; b += k) {
+    g[b] = ext[b];
+    for (int i = b + 1; i < b + k; ++i)
+      g[i] = Op::apply(g[i - 1], ext[i]);
+    h[b + k - 1] = ext[b + k - 1];
+    for (int i = b + k - 2; i >= b; --i)
+      h[i] = Op::apply(h[i + 1], ext[i]);
+  }
+
+  // 窗口 ext[j, j+k-1] 以 in[j] 为中心
+  for (int j = 0; j < n; ++j)
+    out[j] = Op::apply(h[j], g[j + k - 1]);
+}
+
+// 水平方向：按行带并行，每行一次 vhgw1D
+template <typename Op>
+void horizontalPass(const cv::Mat &src, cv::Mat &dst, int r) {
+  const int w = src.cols;
+  parallelFor(cv::Range(0, src.rows), [&](const cv::Range &range) {
+    std::vector<uint8_t> buf(3 * static_cast<size_t>(w + 4 * r + 2));
+    const size_t n = buf.size() / 3;
+    for (int y = range.start; y < range.end; ++y)
+      vhgw1D<Op>(src.ptr<uint8_t>(y), dst.ptr<uint8_t>(y), w, r, buf.data(),
+                 buf.data() + n, buf.data() + 2 * n);
+  });
+}
+
+// 垂直方向：以整行为元素做同样的分块前缀/后缀，
+// 内层按列连续访问，按列带并行
+template <typename Op>
+void verticalPass(const cv::Mat &src, cv::Mat &dst, int r) {
+  const int rows = src.rows;
+  const int cols = src.cols;
+  const int k = 2 * r + 1;
+  const int len = rows + 2 * r;
+  const int padded = (len + k - 1) / k * k;
+  // 列带宽度：每个线程的 g / h 各 padded * kBand 字节，按两者合计约 256KB
+  // （L2 大小）取，限制在 64 ~ 256 列；很高的图即使 64 列也会超出 L2
+  constexpr size_t kCacheBytes = size_t(256) << 10;
+  const int kBand = static_cast<int>(std::clamp<size_t>(
+      kCacheBytes / (2 * static_cast<size_t>(padded)) / 64 * 64, 64, 256));
+
+  const int bands = (cols + kBand - 1) / kBand;
+  parallelFor(cv::Range(0, bands), [&](const cv::Range &range) {
+    std::vector<uint8_t> padRow(kBand, Op::pad);
+    std::vector<uint8_t> g(static_cast<size_t>(padded) * kBand);
+    std::vector<uint8_t> h(static_cast<size_t>(padded) * kBand);
+
+    for (int band = range.start; band < range.end; ++band) {
+      const int x0 = band * kBand;
+      const int bw = std::min(kBand, cols - x0);
+
+      // 扩展后第 i 行（含上下各 r 行填充）
+      auto extRow = [&](int i) -> const uint8_t * {
+        const int y = i - r;
+        if (y < 0 || y >= rows)
+          return padRow.data();
+        return src.ptr<uint8_t>(y) + x0;
+      };
+
+      for (int b = 0; b < padded; b += k) {
+        uint8_t *gb = g.data() + static_cast<size_t>(b) * kBand;
+        std::copy(extRow(b), extRow(b) + bw, gb);
+        for (int i = b + 1; i < b + k; ++i) {
+          const uint8_t *e = extRow(i);
+          const uint8_t *gp = g.data() + static_cast<size_t>(i - 1) * kBand;
+          uint8_t *gi = g.data() + static_cast<size_t>(i) * kBand;
+          for (int x = 0; x < bw; ++x)
+            gi[x] = Op::apply(gp[x], e[x]);
+        }
+
+        uint8_t *hl = h.data() + static_cast<size_t>(b + k - 1) * kBand;
+        std::copy(extRow(b + k - 1), extRow(b + k - 1) + bw, hl);
+        for (int i = b + k - 2; i >= b; --i) {
+          const uint8_t *e = extRow(i);
+          const uint8_t *hn = h.data() + static_cast<size_t>(i + 1) * kBand;
+          uint8_t *hi = h.data() + static_cast<size_t>(i) * kBand;
+          for (int x = 0; x < bw; ++x)
+            hi[x] = Op::apply(hn[x], e[x]);
+        }
+      }
+
+      for (int y = 0; y < rows; ++y) {
+        const uint8_t *hy = h.data() + static_cast<size_t>(y) * kBand;
+        const uint8_t *gy = g.data() + static_cast<size_t>(y + k - 1) * kBand;
+        uint8_t *d = dst.ptr<uint8_t>(y) + x0;
+        for (int x = 0; x < bw; ++x)
+          d[x] = Op::apply(hy[x], gy[x]);
+      }
+    }
+  });
+}
+
+// 对角方向：逐条对角线取出做 vhgw1D，按对角线并行
+// dy = 1 为主对角（x、y 同增），dy = -1 为副对角（x 增 y 减）
+template <typename Op>
+void diagonalPass(const cv::Mat &src, cv::Mat &dst, int r, int dy) {
+  const int rows = src.rows;
+  const int cols = src.cols;
+  const int lines = rows + cols - 1;
+
+  parallelFor(cv::Range(0, lines), [&](const cv::Range &range) {
+    const int maxLen = std::min(rows, cols);
+    std::vector<uint8_t> in(maxLen), out(maxLen);
+    std::vector<uint8_t> buf(3 * static_cast<size_t>(maxLen + 4 * r + 2));
+    const size_t n = buf.size() / 3;
+
+    for (int d = range.start; d < range.end; ++d) {
+      // 起点：先沿左列，再沿上（主对角）/下（副对角）行
+      int x = 0, y = 0;
+      if (d < rows) {
+        y = dy > 0 ? rows - 1 - d : d;
+      } else {
+        x = d - rows + 1;
+        y = dy > 0 ? 0 : rows - 1;
+      }
+
+      int len = 0;
+      for (int xi = x, yi = y; xi < cols && yi >= 0 && yi < rows;
+           ++xi, yi += dy)
+        in[len++] = src.ptr<uint8_t>(yi)[xi];
+
+      vhgw1D<Op>(in.data(), out.data(), len, r, buf.data(), buf.data() + n,
+                 buf.data() + 2 * n);
+
+      for (int i = 0, xi = x, yi = y; i < len; ++i, ++xi, yi += dy)
+        dst.ptr<uint8_t>(yi)[xi] = out[i];
+    }
+  });
+}
+
+template <typename Op>
+void lineFilter(const cv::Mat &src, cv::Mat &dst, int r, int dx, int dy) {
+  if (r <= 0) {
+    src.copyTo(dst);
+    return;
+  }
+  // 各方向都支持原地：水平/对角先取出整行/整条，垂直先复制
+  cv::Mat in = (dst.data == src.data && dx == 0) ? src.clone() : src;
+  dst.create(src.size(), CV_8UC1);
+
+  if (dy == 0)
+    horizontalPass<Op>(in, dst, r);
+  else if (dx == 0)
+    verticalPass<Op>(in, dst, r);
+  else
+    diagonalPass<Op>(in, dst, r, dy > 0 ? 1 : -1);
+}
+
+// 八边形 = 正方形(半边 a) ⊕ 菱形(两条对角线段，半长 b)
+// 轴向半径 a+2b，对角方向半径 (a+b)·√2，取 a≈0.414r、b≈0.293r
+template <typename Op>
+void octagonFilter(const cv::Mat &src, cv::Mat &dst, int radius) {
+  int b = static_cast<int>(radius * 0.2929 + 0.5);
+  int a = radius - 2 * b;
+  // 对角线段单独使用时只覆盖棋盘格一半的点，需要正方形填补
+  if (a < 1 && radius > 0) {
+    a = radius;
+    b = 0;
+  }
+
+  lineFilter<Op>(src, dst, a, 1, 0);
+  lineFilter<Op>(dst, dst, a, 0, 1);
+  if (b > 0) {
+    lineFilter<Op>(dst, dst, b, 1, 1);
+    lineFilter<Op>(dst, dst, b, 1, -1);
+  }
+}
+
+// 精确圆盘：膨胀 = 到前景距离 ≤ r；腐蚀 = 到背景距离 > r。
+// 距离变换（squaredDistanceTransform，按列带 / 行并行）后按行带取阈值，
+// 比较整数距离平方，不需要浮点容差
+void diskDilate(const cv::Mat &src, cv::Mat &dst, int radius) {
+  // 前景置 0，距离即到最近前景的距离
+  cv::Mat inv(src.size(), CV_8UC1);
+  parallelFor(cv::Range(0, src.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uint8_t *s = src.ptr<uint8_t>(y);
+      uint8_t *d = inv.ptr<uint8_t>(y);
+      for (int x = 0; x < src.cols; ++x)
+        d[x] = s[x] ? 0 : 255;
+    }
+  });
+  cv::Mat dist2;
+  squaredDistanceTransform(inv, dist2);
+
+  const int64_t r2 = static_cast<int64_t>(radius) * radius;
+  dst.create(src.size(), CV_8UC1);
+  parallelFor(cv::Range(0, src.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const int *dy = dist2.ptr<int>(y);
+      uint8_t *d = dst.ptr<uint8_t>(y);
+      for (int x = 0; x < src.cols; ++x)
+        d[x] = dy[x] <= r2 ? 255 : 0;
+    }
+  });
+}
+
+void diskErode(const cv::Mat &src, cv::Mat &dst, int radius) {
+  // 背景本来就是 0，距离即到最近背景的距离；图外视为前景
+  cv::Mat dist2;
+  squaredDistanceTransform(src, dist2);
+
+  const int64_t r2 = static_cast<int64_t>(radius) * radius;
+  dst.create(src.size(), CV_8UC1);
+  parallelFor(cv::Range(0, src.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const int *dy = dist2.ptr<int>(y);
+      uint8_t *d = dst.ptr<uint8_t>(y);
+      for (int x = 0; x < src.cols; ++x)
+        d[x] = dy[x] > r2 ? 255 : 0;
+    }
+  });
+}
+
+// 列方向：g = 到本列最近零像素的距离，ny = 该零像素所在行
+void edtColumnPass(const cv::Mat &src, cv::Mat &g, cv::Mat &ny, int inf) {
+  const int rows = src.rows;
+  const int cols = src.cols;
+  constexpr int kBand = 256;
+  const int bands = (cols + kBand - 1) / kBand;
+
+  parallelFor(cv::Range(0, bands), [&](const cv::Range &range) {
+    for (int band = range.start; band < range.end; ++band) {
+      const int x0 = band * kBand;
+      const int x1 = std::min(cols, x0 + kBand);
+
+      // 自上而下
+      for (int y = 0; y < rows; ++y) {
+        const uint8_t *s = src.ptr<uint8_t>(y);
+        int *gy = g.ptr<int>(y);
+        int *ry = ny.ptr<int>(y);
+        const int *gp = y > 0 ? g.ptr<int>(y - 1) : nullptr;
+        const int *rp = y > 0 ? ny.ptr<int>(y - 1) : nullptr;
+        for (int x = x0; x < x1; ++x) {
+          if (!s[x]) {
+            gy[x] = 0;
+            ry[x] = y;
+          } else if (gp && gp[x] < inf) {
+            gy[x] = gp[x] + 1;
+            ry[x] = rp[x];
+          } else {
+            gy[x] = inf;
+            ry[x] = -1;
+          }
+        }
+      }
+      // 自下而上
+      for (int y = rows - 2; y >= 0; --y) {
+        int *gy = g.ptr<int>(y);
+        int *ry = ny.ptr<int>(y);
+        const int *gn = g.ptr<int>(y + 1);
+        const int *rn = ny.ptr<int>(y + 1);
+        for (int x = x0; x < x1; ++x) {
+          if (gn[x] < inf && gn[x] + 1 < gy[x]) {
+            gy[x] = gn[x] + 1;
+            ry[x] = rn[x];
+          }
+        }
+      }
+    }
+  });
+}
+
+inline int64_t floorDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// 行方向：Meijster 抛物线下包络，f(x, i) = (x - i)^2 + g(i)^2
+void edtRowPass(const cv::Mat &g, const cv::Mat &ny, cv::Mat &dist2,
+                cv::Mat *nearest) {
+  const int cols = g.cols;
+  parallelFor(cv::Range(0, g.rows), [&](const cv::Range &range) {
+    std::vector<int> s(cols), t(cols);
+    std::vector<int64_t> g2(cols);
+
+    for (int y = range.start; y < range.end; ++y) {
+      const int *gy = g.ptr<int>(y);
+      for (int x = 0; x < cols; ++x)
+        g2[x] = static_cast<int64_t>(gy[x]) * gy[x];
+
+      auto f = [&](int x, int i) {
+        const int64_t d = x - i;
+        return d * d + g2[i];
+      };
+      // 抛物线 i 与 u（i < u）交点的横坐标（向下取整）
+      auto sep = [&](int i, int u) {
+        return floorDiv(static_cast<int64_t>(u) * u -
+                            static_cast<int64_t>(i) * i + g2[u] - g2[i],
+                        2 * static_cast<int64_t>(u - i));
+      };
+
+      int q = 0;
+      s[0] = 0;
+      t[0] = 0;
+      for (int u = 1; u < cols; ++u) {
+        while (q >= 0 && f(t[q], s[q]) > f(t[q], u))
+          --q;
+        if (q < 0) {
+          q = 0;
+          s[0] = u;
+        } else {
+          const int64_t w = 1 + sep(s[q], u);
+          if (w < cols) {
+            ++q;
+            s[q] = u;
+            t[q] = static_cast<int>(w);
+          }
+        }
+      }
+
+      int *dy = dist2.ptr<int>(y);
+      int *ny2 = nearest ? nearest->ptr<int>(y) : nullptr;
+      const int *ry = ny.ptr<int>(y);
+      for (int u = cols - 1; u >= 0; --u) {
+        // 整行所在列都没有零像素时 g 是占位的 inf，距离按“很大”处理
+        const bool none = ry[s[q]] < 0;
+        const int64_t d = none ? INT_MAX : f(u, s[q]);
+        dy[u] = static_cast<int>(std::min<int64_t>(d, INT_MAX));
+        if (ny2)
+          ny2[u] = none ? -1 : ry[s[q]] * cols + s[q];
+        if (u == t[q])
+          --q;
+      }
+    }
+  });
+}
+
+} // namespace
+
+int squaredDistanceTransform(const cv::Mat &src, cv::Mat &dist2,
+                             cv::Mat *nearest) {
+  if (src.empty() || src.type() != CV_8UC1)
+    return -1;
+  const int inf = src.rows + src.cols;
+
+  cv::Mat g(src.size(), CV_32SC1), ny(src.size(), CV_32SC1);
+  edtColumnPass(src, g, ny, inf);
+
+  dist2.create(src.size(), CV_32SC1);
+  if (nearest)
+    nearest->create(src.size(), CV_32SC1);
+  edtRowPass(g, ny, dist2, nearest);
+  return 0;
+}
+
+void lineMaxFilter(const cv::Mat &src, cv::Mat &dst, int r, int dx, int dy) {
+  lineFilter<MaxOp>(src, dst, r, dx, dy);
+}
+
+void lineMinFilter(const cv::Mat &src, cv::Mat &dst, int r, int dx, int dy) {
+  lineFilter<MinOp>(src, dst, r, dx, dy);
+}
+
+int fastMorphology(const cv::Mat &src, cv::Mat &dst, int op, int radius,
+                   MorphShape shape) {
+  if (src.empty() || src.type() != CV_8UC1)
+    return -1;
+  if (radius < 0)
+    return -2;
+  if (radius == 0) {
+    src.copyTo(dst);
+    return 0;
+  }
+
+  auto dilate = [&](const cv::Mat &in, cv::Mat &out) {
+    if (shape == MorphShape::DISK)
+      diskDilate(in, out, radius);
+    else
+      octagonFilter<MaxOp>(in, out, radius);
+  };
+  auto erode = [&](const cv::Mat &in, cv::Mat &out) {
+    if (shape == MorphShape::DISK)
+      diskErode(in, out, radius);
+    else
+      octagonFilter<MinOp>(in, out, radius);
+  };
+
+  cv::Mat tmp;
+  switch (op) {
+  case cv::MORPH_DILATE:
+    dilate(src, dst);
+    break;
+  case cv::MORPH_ERODE:
+    erode(src, dst);
+    break;
+  case cv::MORPH_CLOSE:
+    dilate(src, tmp);
+    erode(tmp, dst);
+    break;
+  case cv::MORPH_OPEN:
+    erode(src, tmp);
+    dilate(tmp, dst);
+    break;
+  default:
+    return -3;
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <opencv2/opencv.hpp>
+
+// ---------------- 大半径形态学 ----------------
+// 耗时与结构元半径基本无关：
+//   OCTAGON : 水平/垂直/两条对角线段分解（van Herk / Gil-Werman，
+//             每像素 3 次比较），线段组合成近似圆的八边形
+//   DISK    : 精确圆盘，对距离变换取阈值（仅二值图）
+enum class MorphShape { OCTAGON = 0, DISK };
+
+// op 取 cv::MORPH_DILATE / MORPH_ERODE / MORPH_OPEN / MORPH_CLOSE
+// 输入 CV_8UC1；radius = 0 时直接拷贝
+int fastMorphology(const cv::Mat &src, cv::Mat &dst, int op, int radius,
+                   MorphShape shape = MorphShape::DISK);
+
+// 单方向线段最大/最小值滤波（半长 r，长度 2r+1），按行带/列带并行
+// dx/dy 取 (1,0) 水平、(0,1) 垂直、(1,1) 主对角、(1,-1) 副对角
+void lineMaxFilter(const cv::Mat &src, cv::Mat &dst, int r, int dx, int dy);
+void lineMinFilter(const cv::Mat &src, cv::Mat &dst, int r, int dx, int dy);
+
+// 精确欧氏距离变换（Felzenszwalb / Meijster），线性时间：
+// 先逐列求到最近零像素的纵向距离（按列带并行），再逐行求抛物线下包络（按行并行）
+// dist2   : CV_32S，到最近零像素距离的平方（无零像素时为很大的值）
+// nearest : 可选，CV_32S，最近零像素的线性下标 y * cols + x
+int squaredDistanceTransform(const cv::Mat &src, cv::Mat &dist2,
+                             cv::Mat *nearest = nullptr);
+
+#endif // MORPHOLOGY_H
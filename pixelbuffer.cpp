@@ -0,0 +1,112 @@
+#include "pixelbuffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+uint8_t *allocAligned(size_t size) {
+  // 大块按大页对齐并凑整到整页，整块都能落在大页上
+  const bool huge = size >= PixelBuffer::kHugePage;
+  const size_t align = huge ? PixelBuffer::kHugePage : PixelBuffer::kAlignment;
+  const size_t bytes = (size + align - 1) / align * align;
+
+  void *p = nullptr;
+#ifdef _WIN32
+  // Windows 的大页需要 SeLockMemoryPrivilege，这里只做对齐
+  p = _aligned_malloc(bytes, align);
+#else
+  if (posix_memalign(&p, align, bytes) != 0)
+    p = nullptr;
+#endif
+  if (!p)
+    throw std::bad_alloc();
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  // 仅是建议，内核未开启透明大页时失败也无妨
+  if (huge)
+    madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+  return static_cast<uint8_t *>(p);
+}
+
+void freeAligned(uint8_t *p) {
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+} // namespace
+
+PixelBuffer::~PixelBuffer() { release(); }
+
+PixelBuffer::PixelBuffer(const PixelBuffer &other) {
+  resize(other._size);
+  if (_size)
+    std::memcpy(_data, other._data, _size);
+}
+
+PixelBuffer &PixelBuffer::operator=(const PixelBuffer &other) {
+  if (this != &other) {
+    reset(other._size);
+    if (_size)
+      std::memcpy(_data, other._data, _size);
+  }
+  return *this;
+}
+
+PixelBuffer::PixelBuffer(PixelBuffer &&other) noexcept
+    : _data(std::exchange(other._data, nullptr)),
+      _size(std::exchange(other._size, 0)),
+      _capacity(std::exchange(other._capacity, 0)) {}
+
+PixelBuffer &PixelBuffer::operator=(PixelBuffer &&other) noexcept {
+  if (this != &other) {
+    release();
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+    _capacity = std::exchange(other._capacity, 0);
+  }
+  return *this;
+}
+
+void PixelBuffer::resize(size_t size) {
+  if (size <= _capacity) {
+    _size = size;
+    return;
+  }
+  uint8_t *p = allocAligned(size);
+  if (_size)
+    std::memcpy(p, _data, std::min(_size, size));
+  if (_data)
+    freeAligned(_data);
+  _data = p;
+  _size = size;
+  _capacity = size;
+}
+
+void PixelBuffer::reset(size_t size) {
+  if (size > _capacity)
+    release();
+  _size = 0;
+  resize(size);
+}
+
+void PixelBuffer::release() {
+  if (_data)
+    freeAligned(_data);
+  _data = nullptr;
+  _size = 0;
+  _capacity = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef PIXELBUFFER_H
+#define PIXELBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// ---------------- 像素缓冲 ----------------
+// 原始像素用的字节缓冲。与 std::vector<uint8_t> 的区别：
+//   - 分配 / 扩容时不清零（解码 / 交错马上会整块覆盖，清零是多余的一遍写）
+//   - 首地址按 64 字节对齐，SIMD 内核可以直接对齐加载
+//   - 大块（>= 2MB）按 2MB 对齐，Linux 上 madvise(MADV_HUGEPAGE) 申请透明大页，
+//     减少逐行扫描整幅图时的 TLB 缺失
+// 容量够时 resize 不重新分配，重复读图可复用上一幅的内存。
+class PixelBuffer {
+public:
+  static constexpr size_t kAlignment = 64;
+  static constexpr size_t kHugePage = size_t(2) << 20;
+
+  PixelBuffer() = default;
+  explicit PixelBuffer(size_t size) { resize(size); }
+  ~PixelBuffer();
+
+  PixelBuffer(const PixelBuffer &other);
+  PixelBuffer &operator=(const PixelBuffer &other);
+  PixelBuffer(PixelBuffer &&other) noexcept;
+  PixelBuffer &operator=(PixelBuffer &&other) noexcept;
+
+  // 改变大小，保留前 min(旧大小, size) 字节，新增部分内容未定义；
+  // 分配失败抛 std::bad_alloc
+  void resize(size_t size);
+  // 改变大小，不保留旧内容（整块马上会被覆盖时用，扩容时省一次拷贝，
+  // 且先释放旧块再分配，峰值内存不叠加）；分配失败抛 std::bad_alloc
+  void reset(size_t size);
+  // 大小置 0，保留内存
+  void clear() { _size = 0; }
+  // 释放内存
+  void release();
+
+  uint8_t *data() { return _data; }
+  const uint8_t *data() const { return _data; }
+  size_t size() const { return _size; }
+  size_t capacity() const { return _capacity; }
+  bool empty() const { return _size == 0; }
+
+  uint8_t &operator[](size_t i) { return _data[i]; }
+  const uint8_t &operator[](size_t i) const { return _data[i]; }
+
+  uint8_t *begin() { return _data; }
+  uint8_t *end() { return _data + _size; }
+  const uint8_t *begin() const { return _data; }
+  const uint8_t *end() const { return _data + _size; }
+
+private:
+  uint8_t *_data = nullptr;
+  size_t _size = 0;
+  size_t _capacity = 0;
+};
+
+#endif // PIXELBUFFER_H
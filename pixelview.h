@@ -0,0 +1,107 @@
+#ifndef PIXELVIEW_H
+#define PIXELVIEW_H
+
+#include <opencv2/opencv.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// ---------------- 像素视图 ----------------
+// 不拥有内存的 8 位图像描述：首地址 + 宽高 + 行跨度 + 每像素 sample 数 + 平面。
+//   交错（PLANARCONFIG_CONTIG）：planes = 1，一行内 [S0 S1 ...][S0 S1 ...]
+//   分平面（PLANARCONFIG_SEPARATE）：spp = 1，planes = 通道数，
+//     平面 p 的首地址为 data + p * planeStride
+// 行跨度可大于 width * spp（行填充、ROI、调用方缓冲），各内核一律按 row(y) 取行。
+// roi() 只改首地址与宽高，不拷贝；mmap 的条带、行带、分块都可直接构造视图。
+template <typename T> struct BasicPixelView {
+  T *data = nullptr;
+  int width = 0;
+  int height = 0;
+  size_t bytesPerRow = 0; // 行跨度（字节）
+  int spp = 0;            // 每个平面中每像素的 sample 数
+  int planes = 1;
+  size_t planeStride = 0; // 相邻平面首地址的间距（字节）
+
+  BasicPixelView() = default;
+  BasicPixelView(T *data, int width, int height, size_t bytesPerRow, int spp,
+                 int planes = 1, size_t planeStride = 0)
+      : data(data), width(width), height(height), bytesPerRow(bytesPerRow),
+        spp(spp), planes(planes), planeStride(planeStride) {}
+
+  // 可写视图隐式转换为只读视图
+  template <typename U,
+            typename = std::enable_if_t<std::is_same_v<const U, T> &&
+                                        !std::is_same_v<U, T>>>
+  BasicPixelView(const BasicPixelView<U> &other)
+      : BasicPixelView(other.data, other.width, other.height,
+                       other.bytesPerRow, other.spp, other.planes,
+                       other.planeStride) {}
+
+  bool empty() const {
+    return !data || width <= 0 || height <= 0 || spp <= 0 || planes <= 0;
+  }
+  bool interleaved() const { return planes == 1; }
+
+  // 一行的有效字节数（不含填充）
+  size_t rowBytes() const { return static_cast<size_t>(width) * spp; }
+
+  T *row(int y, int plane = 0) const {
+    return data + plane * planeStride + static_cast<size_t>(y) * bytesPerRow;
+  }
+  T *pixel(int x, int y, int plane = 0) const {
+    return row(y, plane) + static_cast<size_t>(x) * spp;
+  }
+
+  bool contains(const cv::Rect &r) const {
+    return r.x >= 0 && r.y >= 0 && r.width >= 0 && r.height >= 0 &&
+           r.x + r.width <= width && r.y + r.height <= height;
+  }
+
+  // 子区域视图（共用内存）；越界返回空视图
+  BasicPixelView roi(const cv::Rect &r) const {
+    if (!contains(r))
+      return {};
+    return BasicPixelView(pixel(r.x, r.y), r.width, r.height, bytesPerRow,
+                          spp, planes, planeStride);
+  }
+
+  // 行带 [y0, y1)
+  BasicPixelView rows(int y0, int y1) const {
+    return roi(cv::Rect(0, y0, width, y1 - y0));
+  }
+
+  // 单个平面的交错视图
+  BasicPixelView plane(int p) const {
+    if (p < 0 || p >= planes)
+      return {};
+    return BasicPixelView(row(0, p), width, height, bytesPerRow, spp);
+  }
+};
+
+using PixelView = BasicPixelView<uint8_t>;
+using ConstPixelView = BasicPixelView<const uint8_t>;
+
+// cv::Mat（8 位、任意通道数）上的视图；其它深度返回空视图
+inline PixelView pixelView(cv::Mat &mat) {
+  if (mat.empty() || mat.depth() != CV_8U)
+    return {};
+  return PixelView(mat.data, mat.cols, mat.rows, mat.step, mat.channels());
+}
+
+inline ConstPixelView pixelView(const cv::Mat &mat) {
+  if (mat.empty() || mat.depth() != CV_8U)
+    return {};
+  return ConstPixelView(mat.data, mat.cols, mat.rows, mat.step,
+                        mat.channels());
+}
+
+// 交错视图上的 cv::Mat 头，不拷贝（OpenCV 只支持 <= CV_CN_MAX 通道）
+inline cv::Mat asMat(const PixelView &view) {
+  if (view.empty() || !view.interleaved() || view.spp > CV_CN_MAX)
+    return {};
+  return cv::Mat(view.height, view.width, CV_8UC(view.spp), view.data,
+                 view.bytesPerRow);
+}
+
+#endif // PIXELVIEW_H
@@ -0,0 +1,80 @@
+#include "pschannels.h"
+
+std::vector<uint8_t> buildPs1006(const std::vector<PsChannelDesc> &channels) {
+  // Pascal 串按规范紧密排列，不做偶数对齐
+  std::vector<uint8_t> out;
+  for (const PsChannelDesc &c : channels) {
+    const size_t len = utf8Prefix(c.name, 255);
+    out.push_back(static_cast<uint8_t>(len));
+    out.insert(out.end(), c.name.begin(), c.name.begin() + len);
+  }
+  return out;
+}
+
+std::vector<uint8_t> buildPs1045(const std::vector<PsChannelDesc> &channels) {
+  std::vector<uint8_t> out;
+  for (const PsChannelDesc &c : channels) {
+    std::vector<uint16_t> u16 = utf8ToUtf16(c.name);
+    u16.push_back(0);
+    appendBE32(out, static_cast<uint32_t>(u16.size()));
+    for (uint16_t ch : u16)
+      appendBE16(out, ch);
+  }
+  return out;
+}
+
+std::vector<uint8_t> buildPs1077(const std::vector<PsChannelDesc> &channels) {
+  std::vector<uint8_t> out;
+  out.reserve(4 + channels.size() * 13);
+  appendBE32(out, 1); // version
+
+  for (const PsChannelDesc &c : channels) {
+    appendBE16(out, static_cast<uint16_t>(c.colorSpace));
+    for (uint16_t v : c.color)
+      appendBE16(out, v);
+    appendBE16(out, std::min<uint16_t>(c.opacity, 100));
+    out.push_back(static_cast<uint8_t>(c.kind));
+  }
+  return out;
+}
+
+std::vector<uint8_t>
+synthesizePsChannelResources(const std::vector<PsChannelDesc> &channels) {
+  std::vector<uint8_t> blob;
+  if (channels.empty())
+    return blob;
+
+  const std::vector<uint8_t> r1006 = buildPs1006(channels);
+  const std::vector<uint8_t> r1045 = buildPs1045(channels);
+  const std::vector<uint8_t> r1077 = buildPs1077(channels);
+
+  appendPsResource(blob, 1006, std::string(), r1006.data(),
+                   static_cast<uint32_t>(r1006.size()));
+  appendPsResource(blob, 1045, std::string(), r1045.data(),
+                   static_cast<uint32_t>(r1045.size()));
+  appendPsResource(blob, 1077, std::string(), r1077.data(),
+                   static_cast<uint32_t>(r1077.size()));
+  return blob;
+}
+
+bool applyPsChannelResources(std::vector<uint8_t> &blob, PsResourceIndex &index,
+                             const std::vector<PsChannelDesc> &channels) {
+  if (channels.empty())
+    return false;
+
+  // 旧版 DisplayInfo 的通道数与新通道不一致，直接去掉
+  if (index.find(1007))
+    index.removeResource(blob, 1007);
+
+  const std::vector<uint8_t> r1006 = buildPs1006(channels);
+  const std::vector<uint8_t> r1045 = buildPs1045(channels);
+  const std::vector<uint8_t> r1077 = buildPs1077(channels);
+
+  index.setResource(blob, 1006, r1006.data(),
+                    static_cast<uint32_t>(r1006.size()));
+  index.setResource(blob, 1045, r1045.data(),
+                    static_cast<uint32_t>(r1045.size()));
+  index.setResource(blob, 1077, r1077.data(),
+                    static_cast<uint32_t>(r1077.size()));
+  return true;
+}
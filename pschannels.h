@@ -0,0 +1,72 @@
+#ifndef PSCHANNELS_H
+#define PSCHANNELS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "psresource.h"
+
+// ---------------- Photoshop 通道资源生成 ----------------
+// 直接由通道描述生成 Alpha/专色通道相关的 8BIM 资源，不依赖模板 TIFF：
+//   1006 : Alpha 通道名（Pascal 串序列）
+//   1045 : Unicode Alpha 通道名（长度(4) + UTF-16BE，含结尾 0）
+//   1077 : DisplayInfo（版本(4) + 每通道 13 字节）
+// 描述顺序与 TIFF ExtraSamples 顺序一致（含第一个透明度通道）
+
+// 1077 中的通道类型
+enum class PsChannelKind : uint8_t {
+  ALPHA = 0,          // 选区（被遮盖区域）
+  INVERTED_ALPHA = 1, // 选区（所选区域）
+  SPOT = 2            // 专色
+};
+
+// 1077 中的颜色空间
+enum class PsColorSpace : uint16_t { RGB = 0, HSB = 1, CMYK = 2, LAB = 7, GRAY = 8 };
+
+struct PsChannelDesc {
+  std::string name; // UTF-8
+  PsChannelKind kind = PsChannelKind::SPOT;
+  PsColorSpace colorSpace = PsColorSpace::RGB;
+  // Photoshop 颜色分量（0~65535）；CMYK 以 65535 表示无墨
+  uint16_t color[4] = {0, 0, 0, 0};
+  uint16_t opacity = 100; // 0~100（专色为密度）
+
+  static PsChannelDesc alpha(const std::string &name) {
+    PsChannelDesc d;
+    d.name = name;
+    d.kind = PsChannelKind::ALPHA;
+    d.color[0] = 0xFFFF; // 红色蒙版（Photoshop 默认）
+    d.opacity = 50;
+    return d;
+  }
+
+  static PsChannelDesc spot(const std::string &name, uint16_t r, uint16_t g,
+                            uint16_t b, uint16_t solidity = 100) {
+    PsChannelDesc d;
+    d.name = name;
+    d.kind = PsChannelKind::SPOT;
+    d.colorSpace = PsColorSpace::RGB;
+    d.color[0] = r;
+    d.color[1] = g;
+    d.color[2] = b;
+    d.opacity = solidity;
+    return d;
+  }
+};
+
+std::vector<uint8_t> buildPs1006(const std::vector<PsChannelDesc> &channels);
+
+std::vector<uint8_t> buildPs1045(const std::vector<PsChannelDesc> &channels);
+
+std::vector<uint8_t> buildPs1077(const std::vector<PsChannelDesc> &channels);
+
+// 生成只含 1006/1045/1077 的完整 34377 blob
+std::vector<uint8_t>
+synthesizePsChannelResources(const std::vector<PsChannelDesc> &channels);
+
+// 把通道资源写入已有 blob（替换或追加），并移除与 1077 冲突的旧版 1007
+bool applyPsChannelResources(std::vector<uint8_t> &blob, PsResourceIndex &index,
+                             const std::vector<PsChannelDesc> &channels);
+
+#endif // PSCHANNELS_H
@@ -0,0 +1,394 @@
+#include "psresource.h"
+
+#include <cstring>
+
+// 多字节序列按 UTF-8 校验（续字节、码点范围），不合法时首字节按 Latin-1 处理
+static size_t decodeUtf8(const std::string &s, size_t i, uint32_t &cp) {
+  const uint8_t c = static_cast<uint8_t>(s[i]);
+  const size_t extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+  cp = c;
+  if (extra == 0 || c >= 0xF8 || i + extra >= s.size())
+    return 1;
+  uint32_t v = extra == 3   ? (c & 0x07u)
+               : extra == 2 ? (c & 0x0Fu)
+                            : (c & 0x1Fu);
+  for (size_t k = 1; k <= extra; ++k) {
+    const uint8_t b = static_cast<uint8_t>(s[i + k]);
+    if ((b & 0xC0u) != 0x80u)
+      return 1;
+    v = (v << 6) | (b & 0x3Fu);
+  }
+  static const uint32_t kMin[4] = {0, 0x80, 0x800, 0x10000};
+  if (v < kMin[extra] || v > 0x10FFFF || (v >= 0xD800 && v <= 0xDFFF))
+    return 1; // 超长编码 / 超出范围 / 代理区
+  cp = v;
+  return extra + 1;
+}
+
+std::vector<uint16_t> utf8ToUtf16(const std::string &s) {
+  std::vector<uint16_t> out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size();) {
+    uint32_t cp;
+    i += decodeUtf8(s, i, cp);
+    if (cp >= 0x10000) {
+      cp -= 0x10000;
+      out.push_back(static_cast<uint16_t>(0xD800 + (cp >> 10)));
+      out.push_back(static_cast<uint16_t>(0xDC00 + (cp & 0x3FF)));
+    } else {
+      out.push_back(static_cast<uint16_t>(cp));
+    }
+  }
+  return out;
+}
+
+size_t utf8Prefix(const std::string &s, size_t maxBytes) {
+  size_t end = 0;
+  for (size_t i = 0; i < s.size();) {
+    uint32_t cp;
+    const size_t len = decodeUtf8(s, i, cp);
+    if (i + len > maxBytes)
+      break;
+    i += len;
+    end = i;
+  }
+  return end;
+}
+
+// ================= PsResourceIndex =================
+
+void PsResourceIndex::clear() {
+  _entries.clear();
+  _byId.clear();
+  _parsedEnd = 0;
+  _error.clear();
+}
+
+bool PsResourceIndex::build(const std::vector<uint8_t> &blob) {
+  clear();
+
+  const uint8_t *ps = blob.data();
+  const size_t len = blob.size();
+  size_t pos = 0;
+
+  while (pos + 4 <= len) {
+    const size_t blockStart = pos;
+
+    // signature
+    if (std::memcmp(ps + pos, "8BIM", 4) != 0) {
+      _error = "non-8BIM signature at off=" + std::to_string(blockStart);
+      break;
+    }
+    pos += 4;
+
+    // resource id
+    if (pos + 2 > len) {
+      _error = "truncated resource id";
+      break;
+    }
+    const uint16_t rid = readBE16(ps + pos);
+    pos += 2;
+
+    // Pascal name
+    if (pos + 1 > len) {
+      _error = "truncated name length";
+      break;
+    }
+    const uint8_t nameLen = ps[pos++];
+    if (pos + nameLen > len) {
+      _error = "truncated name bytes";
+      break;
+    }
+    std::string name(reinterpret_cast<const char *>(ps) + pos, nameLen);
+    pos += nameLen;
+
+    // pad name field to even (1+nameLen)
+    if (((1u + (unsigned)nameLen) & 1u) != 0) {
+      if (pos + 1 > len) {
+        _error = "truncated name pad";
+        break;
+      }
+      pos += 1;
+    }
+
+    // size
+    if (pos + 4 > len) {
+      _error = "truncated data size";
+      break;
+    }
+    const uint32_t dataSize = readBE32(ps + pos);
+    pos += 4;
+
+    if (pos + dataSize > len) {
+      _error = "truncated data at off=" + std::to_string(blockStart) +
+               " rid=" + std::to_string(rid) +
+               " need=" + std::to_string(dataSize) +
+               " remain=" + std::to_string(len - pos);
+      break;
+    }
+
+    const size_t dataOff = pos;
+    pos += dataSize;
+
+    // pad data to even
+    if ((dataSize & 1u) != 0) {
+      if (pos + 1 > len) {
+        _error = "truncated data pad";
+        break;
+      }
+      pos += 1;
+    }
+
+    PsResourceEntry e;
+    e.id = rid;
+    e.name = std::move(name);
+    e.blockOff = blockStart;
+    e.dataOff = dataOff;
+    e.dataSize = dataSize;
+    _byId.emplace(rid, _entries.size());
+    _entries.push_back(std::move(e));
+    _parsedEnd = pos;
+  }
+
+  return _error.empty();
+}
+
+const PsResourceEntry *PsResourceIndex::find(uint16_t id) const {
+  auto it = _byId.find(id);
+  if (it == _byId.end())
+    return nullptr;
+  return &_entries[it->second];
+}
+
+void appendPsResource(std::vector<uint8_t> &out, uint16_t id,
+                      const std::string &name, const uint8_t *data,
+                      uint32_t size) {
+  const uint8_t nameLen = static_cast<uint8_t>(utf8Prefix(name, 255));
+
+  out.insert(out.end(), {'8', 'B', 'I', 'M'});
+  appendBE16(out, id);
+  out.push_back(nameLen);
+  out.insert(out.end(), name.begin(), name.begin() + nameLen);
+  if (((1u + nameLen) & 1u) != 0)
+    out.push_back(0);
+  appendBE32(out, size);
+  if (size > 0)
+    out.insert(out.end(), data, data + size);
+  if ((size & 1u) != 0)
+    out.push_back(0);
+}
+
+std::vector<uint8_t> PsResourceIndex::serialize(
+    const std::vector<uint8_t> &blob,
+    const std::unordered_map<uint16_t, std::vector<uint8_t>> &replacements)
+    const {
+  std::vector<uint8_t> out;
+  out.reserve(blob.size());
+
+  for (const PsResourceEntry &e : _entries) {
+    auto it = replacements.find(e.id);
+    if (it != replacements.end()) {
+      appendPsResource(out, e.id, e.name, it->second.data(),
+                       static_cast<uint32_t>(it->second.size()));
+    } else {
+      appendPsResource(out, e.id, e.name, blob.data() + e.dataOff, e.dataSize);
+    }
+  }
+
+  // 未能解析的尾部原样保留
+  if (_parsedEnd < blob.size())
+    out.insert(out.end(), blob.begin() + _parsedEnd, blob.end());
+  return out;
+}
+
+bool PsResourceIndex::setResource(std::vector<uint8_t> &blob, uint16_t id,
+                                  const uint8_t *data, uint32_t size) {
+  const PsResourceEntry *e = find(id);
+
+  // 大小一致：原地覆盖，索引不变
+  if (e && e->dataSize == size) {
+    if (size > 0)
+      std::memcpy(blob.data() + e->dataOff, data, size);
+    return true;
+  }
+
+  std::vector<uint8_t> out;
+  if (e) {
+    std::unordered_map<uint16_t, std::vector<uint8_t>> rep;
+    rep.emplace(id, std::vector<uint8_t>(data, data + size));
+    out = serialize(blob, rep);
+  } else {
+    // 追加在已解析块之后、未解析尾部之前
+    out.assign(blob.begin(), blob.begin() + _parsedEnd);
+    appendPsResource(out, id, std::string(), data, size);
+    out.insert(out.end(), blob.begin() + _parsedEnd, blob.end());
+  }
+
+  blob.swap(out);
+  build(blob);
+  return true;
+}
+
+bool PsResourceIndex::removeResource(std::vector<uint8_t> &blob, uint16_t id) {
+  const PsResourceEntry *e = find(id);
+  if (!e)
+    return false;
+
+  std::vector<uint8_t> out;
+  out.reserve(blob.size());
+  for (const PsResourceEntry &it : _entries) {
+    if (it.id == id)
+      continue;
+    appendPsResource(out, it.id, it.name, blob.data() + it.dataOff,
+                     it.dataSize);
+  }
+  if (_parsedEnd < blob.size())
+    out.insert(out.end(), blob.begin() + _parsedEnd, blob.end());
+
+  blob.swap(out);
+  build(blob);
+  return true;
+}
+
+// ================= MultiPatternReplacer =================
+
+void MultiPatternReplacer::add(const std::vector<uint8_t> &from,
+                               const std::vector<uint8_t> &to) {
+  if (from.empty())
+    return;
+  if (from.size() != to.size())
+    _sameLength = false;
+  _patterns.push_back({from, to});
+  _built = false;
+}
+
+void MultiPatternReplacer::build() {
+  _nodes.assign(1, Node());
+  std::fill(std::begin(_nodes[0].next), std::end(_nodes[0].next), -1);
+
+  // trie
+  for (size_t pi = 0; pi < _patterns.size(); ++pi) {
+    int s = 0;
+    for (uint8_t c : _patterns[pi].from) {
+      if (_nodes[s].next[c] < 0) {
+        _nodes[s].next[c] = static_cast<int>(_nodes.size());
+        Node n;
+        std::fill(std::begin(n.next), std::end(n.next), -1);
+        _nodes.push_back(n);
+      }
+      s = _nodes[s].next[c];
+    }
+    // 同一模式重复添加时以后者为准
+    _nodes[s].out = static_cast<int>(pi);
+  }
+
+  // BFS 计算 fail，并把 goto 补全为 DFA
+  std::vector<int> queue;
+  queue.reserve(_nodes.size());
+  for (int c = 0; c < 256; ++c) {
+    int t = _nodes[0].next[c];
+    if (t < 0) {
+      _nodes[0].next[c] = 0;
+    } else {
+      _nodes[t].fail = 0;
+      queue.push_back(t);
+    }
+  }
+  for (size_t qi = 0; qi < queue.size(); ++qi) {
+    const int s = queue[qi];
+    const int f = _nodes[s].fail;
+    // fail 链上最近的模式终点（f 比 s 先出队，f 的链接已算好）
+    _nodes[s].outLink = _nodes[f].out >= 0 ? f : _nodes[f].outLink;
+    for (int c = 0; c < 256; ++c) {
+      int t = _nodes[s].next[c];
+      if (t < 0) {
+        _nodes[s].next[c] = _nodes[f].next[c];
+      } else {
+        _nodes[t].fail = _nodes[f].next[c];
+        queue.push_back(t);
+      }
+    }
+  }
+  _built = true;
+}
+
+template <typename OnMatch>
+size_t MultiPatternReplacer::scan(const uint8_t *p, size_t n,
+                                  OnMatch &&onMatch) const {
+  if (!_built || _patterns.empty())
+    return 0;
+
+  size_t count = 0;
+  size_t nextFree = 0; // 上一次替换之后的位置，保证匹配不重叠
+  int s = 0;
+  for (size_t i = 0; i < n; ++i) {
+    s = _nodes[s].next[p[i]];
+    // 在 i 结束的模式沿输出链由长到短，取第一个不与上一次替换重叠的
+    for (int t = _nodes[s].out >= 0 ? s : _nodes[s].outLink; t >= 0;
+         t = _nodes[t].outLink) {
+      const Pattern &pat = _patterns[_nodes[t].out];
+      const size_t start = i + 1 - pat.from.size();
+      if (start < nextFree)
+        continue;
+      onMatch(start, pat);
+      nextFree = i + 1;
+      ++count;
+      break;
+    }
+  }
+  return count;
+}
+
+size_t MultiPatternReplacer::replaceInPlace(uint8_t *p, size_t n) const {
+  if (!_sameLength)
+    return 0;
+  // 写入的区间都在已扫描位置之前，不影响后续匹配
+  return scan(p, n, [&](size_t start, const Pattern &pat) {
+    std::memcpy(p + start, pat.to.data(), pat.to.size());
+  });
+}
+
+size_t MultiPatternReplacer::replace(const uint8_t *p, size_t n,
+                                     std::vector<uint8_t> &out) const {
+  out.clear();
+  out.reserve(n);
+  size_t copied = 0;
+  size_t count = scan(p, n, [&](size_t start, const Pattern &pat) {
+    out.insert(out.end(), p + copied, p + start);
+    out.insert(out.end(), pat.to.begin(), pat.to.end());
+    copied = start + pat.from.size();
+  });
+  out.insert(out.end(), p + copied, p + n);
+  return count;
+}
+
+// ================= 调试输出 =================
+
+void dumpPsFlag(const std::vector<uint8_t> &ps) {
+  DEBUG << "[PhotoshopTag 34377]";
+  if (ps.empty()) {
+    DEBUG << "PhotoshopTag   : none";
+    return;
+  }
+
+  DEBUG << "Length         :" << ps.size();
+
+  PsResourceIndex index;
+  index.build(ps);
+
+  int idx = 0;
+  for (const PsResourceEntry &e : index.entries()) {
+    DEBUG << "[" << idx << "] off=" << e.blockOff << " sig=8BIM"
+          << " id=" << e.id << " name=\"" << escapePrintable(e.name) << "\""
+          << " size=" << e.dataSize << " dataOff=" << e.dataOff;
+    if (e.id == 1006 || e.id == 1007) {
+      dumpBlockPreview(e.id, ps.data() + e.dataOff, e.dataSize);
+    }
+    idx++;
+  }
+
+  if (!index.error().empty())
+    DEBUG << "[WARN]" << index.error().c_str() << "-> stop";
+
+  DEBUG << "BlocksParsed   :" << idx;
+}
@@ -0,0 +1,132 @@
+#ifndef PSRESOURCE_H
+#define PSRESOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tiffimage.h"
+
+inline void appendBE16(std::vector<uint8_t> &out, uint16_t v) {
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+inline void appendBE32(std::vector<uint8_t> &out, uint32_t v) {
+  out.push_back(static_cast<uint8_t>(v >> 24));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+// UTF-8 -> UTF-16 码元（不合法 / 截断的多字节序列逐字节按 Latin-1 处理）
+std::vector<uint16_t> utf8ToUtf16(const std::string &s);
+
+// 不超过 maxBytes 字节、且不截断多字节字符的前缀长度（Pascal 串限 255 字节）
+size_t utf8Prefix(const std::string &s, size_t maxBytes);
+
+// ---------------- 8BIM 资源索引 ----------------
+// TIFFTAG_PHOTOSHOP(34377) 内是一串 8BIM 资源块：
+//   "8BIM" | id(2) | PascalName(偶数对齐) | size(4) | data(偶数对齐)
+// 索引只记录偏移/大小，不拷贝数据；blob 由调用方持有
+struct PsResourceEntry {
+  uint16_t id = 0;
+  std::string name;      // Pascal 名（通常为空）
+  size_t blockOff = 0;   // "8BIM" 起始偏移
+  size_t dataOff = 0;    // 数据起始偏移
+  uint32_t dataSize = 0; // 数据长度（不含 pad）
+};
+
+class PsResourceIndex {
+public:
+  // 解析整个 blob，返回是否完整解析；中途出错时保留已解析的块
+  bool build(const std::vector<uint8_t> &blob);
+
+  void clear();
+
+  bool empty() const { return _entries.empty(); }
+
+  // O(1) 按 id 查找（同 id 多块时取第一个）
+  const PsResourceEntry *find(uint16_t id) const;
+
+  const std::vector<PsResourceEntry> &entries() const { return _entries; }
+
+  // 解析停止的位置，其后的字节在重新序列化时原样保留
+  size_t parsedEnd() const { return _parsedEnd; }
+
+  // 解析失败原因（完整解析时为空）
+  const std::string &error() const { return _error; }
+
+  // 替换资源数据：大小相同则原地覆盖，否则重排 blob 并重建索引；
+  // id 不存在时追加到末尾
+  bool setResource(std::vector<uint8_t> &blob, uint16_t id,
+                   const uint8_t *data, uint32_t size);
+
+  bool removeResource(std::vector<uint8_t> &blob, uint16_t id);
+
+  // 按索引顺序重新序列化（replacements 中的资源替换为新数据）
+  std::vector<uint8_t> serialize(
+      const std::vector<uint8_t> &blob,
+      const std::unordered_map<uint16_t, std::vector<uint8_t>> &replacements =
+          {}) const;
+
+private:
+  std::vector<PsResourceEntry> _entries;
+  std::unordered_map<uint16_t, size_t> _byId;
+  size_t _parsedEnd = 0;
+  std::string _error;
+};
+
+// 追加一个完整的 8BIM 块（自动补齐 name/data 的偶数对齐）
+void appendPsResource(std::vector<uint8_t> &out, uint16_t id,
+                      const std::string &name, const uint8_t *data,
+                      uint32_t size);
+
+// ---------------- 多模式替换（Aho-Corasick） ----------------
+// 一次扫描同时匹配所有模式，重叠时保留先结束的匹配；同一位置结束的多个模式
+// 沿输出链（fail 链上的模式终点）取不与上一次替换重叠的最长者
+class MultiPatternReplacer {
+public:
+  void add(const std::vector<uint8_t> &from, const std::vector<uint8_t> &to);
+
+  // 添加完所有模式后调用，构建完整的转移表
+  void build();
+
+  bool empty() const { return _patterns.empty(); }
+
+  // 所有模式替换前后长度一致，可原地替换
+  bool sameLength() const { return _sameLength; }
+
+  // 原地替换，返回替换次数（要求 sameLength）
+  size_t replaceInPlace(uint8_t *p, size_t n) const;
+
+  // 通用替换，长度可变，返回替换次数
+  size_t replace(const uint8_t *p, size_t n, std::vector<uint8_t> &out) const;
+
+private:
+  struct Pattern {
+    std::vector<uint8_t> from;
+    std::vector<uint8_t> to;
+  };
+  struct Node {
+    int next[256];
+    int fail = 0;
+    int out = -1;     // 恰好在此结束的模式
+    int outLink = -1; // fail 链上最近的有 out 的状态，-1 表示没有
+  };
+
+  template <typename OnMatch>
+  size_t scan(const uint8_t *p, size_t n, OnMatch &&onMatch) const;
+
+  std::vector<Pattern> _patterns;
+  std::vector<Node> _nodes;
+  bool _sameLength = true;
+  bool _built = false;
+};
+
+// 打印 34377 结构（调试用）
+void dumpPsFlag(const std::vector<uint8_t> &ps);
+
+#endif // PSRESOURCE_H
@@ -1 +1,90 @@
 #include "pstemplate.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <tuple>
+
+bool PsTemplateRegistry::add(const std::string &path) {
+  PsTemplate ps;
+  if (!ps.load(path)) {
+    DEBUG << "[PsTemplate] load failed:" << path.c_str();
+    return false;
+  }
+
+  // 校验：8BIM 完整、通道数一致、包含通道名资源
+  if (!ps.index.error().empty()) {
+    DEBUG << "[PsTemplate] broken 34377:" << path.c_str()
+          << ps.index.error().c_str();
+    return false;
+  }
+  int base = -1;
+  if (ps.photometric == PHOTOMETRIC_RGB)
+    base = 3;
+  else if (ps.photometric == PHOTOMETRIC_SEPARATED)
+    base = 4;
+  if (base < 0 || ps.spp != base + static_cast<int>(ps.extraSamples.size())) {
+    DEBUG << "[PsTemplate] invalid channel layout:" << path.c_str();
+    return false;
+  }
+  if (!ps.index.find(1006)) {
+    DEBUG << "[PsTemplate] no channel names (1006):" << path.c_str();
+    return false;
+  }
+
+  PsLayoutKey key{ps.photometric, ps.spp, ps.extraSamples};
+  auto res = _templates.emplace(std::move(key), std::move(ps));
+  if (!res.second) {
+    DEBUG << "[PsTemplate] duplicated layout, skip:" << path.c_str();
+    return false;
+  }
+  return true;
+}
+
+int PsTemplateRegistry::loadDirectory(const std::string &dir) {
+  namespace fs = std::filesystem;
+
+  std::error_code ec;
+  if (!fs::is_directory(dir, ec))
+    return 0;
+
+  // 排序保证重复布局时的选择稳定
+  std::vector<fs::path> files;
+  for (const auto &entry : fs::directory_iterator(dir, ec)) {
+    if (!entry.is_regular_file())
+      continue;
+    std::string ext = entry.path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".tif" || ext == ".tiff")
+      files.push_back(entry.path());
+  }
+  std::sort(files.begin(), files.end());
+
+  int loaded = 0;
+  for (const auto &f : files) {
+    if (add(f.string()))
+      ++loaded;
+  }
+  return loaded;
+}
+
+const PsTemplate *
+PsTemplateRegistry::find(uint16_t photometric, uint16_t spp,
+                         const std::vector<uint16_t> &extraSamples) const {
+  auto it = _templates.find(PsLayoutKey{photometric, spp, extraSamples});
+  if (it == _templates.end())
+    return nullptr;
+  return &it->second;
+}
+
+std::vector<const PsTemplate *> PsTemplateRegistry::list() const {
+  std::vector<const PsTemplate *> all;
+  for (const auto &kv : _templates)
+    all.push_back(&kv.second);
+  std::sort(all.begin(), all.end(),
+            [](const PsTemplate *a, const PsTemplate *b) {
+              return std::tie(a->photometric, a->spp, a->extraSamples) <
+                     std::tie(b->photometric, b->spp, b->extraSamples);
+            });
+  return all;
+}
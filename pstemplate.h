@@ -1,54 +1,33 @@
 #ifndef PSTEMPLATE_H
 #define PSTEMPLATE_H
 
+#include "psresource.h"
 #include "tiffimage.h"
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <tiffio.h>
+#include <unordered_map>
 #include <vector>
-static bool replaceBytes(uint8_t *p, size_t n, const uint8_t *from,
-                         size_t fromN, const uint8_t *to, size_t toN) {
-  if (fromN != toN || fromN == 0 || n < fromN)
-    return false;
-  bool changed = false;
-  for (size_t i = 0; i + fromN <= n; ++i) {
-    if (std::memcmp(p + i, from, fromN) == 0) {
-      std::memcpy(p + i, to, toN);
-      changed = true;
-    }
-  }
-  return changed;
-}
-
-static bool patch1045_W1W2_to_A1A2(uint8_t *data, uint32_t size) {
-  bool changed = false;
-
-  // UTF-16BE
-  const uint8_t W1_BE[] = {0x00, 0x57, 0x00, 0x31};
-  const uint8_t W2_BE[] = {0x00, 0x57, 0x00, 0x32};
-  const uint8_t A1_BE[] = {0x00, 0x41, 0x00, 0x31};
-  const uint8_t A2_BE[] = {0x00, 0x41, 0x00, 0x32};
-
-  // UTF-16LE
-  const uint8_t W1_LE[] = {0x57, 0x00, 0x31, 0x00};
-  const uint8_t W2_LE[] = {0x57, 0x00, 0x32, 0x00};
-  const uint8_t A1_LE[] = {0x41, 0x00, 0x31, 0x00};
-  const uint8_t A2_LE[] = {0x41, 0x00, 0x32, 0x00};
-
-  changed |=
-      replaceBytes(data, size, W1_BE, sizeof(W1_BE), A1_BE, sizeof(A1_BE));
-  changed |=
-      replaceBytes(data, size, W2_BE, sizeof(W2_BE), A2_BE, sizeof(A2_BE));
-  changed |=
-      replaceBytes(data, size, W1_LE, sizeof(W1_LE), A1_LE, sizeof(A1_LE));
-  changed |=
-      replaceBytes(data, size, W2_LE, sizeof(W2_LE), A2_LE, sizeof(A2_LE));
-
-  return changed;
+// 1045 中 W1/W2 -> A1/A2（UTF-16BE/LE 四个模式，一次扫描）
+inline bool patch1045_W1W2_to_A1A2(uint8_t *data, uint32_t size) {
+  static const MultiPatternReplacer replacer = [] {
+    MultiPatternReplacer r;
+    // UTF-16BE
+    r.add({0x00, 0x57, 0x00, 0x31}, {0x00, 0x41, 0x00, 0x31});
+    r.add({0x00, 0x57, 0x00, 0x32}, {0x00, 0x41, 0x00, 0x32});
+    // UTF-16LE
+    r.add({0x57, 0x00, 0x31, 0x00}, {0x41, 0x00, 0x31, 0x00});
+    r.add({0x57, 0x00, 0x32, 0x00}, {0x41, 0x00, 0x32, 0x00});
+    r.build();
+    return r;
+  }();
+
+  return replacer.replaceInPlace(data, size) > 0;
 }
 
 // 修改 1006：把第2/3个名字改为 A1/A2（不改长度）
-static bool patch1006_W1W2_to_A1A2(uint8_t *data, uint32_t size) {
+inline bool patch1006_W1W2_to_A1A2(uint8_t *data, uint32_t size) {
   size_t pos = 0;
   int idx = 0;
   bool changed = false;
@@ -91,87 +70,41 @@ static bool patch1006_W1W2_to_A1A2(uint8_t *data, uint32_t size) {
   return changed;
 }
 
-// 在 34377 blob 中找到 rid=1006，并 patch
-static bool patchPs34377_renameW1W2(std::vector<uint8_t> &ps34377) {
+// 通过索引定位 rid=1045/1006，并 patch
+inline bool patchPs34377_renameW1W2(std::vector<uint8_t> &ps34377,
+                                    const PsResourceIndex &index) {
   if (ps34377.empty())
     return false;
 
-  size_t pos = 0;
-  const size_t len = ps34377.size();
-  int hit = 0;
-
   bool patched1006 = false;
   bool patched1045 = false;
-  while (pos + 4 <= len) {
-    const size_t blockStart = pos;
-
-    // signature
-    if (pos + 4 > len)
-      break;
-    if (std::memcmp(ps34377.data() + pos, "8BIM", 4) != 0)
-      break;
-    pos += 4;
-
-    // resource id
-    if (pos + 2 > len)
-      break;
-    uint16_t rid = readBE16(ps34377.data() + pos);
-    pos += 2;
-
-    // Pascal name
-    if (pos + 1 > len)
-      break;
-    uint8_t nameLen = ps34377[pos++];
-    if (pos + nameLen > len)
-      break;
-    pos += nameLen;
-    if (((1u + (unsigned)nameLen) & 1u) != 0) { // pad
-      if (pos + 1 > len)
-        break;
-      pos += 1;
-    }
-
-    // data size
-    if (pos + 4 > len)
-      break;
-    uint32_t dataSize = readBE32(ps34377.data() + pos);
-    pos += 4;
-
-    if (pos + dataSize > len)
-      break;
-    size_t dataOff = pos;
-    pos += dataSize;
-    if ((dataSize & 1u) != 0) { // pad
-      if (pos + 1 > len)
-        break;
-      pos += 1;
-    }
-    if (rid == 1045) {
-      patched1045 = patch1045_W1W2_to_A1A2(ps34377.data() + dataOff, dataSize);
-      DEBUG << "[PsTemplate] patch 1045 W1/W2 -> A1/A2 :"
-            << (patched1045 ? "OK" : "FAILED");
-    }
 
-    if (rid == 1006) {
-      patched1006 = patch1006_W1W2_to_A1A2(ps34377.data() + dataOff, dataSize);
-      DEBUG << "[PsTemplate] patch 1006 W1/W2 -> A1/A2 :"
-            << (patched1006 ? "OK" : "FAILED");
-    }
+  if (const PsResourceEntry *e = index.find(1045)) {
+    patched1045 =
+        patch1045_W1W2_to_A1A2(ps34377.data() + e->dataOff, e->dataSize);
+    DEBUG << "[PsTemplate] patch 1045 W1/W2 -> A1/A2 :"
+          << (patched1045 ? "OK" : "FAILED");
+  }
 
-    if (pos <= blockStart)
-      break;
+  if (const PsResourceEntry *e = index.find(1006)) {
+    patched1006 =
+        patch1006_W1W2_to_A1A2(ps34377.data() + e->dataOff, e->dataSize);
+    DEBUG << "[PsTemplate] patch 1006 W1/W2 -> A1/A2 :"
+          << (patched1006 ? "OK" : "FAILED");
   }
-  if (patched1045 && patched1006)
-    return true;
-  (void)hit;
-  return false;
+
+  return patched1045 && patched1006;
 }
 
 class PsTemplate {
 public:
   std::vector<uint8_t> ps34377;
+  PsResourceIndex index; // 34377 的 8BIM 索引，load 时构建一次
   uint16_t spp = 0;
   uint16_t extra = 0;
+  uint16_t photometric = 0;
+  std::vector<uint16_t> extraSamples; // 模板的 ExtraSamples 布局
+  std::string source;                 // 来源文件（仅用于日志）
 
   bool load(const std::string &path) {
     TIFF *tif = TIFFOpen(path.c_str(), "r");
@@ -180,11 +113,15 @@ public:
 
     // 校验结构
     TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
 
     uint16_t cnt = 0;
     uint16_t *ex = nullptr;
-    if (TIFFGetField(tif, TIFFTAG_EXTRASAMPLES, &cnt, &ex))
+    if (TIFFGetField(tif, TIFFTAG_EXTRASAMPLES, &cnt, &ex)) {
       extra = cnt;
+      extraSamples.assign(ex, ex + cnt);
+    }
+    source = path;
 
     // 读34377
     uint32_t n = 0;
@@ -196,12 +133,69 @@ public:
 
     ps34377.resize(n);
     memcpy(ps34377.data(), data, n);
-    // bool changed = patchPs34377_renameW1W2(ps34377);
+    index.build(ps34377);
+    // bool changed = patchPs34377_renameW1W2(ps34377, index);
 
     dumpPsFlag(ps34377);
     TIFFClose(tif);
     return true;
   }
+
+  // 模板是否与输出图像的通道布局一致
+  bool matches(const TiffMeta &meta) const {
+    return spp == meta.samplesPerPixel && photometric == meta.photometric &&
+           extraSamples == meta.extraSamples;
+  }
+};
+
+// ---------------- 模板注册表 ----------------
+// 一次性加载目录下所有模板，只保留 34377 blob，
+// 按 (photometric, spp, ExtraSamples 布局) 建索引，O(1) 选模板
+struct PsLayoutKey {
+  uint16_t photometric = 0;
+  uint16_t spp = 0;
+  std::vector<uint16_t> extraSamples;
+
+  bool operator==(const PsLayoutKey &o) const {
+    return photometric == o.photometric && spp == o.spp &&
+           extraSamples == o.extraSamples;
+  }
+};
+
+struct PsLayoutKeyHash {
+  size_t operator()(const PsLayoutKey &k) const {
+    size_t h = (static_cast<size_t>(k.photometric) << 16) ^ k.spp;
+    for (uint16_t v : k.extraSamples)
+      h = h * 31 + v + 1;
+    return h;
+  }
+};
+
+class PsTemplateRegistry {
+public:
+  // 加载并校验单个模板；同一布局已存在时保留先加载的
+  bool add(const std::string &path);
+
+  // 加载目录下所有 .tif/.tiff，返回成功加载的数量
+  int loadDirectory(const std::string &dir);
+
+  const PsTemplate *find(uint16_t photometric, uint16_t spp,
+                         const std::vector<uint16_t> &extraSamples) const;
+
+  const PsTemplate *find(const TiffMeta &meta) const {
+    return find(meta.photometric, meta.samplesPerPixel, meta.extraSamples);
+  }
+
+  bool empty() const { return _templates.empty(); }
+  size_t size() const { return _templates.size(); }
+
+  // 全部模板，按布局排序（顺序稳定，供计算结果缓存键）
+  std::vector<const PsTemplate *> list() const;
+
+  void clear() { _templates.clear(); }
+
+private:
+  std::unordered_map<PsLayoutKey, PsTemplate, PsLayoutKeyHash> _templates;
 };
 
 #endif // PSTEMPLATE_H
@@ -0,0 +1,454 @@
+#include "resultcache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <tiffio.h>
+
+#include "utils.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 输出格式或处理流程变化导致旧结果失效时加一
+constexpr uint64_t kCacheVersion = 1;
+
+// ---------------- XXH64（流式） ----------------
+class Xxh64 {
+public:
+  explicit Xxh64(uint64_t seed = 0)
+      : _v{seed + P1 + P2, seed + P2, seed, seed - P1}, _seed(seed) {}
+
+  void update(const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    _total += len;
+    if (_bufLen + len < 32) {
+      std::memcpy(_buf + _bufLen, p, len);
+      _bufLen += len;
+      return;
+    }
+    if (_bufLen > 0) {
+      const size_t fill = 32 - _bufLen;
+      std::memcpy(_buf + _bufLen, p, fill);
+      stripe(_buf);
+      p += fill;
+      len -= fill;
+      _bufLen = 0;
+    }
+    for (; len >= 32; p += 32, len -= 32)
+      stripe(p);
+    std::memcpy(_buf, p, len);
+    _bufLen = len;
+  }
+
+  template <typename T> void add(const T &v) { update(&v, sizeof(v)); }
+
+  void addBytes(const std::vector<uint8_t> &v) {
+    add(static_cast<uint64_t>(v.size()));
+    update(v.data(), v.size());
+  }
+
+  uint64_t digest() const {
+    uint64_t h;
+    if (_total >= 32) {
+      h = rotl(_v[0], 1) + rotl(_v[1], 7) + rotl(_v[2], 12) + rotl(_v[3], 18);
+      for (uint64_t v : _v) {
+        h ^= round(0, v);
+        h = h * P1 + P4;
+      }
+    } else {
+      h = _seed + P5;
+    }
+    h += _total;
+
+    const uint8_t *p = _buf;
+    size_t len = _bufLen;
+    for (; len >= 8; p += 8, len -= 8) {
+      h ^= round(0, read64(p));
+      h = rotl(h, 27) * P1 + P4;
+    }
+    if (len >= 4) {
+      h ^= uint64_t(read32(p)) * P1;
+      h = rotl(h, 23) * P2 + P3;
+      p += 4;
+      len -= 4;
+    }
+    for (; len > 0; ++p, --len) {
+      h ^= *p * P5;
+      h = rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  uint64_t total() const { return _total; }
+
+private:
+  static constexpr uint64_t P1 = 11400714785074694791ULL;
+  static constexpr uint64_t P2 = 14029467366897019727ULL;
+  static constexpr uint64_t P3 = 1609587929392839161ULL;
+  static constexpr uint64_t P4 = 9650029242287828579ULL;
+  static constexpr uint64_t P5 = 2870177450012600261ULL;
+
+  static uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+  }
+  static uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+  }
+  static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+  }
+  static uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    return rotl(acc, 31) * P1;
+  }
+
+  void stripe(const uint8_t *p) {
+    for (int i = 0; i < 4; ++i)
+      _v[i] = round(_v[i], read64(p + 8 * i));
+  }
+
+  uint64_t _v[4];
+  uint64_t _seed;
+  uint64_t _total = 0;
+  uint8_t _buf[32];
+  size_t _bufLen = 0;
+};
+
+// 各页影响输出的 Tag 和未解码的条带 / 瓦片（不解压）
+bool hashTiff(const std::string &path, Xxh64 &h) {
+  TIFF *tif = TIFFOpen(path.c_str(), "r");
+  if (!tif)
+    return false;
+
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> buf(size_t(1) << 20);
+  bool ok = static_cast<bool>(file);
+  do {
+    uint32_t w = 0, hgt = 0;
+    uint16_t spp = 0, bps = 0, photometric = 0, planar = 0, orientation = 0,
+             compression = 0, predictor = 0, fillOrder = 0, resUnit = 0;
+    float xres = 0.0f, yres = 0.0f;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &hgt);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+    TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &orientation);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PREDICTOR, &predictor);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_FILLORDER, &fillOrder);
+    TIFFGetField(tif, TIFFTAG_XRESOLUTION, &xres);
+    TIFFGetField(tif, TIFFTAG_YRESOLUTION, &yres);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_RESOLUTIONUNIT, &resUnit);
+    for (uint64_t v :
+         {uint64_t(w), uint64_t(hgt), uint64_t(spp), uint64_t(bps),
+          uint64_t(photometric), uint64_t(planar), uint64_t(orientation),
+          uint64_t(compression), uint64_t(predictor), uint64_t(fillOrder),
+          uint64_t(resUnit)})
+      h.add(v);
+    h.add(xres);
+    h.add(yres);
+
+    uint16_t extraCount = 0;
+    uint16_t *extra = nullptr;
+    TIFFGetField(tif, TIFFTAG_EXTRASAMPLES, &extraCount, &extra);
+    h.add(extraCount);
+    if (extra)
+      h.update(extra, extraCount * sizeof(uint16_t));
+
+    uint32_t iccSize = 0;
+    void *icc = nullptr;
+    TIFFGetField(tif, TIFFTAG_ICCPROFILE, &iccSize, &icc);
+    h.add(iccSize);
+    if (icc)
+      h.update(icc, iccSize);
+
+    // 按偏移直接读文件里的原始字节，单条带的大图也只用固定大小的缓冲
+    const bool tiled = TIFFIsTiled(tif) != 0;
+    const uint32_t chunks =
+        tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    uint64_t *offsets = nullptr, *counts = nullptr;
+    TIFFGetField(tif, tiled ? TIFFTAG_TILEOFFSETS : TIFFTAG_STRIPOFFSETS,
+                 &offsets);
+    TIFFGetField(tif, tiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS,
+                 &counts);
+    if (!offsets || !counts) {
+      ok = false;
+      break;
+    }
+    h.add(chunks);
+    for (uint32_t i = 0; i < chunks && ok; ++i) {
+      h.add(counts[i]);
+      file.clear();
+      file.seekg(static_cast<std::streamoff>(offsets[i]));
+      for (uint64_t left = counts[i]; left > 0;) {
+        const size_t n = static_cast<size_t>(
+            std::min<uint64_t>(left, buf.size()));
+        if (!file.read(reinterpret_cast<char *>(buf.data()), n)) {
+          ok = false;
+          break;
+        }
+        h.update(buf.data(), n);
+        left -= n;
+      }
+    }
+  } while (ok && TIFFReadDirectory(tif));
+
+  TIFFClose(tif);
+  return ok;
+}
+
+#ifdef __linux__
+// 写时复制克隆（btrfs / XFS 等），不支持时返回 false
+bool reflinkFile(const fs::path &from, const fs::path &to) {
+#ifdef FICLONE
+  const int src = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (src < 0)
+    return false;
+  const int dst =
+      open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = dst >= 0 && ioctl(dst, FICLONE, src) == 0;
+  if (dst >= 0)
+    close(dst);
+  close(src);
+  if (!ok) {
+    std::error_code ec;
+    fs::remove(to, ec);
+  }
+  return ok;
+#else
+  (void)from;
+  (void)to;
+  return false;
+#endif
+}
+#endif
+
+// reflink -> 硬链接 -> 复制；to 已存在时先删除
+bool linkOrCopy(const fs::path &from, const fs::path &to, bool allowHardlink) {
+  std::error_code ec;
+  fs::remove(to, ec);
+#ifdef __linux__
+  if (reflinkFile(from, to))
+    return true;
+#endif
+  if (allowHardlink) {
+    fs::create_hard_link(from, to, ec);
+    if (!ec)
+      return true;
+  }
+  return fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+}
+
+std::string toHex(uint64_t v) {
+  char s[17];
+  std::snprintf(s, sizeof(s), "%016llx", static_cast<unsigned long long>(v));
+  return s;
+}
+
+// path 同目录下不会冲突的临时文件名
+std::string tmpPathFor(const std::string &path, uint64_t counter) {
+  const uint64_t salt =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+      static_cast<uint64_t>(
+          std::chrono::steady_clock::now().time_since_epoch().count());
+  return path + "." + toHex(salt) + "." + std::to_string(counter) + ".tmp";
+}
+
+std::atomic<uint64_t> g_produceCounter{0};
+
+} // namespace
+
+ResultCache::ResultCache(ResultCacheConfig config)
+    : _config(std::move(config)) {
+  if (enabled()) {
+    std::error_code ec;
+    fs::create_directories(_config.dir, ec);
+  }
+}
+
+std::string ResultCache::objectPath(const std::string &key) const {
+  return (fs::path(_config.dir) / (key + ".tif")).string();
+}
+
+std::string ResultCache::key(const std::string &input,
+                             const TiffPageParams &params,
+                             const PsTemplateRegistry &templates) const {
+  Xxh64 h;
+  h.add(kCacheVersion);
+  if (!hashTiff(input, h))
+    return {};
+
+  h.add(static_cast<int>(params.method));
+  h.add(params.blacknessThresh);
+  h.add(params.noiseThresh);
+  h.add(params.whiteOffset);
+  h.add(params.compression);
+
+  // 指定模板优先；否则按布局从注册表选，整个注册表参与
+  if (params.ps) {
+    h.addBytes(params.ps->ps34377);
+  } else {
+    const std::vector<const PsTemplate *> all = templates.list();
+    h.add(static_cast<uint64_t>(all.size()));
+    for (const PsTemplate *t : all) {
+      h.add(t->photometric);
+      h.add(t->spp);
+      h.add(static_cast<uint64_t>(t->extraSamples.size()));
+      h.update(t->extraSamples.data(),
+               t->extraSamples.size() * sizeof(uint16_t));
+      h.addBytes(t->ps34377);
+    }
+  }
+
+  const tiffProcess &proc = tiffProcess::getInstance();
+  h.addBytes(proc.cmykProfile());
+  h.addBytes(proc.rgbProfile());
+
+  return toHex(h.digest()) + toHex(h.total());
+}
+
+bool ResultCache::fetch(const std::string &key, const std::string &output) {
+  if (!enabled() || key.empty())
+    return false;
+  const fs::path obj = objectPath(key);
+  std::error_code ec;
+  if (!fs::is_regular_file(obj, ec))
+    return false;
+  // 其他进程可能正好把它淘汰掉，链接 / 复制失败按未命中处理
+  if (!linkOrCopy(obj, output, _config.allowHardlink))
+    return false;
+  fs::last_write_time(obj, fs::file_time_type::clock::now(), ec);
+  DEBUG << "[Cache] hit" << key.c_str() << "->" << output.c_str();
+  return true;
+}
+
+int ResultCache::store(const std::string &key, const std::string &output) {
+  if (!enabled() || key.empty())
+    return -1;
+  const fs::path obj = objectPath(key);
+
+  // 同目录临时文件 + 改名：其他进程只会看到完整的对象。
+  // 不用硬链接，缓存对象和 output 不能是同一文件
+  const fs::path tmp = tmpPathFor(obj.string(), ++_tmpCounter);
+  if (!linkOrCopy(output, tmp, false))
+    return -2;
+  std::error_code ec;
+  fs::rename(tmp, obj, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return -3;
+  }
+  fs::last_write_time(obj, fs::file_time_type::clock::now(), ec);
+  evict();
+  return 0;
+}
+
+void ResultCache::evict() {
+  if (!enabled() || _config.maxBytes <= 0)
+    return;
+  std::unique_lock<std::mutex> lock(_evictMutex, std::try_to_lock);
+  if (!lock.owns_lock())
+    return; // 本进程已有线程在淘汰
+
+  struct Entry {
+    fs::path path;
+    fs::file_time_type time;
+    uintmax_t size;
+  };
+  std::vector<Entry> entries;
+  uintmax_t total = 0;
+  const auto now = fs::file_time_type::clock::now();
+  std::error_code ec;
+  for (const auto &e : fs::directory_iterator(_config.dir, ec)) {
+    std::error_code fec;
+    const fs::path &p = e.path();
+    const auto time = fs::last_write_time(p, fec);
+    const uintmax_t size = fs::file_size(p, fec);
+    if (fec)
+      continue;
+    if (p.extension() == ".tmp") {
+      // 崩溃残留的临时文件
+      if (now - time > std::chrono::hours(1))
+        fs::remove(p, fec);
+      continue;
+    }
+    if (p.extension() != ".tif")
+      continue;
+    entries.push_back({p, time, size});
+    total += size;
+  }
+  if (total <= static_cast<uintmax_t>(_config.maxBytes))
+    return;
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.time < b.time; });
+  for (const Entry &e : entries) {
+    if (total <= static_cast<uintmax_t>(_config.maxBytes))
+      break;
+    std::error_code rec;
+    if (fs::remove(e.path, rec))
+      total -= e.size;
+  }
+}
+
+int processWithCache(ResultCache *cache, const std::string &input,
+                     const std::string &output, const TiffPageParams &params,
+                     const PsTemplateRegistry &templates,
+                     const std::function<int(const std::string &)> &produce,
+                     bool *hit) {
+  if (hit)
+    *hit = false;
+  std::string key;
+  if (cache && cache->enabled())
+    key = cache->key(input, params, templates);
+  if (!key.empty() && cache->fetch(key, output)) {
+    if (hit)
+      *hit = true;
+    return 0;
+  }
+
+  // output 可能是上次命中时留下的硬链接，改名替换目录项而不是原地截断
+  const std::string tmp = tmpPathFor(output, ++g_produceCounter);
+  int res = produce(tmp);
+  std::error_code ec;
+  if (res == 0) {
+    fs::rename(tmp, output, ec);
+    if (ec)
+      res = -5;
+  }
+  if (res != 0) {
+    fs::remove(tmp, ec);
+    return res;
+  }
+  // 存缓存失败不影响本次结果
+  if (!key.empty())
+    cache->store(key, output);
+  return 0;
+}
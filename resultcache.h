@@ -0,0 +1,69 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "pstemplate.h"
+#include "tiffprocess.h"
+
+// ---------------- 结果缓存 ----------------
+// 按内容寻址的磁盘缓存：键为输入各页未解码的条带 / 瓦片数据、影响输出的 Tag、
+// 处理参数、模板和 ICC 配置文件的 XXH64（附带参与哈希的字节数）。
+// 同一稿件重复提交时直接把上次的输出 reflink / 复制过去，不再处理。
+//   <dir>/<key>.tif     缓存对象，修改时间即最近使用时间（命中时刷新）
+//   写入先写同目录临时文件再改名，多个进程同时读写同一缓存目录是安全的；
+//   淘汰按修改时间从旧到新删除，直到总大小不超过 maxBytes。
+// 存入缓存只用 reflink / 复制，缓存对象不会和生成的输出共用同一文件。
+// allowHardlink 只影响命中时取出：输出与缓存对象共用同一文件，
+// processWithCache 总是先写临时文件再改名覆盖 output，流水线自身重写不会
+// 改到缓存；但任何原地修改输出的操作（包括外部程序以 "w" / "r+" 打开
+// 同一路径）都会连带改坏缓存，只有确定输出只读时才开启。
+
+struct ResultCacheConfig {
+  std::string dir; // 为空不启用
+  int64_t maxBytes = int64_t(20) << 30;
+  bool allowHardlink = false;
+};
+
+class ResultCache {
+public:
+  explicit ResultCache(ResultCacheConfig config);
+
+  bool enabled() const { return !_config.dir.empty(); }
+
+  // 计算缓存键（32 位十六进制）；输入读不了返回空
+  std::string key(const std::string &input, const TiffPageParams &params,
+                  const PsTemplateRegistry &templates) const;
+
+  // 命中时把缓存对象放到 output，返回 true
+  bool fetch(const std::string &key, const std::string &output);
+
+  // 把已生成的 output 存入缓存，超出上限时淘汰；失败返回负数
+  int store(const std::string &key, const std::string &output);
+
+  // 按最近使用时间淘汰到 maxBytes 以内
+  void evict();
+
+private:
+  std::string objectPath(const std::string &key) const;
+
+  ResultCacheConfig _config;
+  std::atomic<uint64_t> _tmpCounter{0};
+  std::mutex _evictMutex; // 本进程内同时只有一个线程淘汰
+};
+
+// 缓存命中时直接得到 output，否则调用 produce(dst) 生成并存入缓存。
+// produce 写到 output 同目录的临时文件，成功后改名覆盖 output，
+// 不会原地截断 output 原来指向的文件（可能是缓存对象的硬链接）。
+// hit 非空时返回是否命中
+int processWithCache(ResultCache *cache, const std::string &input,
+                     const std::string &output, const TiffPageParams &params,
+                     const PsTemplateRegistry &templates,
+                     const std::function<int(const std::string &)> &produce,
+                     bool *hit = nullptr);
+
+#endif // RESULTCACHE_H
@@ -0,0 +1,311 @@
+#include "runmask.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "taskpool.h"
+
+namespace {
+
+// 各行并行生成行程后整体写入 dst；fill 全部完成后才改动 dst，
+// 因此 fill 可以读取 dst 自身（src 与 dst 为同一对象）
+template <typename Fn>
+void buildRuns(RunMask &dst, int width, int height, Fn &&fill) {
+  std::vector<std::vector<BitRun>> rows(height);
+  parallelFor(cv::Range(0, height), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y)
+      fill(y, rows[y]);
+  });
+  dst.create(width, height);
+  dst.assign(rows);
+}
+
+// 追加 [x0, x1)，与上一个行程相接时合并
+inline void appendRun(std::vector<BitRun> &row, int x0, int x1) {
+  if (x0 >= x1)
+    return;
+  if (!row.empty() && row.back().x1 >= x0)
+    row.back().x1 = std::max(row.back().x1, x1);
+  else
+    row.push_back({x0, x1});
+}
+
+} // namespace
+
+void RunMask::create(int width, int height) {
+  _width = std::max(0, width);
+  _height = std::max(0, height);
+  _runs.clear();
+  _rowStart.assign(_height + 1, 0);
+}
+
+int64_t RunMask::area() const {
+  int64_t sum = 0;
+  for (const BitRun &r : _runs)
+    sum += r.x1 - r.x0;
+  return sum;
+}
+
+void RunMask::assign(std::vector<std::vector<BitRun>> &rows) {
+  size_t total = 0;
+  for (int y = 0; y < _height; ++y) {
+    _rowStart[y] = total;
+    total += rows[y].size();
+  }
+  _rowStart[_height] = total;
+
+  _runs.resize(total);
+  for (int y = 0; y < _height; ++y) {
+    std::copy(rows[y].begin(), rows[y].end(), _runs.begin() + _rowStart[y]);
+    std::vector<BitRun>().swap(rows[y]);
+  }
+}
+
+// ---------------- 编码 ----------------
+
+int thresholdToRuns(const cv::Mat &src, int thresh, RunMask &dst,
+                    cv::Point origin) {
+  if (src.empty() || src.type() != CV_8UC1)
+    return -1;
+  if (dst.empty()) {
+    if (origin != cv::Point())
+      return -2;
+    dst.create(src.cols, src.rows);
+  }
+  if (origin.x < 0 || origin.y < 0 || origin.x + src.cols > dst.width() ||
+      origin.y + src.rows > dst.height())
+    return -2;
+
+  // 先压成位（SIMD），再按字找行程；区域外的行保持不变
+  const size_t words = (static_cast<size_t>(src.cols) + 63) / 64;
+  buildRuns(dst, dst.width(), dst.height(),
+            [&](int y, std::vector<BitRun> &row) {
+              const int sy = y - origin.y;
+              if (sy < 0 || sy >= src.rows) {
+                row.assign(dst.row(y), dst.row(y) + dst.runCount(y));
+                return;
+              }
+              thread_local std::vector<uint64_t> bits;
+              bits.resize(words);
+              thresholdRowToBits(src.ptr<uint8_t>(sy), src.cols, thresh,
+                                 bits.data());
+              extractRuns(bits.data(), src.cols, row);
+              for (BitRun &r : row) {
+                r.x0 += origin.x;
+                r.x1 += origin.x;
+              }
+            });
+  return 0;
+}
+
+int encodeRuns(const cv::Mat &src, RunMask &dst) {
+  if (src.empty() || src.type() != CV_8UC1)
+    return -1;
+  const size_t words = (static_cast<size_t>(src.cols) + 63) / 64;
+  buildRuns(dst, src.cols, src.rows, [&](int y, std::vector<BitRun> &row) {
+    thread_local std::vector<uint64_t> bits;
+    bits.resize(words);
+    packRowBits(src.ptr<uint8_t>(y), src.cols, bits.data());
+    extractRuns(bits.data(), src.cols, row);
+  });
+  return 0;
+}
+
+int encodeRuns(const BitMask &src, RunMask &dst) {
+  if (src.empty())
+    return -1;
+  buildRuns(dst, src.width(), src.height(),
+            [&](int y, std::vector<BitRun> &row) {
+              extractRuns(src.row(y), src.width(), row);
+            });
+  return 0;
+}
+
+// ---------------- 解码 ----------------
+
+void decodeRow(const RunMask &src, int y, int x0, int n, uint8_t *dst) {
+  std::memset(dst, 0, n);
+  const BitRun *begin = src.row(y);
+  const BitRun *end = begin + src.runCount(y);
+  // 跳过 x0 之前结束的行程
+  const BitRun *r = std::partition_point(
+      begin, end, [x0](const BitRun &run) { return run.x1 <= x0; });
+  const int x1 = x0 + n;
+  for (; r != end && r->x0 < x1; ++r) {
+    const int a = std::max(x0, r->x0), b = std::min(x1, r->x1);
+    std::memset(dst + (a - x0), 255, b - a);
+  }
+}
+
+int decodeRuns(const RunMask &src, cv::Mat &dst, const cv::Rect &rect) {
+  if (src.empty())
+    return -1;
+  const cv::Rect full(0, 0, src.width(), src.height());
+  const cv::Rect r = rect.empty() ? full : rect;
+  if ((r & full) != r)
+    return -2;
+
+  dst.create(r.size(), CV_8UC1);
+  parallelFor(cv::Range(0, r.height), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y)
+      decodeRow(src, r.y + y, r.x, r.width, dst.ptr<uint8_t>(y));
+  });
+  return 0;
+}
+
+int decodeRuns(const RunMask &src, BitMask &dst) {
+  if (src.empty())
+    return -1;
+  dst.create(src.width(), src.height());
+  parallelFor(cv::Range(0, src.height()), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      uint64_t *d = dst.row(y);
+      std::fill(d, d + dst.wordsPerRow(), 0);
+      const BitRun *runs = src.row(y);
+      for (size_t i = 0; i < src.runCount(y); ++i)
+        dst.setRange(y, runs[i].x0, runs[i].x1, true);
+    }
+  });
+  return 0;
+}
+
+void fillOutside(RunMask &mask, const cv::Rect &roi, bool value) {
+  const int w = mask.width(), h = mask.height();
+  const int rx0 = std::clamp(roi.x, 0, w);
+  const int rx1 = std::clamp(roi.x + roi.width, rx0, w);
+  const int ry0 = std::clamp(roi.y, 0, h);
+  const int ry1 = std::clamp(roi.y + roi.height, ry0, h);
+
+  buildRuns(mask, w, h, [&](int y, std::vector<BitRun> &row) {
+    if (y < ry0 || y >= ry1) {
+      if (value)
+        row.push_back({0, w});
+      return;
+    }
+    if (value)
+      appendRun(row, 0, rx0);
+    const BitRun *runs = mask.row(y);
+    for (size_t i = 0; i < mask.runCount(y); ++i)
+      appendRun(row, std::max(runs[i].x0, rx0), std::min(runs[i].x1, rx1));
+    if (value)
+      appendRun(row, rx1, w);
+  });
+}
+
+// ---------------- 连通域 ----------------
+
+int labelRuns(const RunMask &src, std::vector<int> &labels,
+              std::vector<int64_t> &areas) {
+  if (src.empty())
+    return -1;
+  const int h = src.height();
+  const size_t n = src.runCount();
+
+  std::vector<size_t> parent(n);
+  for (size_t i = 0; i < n; ++i)
+    parent[i] = i;
+
+  auto find = [&](size_t a) {
+    while (parent[a] != a) {
+      parent[a] = parent[parent[a]];
+      a = parent[a];
+    }
+    return a;
+  };
+  auto unite = [&](size_t a, size_t b) {
+    a = find(a);
+    b = find(b);
+    if (a == b)
+      return;
+    if (a > b)
+      std::swap(a, b);
+    parent[b] = a;
+  };
+
+  // 与上一行横向重叠或对角相邻（8 连通）的行程合并
+  for (int y = 1; y < h; ++y) {
+    const BitRun *prev = src.row(y - 1);
+    const BitRun *cur = src.row(y);
+    const size_t np = src.runCount(y - 1), nc = src.runCount(y);
+    const size_t base = src.rowStart(y), prevBase = src.rowStart(y - 1);
+    size_t j = 0;
+    for (size_t i = 0; i < nc; ++i) {
+      while (j < np && prev[j].x1 < cur[i].x0)
+        ++j;
+      for (size_t k = j; k < np && prev[k].x0 <= cur[i].x1; ++k)
+        unite(base + i, prevBase + k);
+    }
+  }
+
+  // 根节点下标最小，按首次出现顺序编号
+  labels.assign(n, -1);
+  areas.clear();
+  for (int y = 0; y < h; ++y) {
+    const BitRun *runs = src.row(y);
+    for (size_t i = 0; i < src.runCount(y); ++i) {
+      const size_t idx = src.rowStart(y) + i;
+      const size_t root = find(idx);
+      if (labels[root] < 0) {
+        labels[root] = static_cast<int>(areas.size());
+        areas.push_back(0);
+      }
+      labels[idx] = labels[root];
+      areas[labels[idx]] += runs[i].x1 - runs[i].x0;
+    }
+  }
+  return static_cast<int>(areas.size());
+}
+
+int filterRunsByArea(const RunMask &src, int minArea, RunMask &dst) {
+  if (src.empty())
+    return -1;
+  if (minArea <= 1) {
+    if (&dst != &src)
+      dst = src;
+    return 0;
+  }
+
+  std::vector<int> labels;
+  std::vector<int64_t> areas;
+  int res = labelRuns(src, labels, areas);
+  if (res < 0)
+    return res;
+
+  buildRuns(dst, src.width(), src.height(),
+            [&](int y, std::vector<BitRun> &row) {
+              const BitRun *runs = src.row(y);
+              for (size_t i = 0; i < src.runCount(y); ++i)
+                if (areas[labels[src.rowStart(y) + i]] >= minArea)
+                  row.push_back(runs[i]);
+            });
+  return 0;
+}
+
+int decodeRuns(const RunMask &src, const std::vector<int> &labels,
+               const std::vector<uint8_t> &keep, BitMask &dst,
+               const std::vector<uint8_t> *changed) {
+  if (src.empty() || labels.size() != src.runCount())
+    return -1;
+  if (changed && (dst.size() != src.size() || changed->size() != keep.size()))
+    return -2;
+  if (!changed)
+    dst.create(src.width(), src.height());
+
+  // 各行只写自己的字，按行并行
+  parallelFor(cv::Range(0, src.height()), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      if (!changed) {
+        uint64_t *d = dst.row(y);
+        std::fill(d, d + dst.wordsPerRow(), 0);
+      }
+      const BitRun *runs = src.row(y);
+      const int *label = labels.data() + src.rowStart(y);
+      for (size_t i = 0; i < src.runCount(y); ++i) {
+        const int l = label[i];
+        if (changed ? (*changed)[l] != 0 : keep[l] != 0)
+          dst.setRange(y, runs[i].x0, runs[i].x1, keep[l] != 0);
+      }
+    }
+  });
+  return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef RUNMASK_H
+#define RUNMASK_H
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "bitmask.h"
+
+// ---------------- 行程编码蒙版 ----------------
+// 印刷图稿的蒙版基本是大段的 0 / 255，按行存置位区间 [x0, x1)：
+// 所有行程连续存放，_rowStart[y] 为第 y 行第一个行程的下标。
+// 连通域标记直接在行程上做，标签按行程存，不再需要整幅 CV_32S 标签图。
+class RunMask {
+public:
+  RunMask() = default;
+  RunMask(int width, int height) { create(width, height); }
+
+  // 设置尺寸并清空所有行程
+  void create(int width, int height);
+
+  bool empty() const { return _width <= 0 || _height <= 0; }
+  int width() const { return _width; }
+  int height() const { return _height; }
+  cv::Size size() const { return cv::Size(_width, _height); }
+
+  // 全部行程 / 第 y 行行程（按 x0 升序、互不相邻）
+  size_t runCount() const { return _runs.size(); }
+  size_t runCount(int y) const { return _rowStart[y + 1] - _rowStart[y]; }
+  size_t rowStart(int y) const { return _rowStart[y]; }
+  const BitRun *row(int y) const { return _runs.data() + _rowStart[y]; }
+
+  // 置位像素数
+  int64_t area() const;
+
+  // 按行整体替换（rows.size() == height），rows 会被清空
+  void assign(std::vector<std::vector<BitRun>> &rows);
+
+private:
+  int _width = 0;
+  int _height = 0;
+  std::vector<BitRun> _runs;
+  std::vector<size_t> _rowStart;
+};
+
+// src (CV_8UC1) 中 <= thresh 的像素直接编码成行程（与 THRESH_BINARY_INV 一致）。
+// dst 为空时按 src 尺寸创建；否则 src 放在 origin 处，对应各行整行重写
+int thresholdToRuns(const cv::Mat &src, int thresh, RunMask &dst,
+                    cv::Point origin = cv::Point());
+
+// 非 0 像素 / 置位像素编码成行程
+int encodeRuns(const cv::Mat &src, RunMask &dst);
+int encodeRuns(const BitMask &src, RunMask &dst);
+
+// 解码：rect 为空时解码整幅
+int decodeRuns(const RunMask &src, cv::Mat &dst, const cv::Rect &rect = {});
+int decodeRuns(const RunMask &src, BitMask &dst);
+
+// 解码第 y 行的 [x0, x0 + n) 到 dst（0/255），供逐行交错写出
+void decodeRow(const RunMask &src, int y, int x0, int n, uint8_t *dst);
+
+// 把 roi 以外的部分置为 value（相邻行程合并）
+void fillOutside(RunMask &mask, const cv::Rect &roi, bool value);
+
+// 8 连通标记：labels[i] 为第 i 个行程的连通域编号（0 起，按首次出现顺序），
+// areas[l] 为连通域 l 的面积；返回连通域数，失败返回负数
+int labelRuns(const RunMask &src, std::vector<int> &labels,
+              std::vector<int64_t> &areas);
+
+// 删除面积 < minArea 的连通域（src 与 dst 可以是同一对象）
+int filterRunsByArea(const RunMask &src, int minArea, RunMask &dst);
+
+// 按连通域保留表解码：第 i 个行程的像素置为 keep[labels[i]]（labels 来自 labelRuns）。
+// changed 为空时整幅重写 dst；否则 dst 须是上一次的解码结果，
+// 只改写 changed[label] 非 0 的连通域，其余像素不动
+int decodeRuns(const RunMask &src, const std::vector<int> &labels,
+               const std::vector<uint8_t> &keep, BitMask &dst,
+               const std::vector<uint8_t> *changed = nullptr);
+
+#endif // RUNMASK_H
@@ -0,0 +1,259 @@
+#include "streamprocessor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+int StreamProcessor::begin(int width, int channels, const StreamParams &params,
+                           RowSink sink) {
+  if (width <= 0 || channels <= 0 || !sink)
+    return -1;
+
+  const int colorChannels =
+      params.photometric == 2 ? 3 : (params.photometric == 5 ? 4 : -1);
+  if (colorChannels < 0 || channels < colorChannels)
+    return -2;
+  const int oldExtra = channels - colorChannels;
+  if (params.alphaIndex >= oldExtra)
+    return -2;
+
+  _width = width;
+  _channels = channels;
+  _colorChannels = colorChannels;
+  // 颜色 | Alpha | 旧 Extra（去掉原 Alpha） | W1 | W2
+  _outChannels =
+      colorChannels + 1 + oldExtra - (params.alphaIndex >= 0 ? 1 : 0) + 2;
+  _params = params;
+  if (_params.whiteThresh <= 0)
+    _params.whiteThresh = _params.blacknessThresh;
+  _sink = std::move(sink);
+  _finished = false;
+  _rowsIn = 0;
+  _rowsOut = 0;
+
+  _outRow.assign(static_cast<size_t>(width) * _outChannels, 0);
+  _pending.clear();
+  _parent.clear();
+  _area.clear();
+  _lastRow.clear();
+  _prevRuns.clear();
+  return 0;
+}
+
+int StreamProcessor::pushRows(const uint8_t *data, size_t bytesPerLine,
+                              int rows) {
+  if (!data || rows <= 0)
+    return -1;
+  return pushRows(ConstPixelView(data, _width, rows, bytesPerLine, _channels));
+}
+
+int StreamProcessor::pushRows(const ConstPixelView &band) {
+  if (!_sink || _finished)
+    return -1;
+  if (band.empty() || !band.interleaved() || band.width != _width ||
+      band.spp != _channels || band.bytesPerRow < band.rowBytes())
+    return -1;
+
+  tiffProcess &proc = tiffProcess::getInstance();
+  int res = proc.convertToBgr(band, _params.photometric, {}, _bgr);
+  if (res != 0)
+    return res;
+  res = proc.calcBlackness(_bgr, _params.method, _blackness);
+  if (res != 0)
+    return res;
+
+  const size_t srcBytes = band.rowBytes();
+  for (int i = 0; i < band.height; ++i) {
+    std::unique_ptr<PendingRow> row = acquireRow();
+    row->y = _rowsIn++;
+    std::memcpy(row->src.data(), band.row(i), srcBytes);
+    std::memcpy(row->blackness.data(), _blackness.ptr<uint8_t>(i), _width);
+
+    // 与 removeBlack 一致：黑度 > 阈值为透明
+    const uint8_t *b = row->blackness.data();
+    uint8_t *m = row->mask.data();
+    const int thresh = _params.blacknessThresh;
+    for (int x = 0; x < _width; ++x)
+      m[x] = b[x] > thresh ? 0 : 255;
+
+    if (_params.noiseArea > 0)
+      labelRow(*row);
+    _pending.push_back(std::move(row));
+  }
+
+  return drain();
+}
+
+int StreamProcessor::finish() {
+  if (!_sink)
+    return -1;
+  _finished = true;
+  int res = drain();
+  _sink = nullptr;
+  return res;
+}
+
+std::unique_ptr<StreamProcessor::PendingRow> StreamProcessor::acquireRow() {
+  std::unique_ptr<PendingRow> row;
+  if (!_freeRows.empty()) {
+    row = std::move(_freeRows.back());
+    _freeRows.pop_back();
+  } else {
+    row = std::make_unique<PendingRow>();
+  }
+  row->src.resize(static_cast<size_t>(_width) * _channels);
+  row->blackness.resize(_width);
+  row->mask.resize(_width);
+  row->runs.clear();
+  return row;
+}
+
+// ---------------- 增量连通域 ----------------
+
+int StreamProcessor::newLabel(int area) {
+  const int label = static_cast<int>(_parent.size());
+  _parent.push_back(label);
+  _area.push_back(area);
+  _lastRow.push_back(_rowsIn - 1);
+  return label;
+}
+
+int StreamProcessor::find(int label) {
+  while (_parent[label] != label) {
+    _parent[label] = _parent[_parent[label]];
+    label = _parent[label];
+  }
+  return label;
+}
+
+void StreamProcessor::unite(int a, int b) {
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return;
+  if (a > b)
+    std::swap(a, b);
+  _parent[b] = a;
+  _area[a] += _area[b];
+  _lastRow[a] = std::max(_lastRow[a], _lastRow[b]);
+}
+
+// 提取本行前景行程，与上一行行程按 8 连通合并
+void StreamProcessor::labelRow(PendingRow &row) {
+  const uint8_t *m = row.mask.data();
+  for (int x = 0; x < _width;) {
+    if (!m[x]) {
+      ++x;
+      continue;
+    }
+    const int x0 = x;
+    while (x < _width && m[x])
+      ++x;
+    row.runs.push_back({x0, x - 1, newLabel(x - x0)});
+  }
+
+  // 上一行必须紧邻，否则没有连接
+  size_t j = 0;
+  for (Run &run : row.runs) {
+    while (j < _prevRuns.size() && _prevRuns[j].x1 < run.x0 - 1)
+      ++j;
+    for (size_t k = j; k < _prevRuns.size() && _prevRuns[k].x0 <= run.x1 + 1;
+         ++k)
+      unite(run.label, _prevRuns[k].label);
+  }
+  _prevRuns = row.runs;
+}
+
+// 行上所有未达标的连通域都已闭合才能确定去留
+bool StreamProcessor::emittable(const PendingRow &row) {
+  if (_params.noiseArea <= 0 || _finished)
+    return true;
+  const int lastIn = _rowsIn - 1;
+  for (const Run &run : row.runs) {
+    const int root = find(run.label);
+    if (_area[root] < _params.noiseArea && _lastRow[root] >= lastIn)
+      return false;
+  }
+  return true;
+}
+
+int StreamProcessor::emitRow(PendingRow &row) {
+  uint8_t *mask = row.mask.data();
+  if (_params.noiseArea > 0) {
+    for (const Run &run : row.runs) {
+      if (_area[find(run.label)] < _params.noiseArea)
+        std::fill(mask + run.x0, mask + run.x1 + 1, 0);
+    }
+  }
+
+  cv::Mat blackRow(1, _width, CV_8UC1, row.blackness.data());
+  cv::Mat maskRow(1, _width, CV_8UC1, mask);
+  int res = tiffProcess::getInstance().generateWhiteCompensation(
+      blackRow, maskRow, _params.whiteThresh, _white);
+  if (res != 0)
+    return res;
+
+  // 白墨通道值 = 255 - 补白强度
+  uint8_t *ink = _white.ptr<uint8_t>(0);
+  for (int x = 0; x < _width; ++x)
+    ink[x] = static_cast<uint8_t>(255 - ink[x]);
+
+  const uint8_t *extras[2] = {ink, ink};
+  tiffProcess::appendChannelsRow(row.src.data(), _channels, _colorChannels,
+                                 _params.alphaIndex, mask, extras, 2,
+                                 _outRow.data(), _width);
+  res = _sink(_outRow.data(), row.y);
+  if (res != 0)
+    return res;
+  ++_rowsOut;
+  return 0;
+}
+
+int StreamProcessor::drain() {
+  while (!_pending.empty() && emittable(*_pending.front())) {
+    std::unique_ptr<PendingRow> row = std::move(_pending.front());
+    _pending.pop_front();
+    int res = emitRow(*row);
+    _freeRows.push_back(std::move(row));
+    if (res != 0)
+      return res;
+  }
+
+  // 已输出的行不再引用标签，标签表过大时重新编号
+  size_t live = _prevRuns.size();
+  for (const auto &row : _pending)
+    live += row->runs.size();
+  if (_parent.size() > 4 * live + 65536)
+    compactLabels();
+  return 0;
+}
+
+void StreamProcessor::compactLabels() {
+  std::unordered_map<int, int> remap;
+  std::vector<int> parent;
+  std::vector<int64_t> area;
+  std::vector<int> lastRow;
+
+  auto relabel = [&](Run &run) {
+    const int root = find(run.label);
+    auto it = remap.find(root);
+    if (it == remap.end()) {
+      const int id = static_cast<int>(parent.size());
+      parent.push_back(id);
+      area.push_back(_area[root]);
+      lastRow.push_back(_lastRow[root]);
+      it = remap.emplace(root, id).first;
+    }
+    run.label = it->second;
+  };
+
+  for (auto &row : _pending)
+    for (Run &run : row->runs)
+      relabel(run);
+  for (Run &run : _prevRuns)
+    relabel(run);
+
+  _parent = std::move(parent);
+  _area = std::move(area);
+  _lastRow = std::move(lastRow);
+}
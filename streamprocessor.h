@@ -0,0 +1,97 @@
+#ifndef STREAMPROCESSOR_H
+#define STREAMPROCESSOR_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "tiffprocess.h"
+
+// ---------------- 按行带流式处理 ----------------
+// 输入按行带陆续送入，逐行输出 颜色 | Alpha | 旧 Extra | W1 | W2。
+// 黑度/去黑/补白都是逐像素的；去杂点用增量连通域（行程 + 并查集），
+// 某行上所有小连通域都已闭合（或面积已达标）时该行才输出，
+// 因此滞留的行数受 minArea 限制，不需要整页缓冲。
+
+struct StreamParams {
+  uint16_t photometric = 5; // PHOTOMETRIC_RGB = 2 / PHOTOMETRIC_SEPARATED = 5
+  int alphaIndex = -1;      // 输入中 Alpha 所在的 Extra 下标，无则 -1
+  BlacknessMethod method = BlacknessMethod::MAX_CHANNEL;
+  int blacknessThresh = 235;
+  int noiseArea = 0;   // <= 0 不去杂点
+  int whiteThresh = 0; // <= 0 时同 blacknessThresh
+};
+
+class StreamProcessor {
+public:
+  // 按行号顺序输出一行，返回非 0 时中止处理
+  using RowSink = std::function<int(const uint8_t *row, int y)>;
+
+  int begin(int width, int channels, const StreamParams &params,
+            RowSink sink);
+  // 一个行带（交错视图，宽度与通道数须与 begin 一致）
+  int pushRows(const ConstPixelView &band);
+  // rows 行交错像素，行跨度 bytesPerLine
+  int pushRows(const uint8_t *data, size_t bytesPerLine, int rows);
+  // 所有连通域闭合，输出剩余行
+  int finish();
+
+  int outputChannels() const { return _outChannels; }
+  int rowsIn() const { return _rowsIn; }
+  int rowsOut() const { return _rowsOut; }
+  size_t pendingRows() const { return _pending.size(); }
+
+private:
+  struct Run {
+    int x0; // 闭区间 [x0, x1]
+    int x1;
+    int label;
+  };
+
+  struct PendingRow {
+    int y = 0;
+    std::vector<uint8_t> src;
+    std::vector<uint8_t> blackness;
+    std::vector<uint8_t> mask;
+    std::vector<Run> runs;
+  };
+
+  std::unique_ptr<PendingRow> acquireRow();
+  void labelRow(PendingRow &row);
+  int newLabel(int area);
+  int find(int label);
+  void unite(int a, int b);
+  bool emittable(const PendingRow &row);
+  int emitRow(PendingRow &row);
+  int drain();
+  void compactLabels();
+
+  int _width = 0;
+  int _channels = 0;
+  int _colorChannels = 0;
+  int _outChannels = 0;
+  StreamParams _params;
+  RowSink _sink;
+  bool _finished = false;
+  int _rowsIn = 0;
+  int _rowsOut = 0;
+
+  cv::Mat _bgr;       // 当前行带的 BGR
+  cv::Mat _blackness; // 当前行带的黑度
+  cv::Mat _white;     // 单行补白
+  std::vector<uint8_t> _outRow;
+
+  std::deque<std::unique_ptr<PendingRow>> _pending;
+  std::vector<std::unique_ptr<PendingRow>> _freeRows;
+
+  // 连通域并查集：面积、最后出现的行
+  std::vector<int> _parent;
+  std::vector<int64_t> _area;
+  std::vector<int> _lastRow;
+  std::vector<Run> _prevRuns;
+};
+
+#endif // STREAMPROCESSOR_H
@@ -0,0 +1,311 @@
+#include "taskpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <utility>
+
+#include "utils.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace {
+
+// 当前线程在哪个池里是第几个队列（非工作线程为 -1）
+thread_local TaskPool *tlsPool = nullptr;
+thread_local int tlsQueue = -1;
+// 当前线程正在执行的任务所属的组
+thread_local TaskGroup *tlsGroup = nullptr;
+
+// 作用域内把当前任务组设为 group，退出（含异常）时恢复
+class CurrentGroupScope {
+public:
+  explicit CurrentGroupScope(TaskGroup *group) : _prev(tlsGroup) {
+    tlsGroup = group;
+  }
+  ~CurrentGroupScope() { tlsGroup = _prev; }
+
+  CurrentGroupScope(const CurrentGroupScope &) = delete;
+  CurrentGroupScope &operator=(const CurrentGroupScope &) = delete;
+
+private:
+  TaskGroup *_prev;
+};
+
+int hardwareThreads() {
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void pinThread(std::thread &t, int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % hardwareThreads(), &set);
+  pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#elif defined(_WIN32)
+  SetThreadAffinityMask(t.native_handle(),
+                        DWORD_PTR(1) << (cpu % hardwareThreads() % 64));
+#else
+  (void)t;
+  (void)cpu;
+#endif
+}
+
+} // namespace
+
+// ---------------- TaskPool ----------------
+
+TaskPool &TaskPool::getInstance() {
+  static TaskPool instance;
+  return instance;
+}
+
+TaskPool::TaskPool() {
+  if (const char *v = std::getenv("TIFFPROCESS_THREADS"))
+    _workers = std::atoi(v);
+  if (const char *v = std::getenv("TIFFPROCESS_AFFINITY"))
+    _pin = std::atoi(v) != 0;
+  if (_workers <= 0)
+    _workers = hardwareThreads();
+  _queues.push_back(std::make_unique<Queue>());
+}
+
+TaskPool::~TaskPool() { stop(); }
+
+void TaskPool::configure(int workers, bool pinThreads) {
+  std::lock_guard<std::mutex> lock(_configMutex);
+  stop();
+  _workers = workers > 0 ? workers : hardwareThreads();
+  _pin = pinThreads;
+}
+
+int TaskPool::workers() const { return _workers; }
+
+void TaskPool::start() {
+  std::lock_guard<std::mutex> lock(_configMutex);
+  if (_started)
+    return;
+
+  // OpenCV 自身的并行也改为单线程，线程数统一由本池控制
+  cv::setNumThreads(1);
+
+  // 调用线程等待时参与执行，池内起 workers - 1 个线程；至少一个，
+  // 供只提交不等待的调用方（如热文件夹）使用
+  const int threads = std::max(1, _workers - 1);
+  _queues.resize(1);
+  for (int i = 0; i < threads; ++i)
+    _queues.push_back(std::make_unique<Queue>());
+  _stop = false;
+  for (int i = 0; i < threads; ++i) {
+    _threads.emplace_back(&TaskPool::workerLoop, this, i + 1);
+    if (_pin)
+      pinThread(_threads.back(), i + 1); // CPU 0 留给调用线程
+  }
+  _started = true;
+  DEBUG << "[TaskPool] workers" << _workers << (_pin ? "pinned" : "");
+}
+
+void TaskPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(_sleepMutex);
+    _stop = true;
+  }
+  _sleepCv.notify_all();
+  for (std::thread &t : _threads)
+    t.join();
+  _threads.clear();
+  _started = false;
+}
+
+void TaskPool::workerLoop(int index) {
+  tlsPool = this;
+  tlsQueue = index;
+  for (;;) {
+    if (runOne(nullptr))
+      continue;
+    std::unique_lock<std::mutex> lock(_sleepMutex);
+    _sleepCv.wait(lock, [this] { return _stop || _queued > 0; });
+    if (_stop)
+      return;
+  }
+}
+
+void TaskPool::push(Task task) {
+  if (!_started)
+    start();
+  const int q = tlsPool == this ? tlsQueue : 0;
+  {
+    std::lock_guard<std::mutex> lock(_queues[q]->mutex);
+    _queues[q]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(_sleepMutex);
+    ++_queued;
+  }
+  _sleepCv.notify_one();
+}
+
+bool TaskPool::pop(Task &task, const TaskGroup *group) {
+  const int self = tlsPool == this ? tlsQueue : -1;
+  const int n = static_cast<int>(_queues.size());
+
+  auto take = [&](Queue &q, bool fromBack) {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (fromBack) {
+      for (auto it = q.tasks.rbegin(); it != q.tasks.rend(); ++it) {
+        if (!group || it->group->inside(group)) {
+          task = std::move(*it);
+          q.tasks.erase(std::next(it).base());
+          return true;
+        }
+      }
+    } else {
+      for (auto it = q.tasks.begin(); it != q.tasks.end(); ++it) {
+        if (!group || it->group->inside(group)) {
+          task = std::move(*it);
+          q.tasks.erase(it);
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  // 自己的队列取最新的，公共队列和别人的队列取最早的
+  bool found = self > 0 && take(*_queues[self], true);
+  if (!found)
+    found = take(*_queues[0], false);
+  for (int i = 1; !found && i < n; ++i) {
+    const int victim = (self > 0 ? self + i : i) % n;
+    if (victim != 0 && victim != self)
+      found = take(*_queues[victim], false);
+  }
+  if (found)
+    --_queued;
+  return found;
+}
+
+bool TaskPool::runOne(const TaskGroup *group) {
+  Task task;
+  if (!pop(task, group))
+    return false;
+
+  if (!task.group->cancelled()) {
+    CurrentGroupScope scope(task.group);
+    try {
+      task.fn();
+    } catch (const std::exception &e) {
+      DEBUG << "[TaskPool] task failed:" << e.what();
+      task.group->fail(std::current_exception());
+    } catch (...) {
+      DEBUG << "[TaskPool] task failed: unknown exception";
+      task.group->fail(std::current_exception());
+    }
+  }
+  task.fn = nullptr; // 先释放捕获的数据再标记完成
+  task.group->finish();
+  return true;
+}
+
+// ---------------- TaskGroup ----------------
+
+TaskGroup::TaskGroup()
+    : _pool(TaskPool::getInstance()), _parent(tlsGroup) {}
+
+TaskGroup::~TaskGroup() { join(); }
+
+TaskGroup *TaskGroup::current() { return tlsGroup; }
+
+void TaskGroup::run(std::function<void()> fn) {
+  ++_pending;
+  _pool.push({std::move(fn), this});
+}
+
+void TaskGroup::join() {
+  // 只帮忙执行本组的任务：执行别的组的长任务（如另一页）会拖慢本组，
+  // 按序写出的多页任务还可能互相等待
+  while (_pending > 0) {
+    if (_pool.runOne(this))
+      continue;
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait_for(lock, std::chrono::milliseconds(1),
+                 [this] { return _pending == 0; });
+  }
+}
+
+int TaskGroup::wait() {
+  join();
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    error = std::exchange(_error, nullptr);
+  }
+  if (error)
+    std::rethrow_exception(error);
+  return cancelled() ? kTaskCancelled : 0;
+}
+
+void TaskGroup::fail(std::exception_ptr error) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_error)
+      _error = std::move(error);
+  }
+  cancel();
+}
+
+void TaskGroup::finish() {
+  // 持锁递减：wait 返回（组可能随即析构）前须等这里放开锁
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (--_pending == 0)
+    _cv.notify_all();
+}
+
+// ---------------- parallelFor ----------------
+
+int parallelFor(const cv::Range &range,
+                const std::function<void(const cv::Range &)> &fn, int grain) {
+  const int n = range.end - range.start;
+  if (n <= 0)
+    return 0;
+
+  const int threads = TaskPool::getInstance().workers();
+  int segments = grain > 0 ? (n + grain - 1) / grain : threads * 4;
+  segments = std::min(segments, n);
+
+  TaskGroup *outer = TaskGroup::current();
+  if (segments <= 1 || threads <= 1) {
+    if (outer && outer->cancelled())
+      return kTaskCancelled;
+    fn(range);
+    return 0;
+  }
+
+  // 第 0 段由调用线程直接执行，其余提交
+  auto segment = [&](int i) {
+    return cv::Range(range.start + static_cast<int>(int64_t(n) * i / segments),
+                     range.start +
+                         static_cast<int>(int64_t(n) * (i + 1) / segments));
+  };
+  TaskGroup group;
+  for (int i = 1; i < segments; ++i)
+    group.run([&fn, r = segment(i)] { fn(r); });
+  if (!group.cancelled()) {
+    CurrentGroupScope scope(&group);
+    try {
+      fn(segment(0));
+    } catch (...) {
+      group.fail(std::current_exception());
+    }
+  }
+  return group.wait();
+}
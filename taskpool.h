@@ -0,0 +1,152 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ---------------- 任务调度 ----------------
+// 处理核心共用的一个工作窃取线程池，所有阶段（行带 / 分块 / 多页 / 批量）都往这里提交，
+// 不再各自起线程，多个作业同时运行时总线程数也不超过配置的数量。
+//   每个工作线程一个双端队列：自己从尾部取（最近提交，缓存热），空闲线程从别人头部偷；
+//   非工作线程提交的任务进公共队列。
+//   等待任务组的线程（包括工作线程自己）在等待期间继续执行队列中的任务，
+//   因此批量任务内部再并行（嵌套）不会死锁，也不会额外占用线程。
+// 工作线程数：TIFFPROCESS_THREADS 或 configure，<= 0 取 CPU 核数；
+// 调用线程在等待时也参与执行，所以池内只起 workers - 1 个线程（至少一个）。
+// TIFFPROCESS_AFFINITY=1 或 configure(n, true) 时第 i 个工作线程绑定到第 i 个 CPU。
+
+class TaskGroup;
+
+// 任务被取消时各接口的返回值
+constexpr int kTaskCancelled = -100;
+
+class TaskPool {
+public:
+  static TaskPool &getInstance();
+
+  // 重新设置线程数 / 绑核；须在没有任务运行时调用
+  void configure(int workers, bool pinThreads = false);
+  // 参与执行的线程数（含等待中的调用线程）
+  int workers() const;
+
+private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> fn;
+    TaskGroup *group = nullptr;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  TaskPool();
+  ~TaskPool();
+
+  TaskPool(const TaskPool &) = delete;
+  TaskPool &operator=(const TaskPool &) = delete;
+
+  void start();
+  void stop();
+  void workerLoop(int index);
+
+  void push(Task task);
+  // 取一个任务执行（自己的队列 -> 公共队列 -> 偷），没有返回 false；
+  // group 非空时只取该组及其内部创建的组的任务
+  bool runOne(const TaskGroup *group);
+  bool pop(Task &task, const TaskGroup *group);
+
+  std::mutex _configMutex;
+  int _workers = 0;
+  bool _pin = false;
+  std::atomic<bool> _started{false};
+
+  // _queues[0] 为公共队列，_queues[i + 1] 属于第 i 个工作线程
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _threads;
+
+  std::mutex _sleepMutex;
+  std::condition_variable _sleepCv;
+  std::atomic<int64_t> _queued{0};
+  bool _stop = false;
+};
+
+// 一组任务：run 提交，wait 等全部结束（等待时帮忙执行）。
+// cancel 后尚未开始的任务直接跳过，运行中的任务可轮询 cancelled() 提前返回；
+// 在任务内部创建的组继承外层组的取消状态。
+// 任务抛出异常时记下第一个异常并取消本组，wait 在全部结束后重新抛出。
+// 析构时自动等待（不抛出，未取走的异常丢弃）。
+class TaskGroup {
+public:
+  TaskGroup();
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void run(std::function<void()> fn);
+
+  // 全部完成返回 0，被取消返回 kTaskCancelled；有任务抛异常时重新抛出
+  int wait();
+
+  // 记下异常（只保留第一个）并取消本组
+  void fail(std::exception_ptr error);
+
+  void cancel() { _cancelled = true; }
+  bool cancelled() const {
+    return _cancelled || (_parent && _parent->cancelled());
+  }
+
+  // 当前线程正在执行的任务所属的组（不在任务中为空）
+  static TaskGroup *current();
+
+private:
+  friend class TaskPool;
+
+  void finish();
+  // 等待全部任务结束，不抛出
+  void join();
+  bool inside(const TaskGroup *ancestor) const {
+    for (const TaskGroup *g = this; g; g = g->_parent)
+      if (g == ancestor)
+        return true;
+    return false;
+  }
+
+  TaskPool &_pool;
+  TaskGroup *_parent;
+  std::atomic<bool> _cancelled{false};
+  std::atomic<int64_t> _pending{0};
+  std::exception_ptr _error; // 受 _mutex 保护
+  std::mutex _mutex;
+  std::condition_variable _cv;
+};
+
+// 替代 cv::parallel_for_：range 切成若干段提交到线程池并等待完成。
+// grain 为每段最少行数（<= 0 自动，按线程数切成约 4 倍段数）；
+// 外层任务被取消时尚未开始的段会跳过，返回 kTaskCancelled；
+// 任一段抛出异常时其余段跳过，等全部结束后把异常抛给调用方，
+// 因此输出不会在返回 0 时只写了一部分
+int parallelFor(const cv::Range &range,
+                const std::function<void(const cv::Range &)> &fn,
+                int grain = 0);
+
+// 当前线程所在的任务（或其外层任务）是否已取消，供长时间运行的阶段轮询
+inline bool taskCancelled() {
+  const TaskGroup *g = TaskGroup::current();
+  return g && g->cancelled();
+}
+
+#endif // TASKPOOL_H
@@ -4,6 +4,8 @@
 
 #include <vector>
 
+#include "pixelbuffer.h"
+#include "pixelview.h"
 #include "utils.h"
 struct TiffMeta {
   // ---------------- 基本尺寸 ----------------
@@ -31,6 +33,9 @@ struct TiffMeta {
   uint16_t orientation = ORIENTATION_TOPLEFT; // 图像方向
   uint16_t compression = COMPRESSION_NONE;    // 压缩方式
 
+  // TIFFTAG_ICCPROFILE（嵌入的 ICC 配置文件，可能为空）
+  std::vector<uint8_t> iccProfile;
+
   // ---------------- 语义推导（不是 Tag） ----------------
 
   // 是否包含 Alpha 通道
@@ -76,7 +81,8 @@ struct TiffRawData {
   //     [S0 S1 S2 ...][S0 S1 S2 ...]
   //   PLANARCONFIG_SEPARATE :
   //     [plane0][plane1][plane2]...
-  std::vector<uint8_t> buffer;
+  // 分配时不清零、按 SIMD / 大页对齐（见 pixelbuffer.h）
+  PixelBuffer buffer;
 
   // 每一行的字节数（TIFFScanlineSize）
   uint32_t bytesPerRow = 0;
@@ -100,6 +106,25 @@ struct TiffImage {
   int extraSampleCount() const {
     return static_cast<int>(meta.extraSamples.size());
   }
+
+  // 原始像素的视图（按 bytesPerRow 取行，分平面时每个 sample 一个平面）；
+  // 非 8 位或缓冲不足时为空
+  ConstPixelView view() const {
+    if (meta.bitsPerSample != 8 || meta.samplesPerPixel == 0)
+      return {};
+    const bool planar = meta.planarConfig == PLANARCONFIG_SEPARATE;
+    const int spp = planar ? 1 : meta.samplesPerPixel;
+    const int planes = planar ? meta.samplesPerPixel : 1;
+    const size_t planeStride =
+        static_cast<size_t>(raw.bytesPerRow) * meta.height;
+    const size_t rowBytes = static_cast<size_t>(meta.width) * spp;
+    if (meta.width == 0 || meta.height == 0 || raw.bytesPerRow < rowBytes ||
+        raw.buffer.size() < planeStride * planes)
+      return {};
+    return ConstPixelView(raw.buffer.data(), static_cast<int>(meta.width),
+                          static_cast<int>(meta.height), raw.bytesPerRow, spp,
+                          planes, planeStride);
+  }
 };
 
 static inline bool isAlphaSample(uint16_t type) {
@@ -303,106 +328,4 @@ inline void dumpBlockPreview(uint16_t rid, const uint8_t *data, uint32_t size) {
   DEBUG << "---- End BlockPreview ----";
 }
 
-inline void dumpPsFlag(const std::vector<uint8_t> &ps) {
-  DEBUG << "[PhotoshopTag 34377]";
-  if (ps.empty()) {
-    DEBUG << "PhotoshopTag   : none";
-    return;
-  }
-
-  const size_t len = ps.size();
-  DEBUG << "Length         :" << len;
-
-  size_t pos = 0;
-  int idx = 0;
-
-  while (pos + 4 <= len) {
-    const size_t blockStart = pos;
-
-    // signature
-    if (pos + 4 > len)
-      break;
-    char sig[5] = {0};
-    std::memcpy(sig, ps.data() + pos, 4);
-    pos += 4;
-
-    if (std::memcmp(sig, "8BIM", 4) != 0) {
-      DEBUG << "[WARN] Non-8BIM signature at off=" << blockStart
-            << " sig=" << escapePrintable(std::string(sig, 4)) << " -> stop";
-      break;
-    }
-
-    // resource id
-    if (pos + 2 > len) {
-      DEBUG << "[WARN] Truncated resource id -> stop";
-      break;
-    }
-    const uint16_t rid = readBE16(ps.data() + pos);
-    pos += 2;
-
-    // Pascal name
-    if (pos + 1 > len) {
-      DEBUG << "[WARN] Truncated name length -> stop";
-      break;
-    }
-    const uint8_t nameLen = ps[pos++];
-    if (pos + nameLen > len) {
-      DEBUG << "[WARN] Truncated name bytes -> stop";
-      break;
-    }
-    std::string name((const char *)ps.data() + pos,
-                     (const char *)ps.data() + pos + nameLen);
-    pos += nameLen;
-
-    // pad name field to even (1+nameLen)
-    if (((1u + (unsigned)nameLen) & 1u) != 0) {
-      if (pos + 1 > len) {
-        DEBUG << "[WARN] Truncated name pad -> stop";
-        break;
-      }
-      pos += 1;
-    }
-
-    // size
-    if (pos + 4 > len) {
-      DEBUG << "[WARN] Truncated data size -> stop";
-      break;
-    }
-    const uint32_t dataSize = readBE32(ps.data() + pos);
-    pos += 4;
-
-    if (pos + dataSize > len) {
-      DEBUG << "[WARN] Truncated data at off=" << blockStart << " rid=" << rid
-            << " need=" << dataSize << " remain=" << (len - pos) << " -> stop";
-      break;
-    }
-
-    const size_t dataOff = pos;
-    pos += dataSize;
-
-    // pad data to even
-    if ((dataSize & 1u) != 0) {
-      if (pos + 1 > len) {
-        DEBUG << "[WARN] Truncated data pad -> stop";
-        break;
-      }
-      pos += 1;
-    }
-
-    DEBUG << "[" << idx << "] off=" << blockStart << " sig=8BIM"
-          << " id=" << rid << " name=\"" << escapePrintable(name) << "\""
-          << " size=" << dataSize << " dataOff=" << dataOff;
-    if (rid == 1006 || rid == 1007) {
-      dumpBlockPreview(rid, ps.data() + dataOff, dataSize);
-    }
-    idx++;
-
-    if (pos <= blockStart) {
-      DEBUG << "[ERR] parser did not advance -> stop";
-      break;
-    }
-  }
-
-  DEBUG << "BlocksParsed   :" << idx;
-}
 #endif // TIFFIMAGE_H
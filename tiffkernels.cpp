@@ -0,0 +1,275 @@
+#include "tiffkernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TIFFKERNELS_SSE2 1
+#endif
+
+namespace {
+
+inline uint8_t clamp8(int v) {
+  return static_cast<uint8_t>(std::max(0, std::min(255, v)));
+}
+
+// ---------------- blackness ----------------
+
+// 参考实现：逐像素按公式计算
+void blacknessScalar(const uint8_t *bgr, uint8_t *dst, int width,
+                     BlacknessMethod method) {
+  for (int x = 0; x < width; ++x) {
+    uchar R = bgr[3 * x];
+    uchar G = bgr[3 * x + 1];
+    uchar B = bgr[3 * x + 2];
+
+    uchar value = 0;
+
+    switch (method) {
+    case BlacknessMethod::GRAY: {
+      value = static_cast<uchar>(0.299f * R + 0.587f * G + 0.114f * B);
+      break;
+    }
+    case BlacknessMethod::DARK_NEUTRAL: {
+      //暗度
+      float brightness = (R + G + B) / (3.0f * 255.0f);
+      float dark = 1.0f - brightness;
+
+      //中性色
+      uchar maxv = std::max({R, G, B});
+      uchar minv = std::min({R, G, B});
+      float chroma = (maxv - minv) / 255.0f;
+      float neutral = 1.0f - chroma;
+
+      float b = dark * neutral;
+      value = static_cast<uchar>(std::clamp(b, 0.0f, 1.0f) * 255.0f);
+      break;
+    }
+    case BlacknessMethod::MAX_CHANNEL: {
+      // 近似 K = 1 - max(R,G,B)
+      uchar maxv = std::max({R, G, B});
+      value = 255 - maxv;
+      break;
+    }
+    }
+    dst[x] = value;
+  }
+}
+
+// 查表：乘法 / 除法预先按与参考实现相同的浮点运算算好，
+// 运行时只剩查表、一次乘法（DARK_NEUTRAL）或两次加法（GRAY）
+struct BlacknessTables {
+  float grayR[256], grayG[256], grayB[256];
+  float dark[766];    // 按 R+G+B
+  float neutral[256]; // 按 max-min
+
+  BlacknessTables() {
+    for (int i = 0; i < 256; ++i) {
+      const uchar v = static_cast<uchar>(i);
+      grayR[i] = 0.299f * v;
+      grayG[i] = 0.587f * v;
+      grayB[i] = 0.114f * v;
+      neutral[i] = 1.0f - i / 255.0f;
+    }
+    for (int s = 0; s < 766; ++s)
+      dark[s] = 1.0f - s / (3.0f * 255.0f);
+  }
+};
+
+void blacknessLut(const uint8_t *bgr, uint8_t *dst, int width,
+                  BlacknessMethod method) {
+  static const BlacknessTables t;
+
+  switch (method) {
+  case BlacknessMethod::GRAY:
+    for (int x = 0; x < width; ++x) {
+      const uint8_t *p = bgr + 3 * x;
+      dst[x] = static_cast<uchar>(t.grayR[p[0]] + t.grayG[p[1]] + t.grayB[p[2]]);
+    }
+    break;
+  case BlacknessMethod::DARK_NEUTRAL:
+    for (int x = 0; x < width; ++x) {
+      const uint8_t *p = bgr + 3 * x;
+      const uchar maxv = std::max({p[0], p[1], p[2]});
+      const uchar minv = std::min({p[0], p[1], p[2]});
+      const float b = t.dark[p[0] + p[1] + p[2]] * t.neutral[maxv - minv];
+      dst[x] = static_cast<uchar>(std::clamp(b, 0.0f, 1.0f) * 255.0f);
+    }
+    break;
+  case BlacknessMethod::MAX_CHANNEL:
+    for (int x = 0; x < width; ++x) {
+      const uint8_t *p = bgr + 3 * x;
+      dst[x] = 255 - std::max({p[0], p[1], p[2]});
+    }
+    break;
+  }
+}
+
+// ---------------- bgr ----------------
+
+void bgrScalar(const uint8_t *src, int spp, uint16_t photometric, uint8_t *dst,
+               int width) {
+  if (photometric == PHOTOMETRIC_RGB) {
+    for (int x = 0; x < width; ++x) {
+      const uint8_t *p = src + x * spp;
+      // TIFF: RGB -> OpenCV: BGR
+      *dst++ = p[2];
+      *dst++ = p[1];
+      *dst++ = p[0];
+    }
+  } else {
+    for (int x = 0; x < width; ++x) {
+      const uint8_t *p = src + x * spp;
+      int C = p[0];
+      int M = p[1];
+      int Y = p[2];
+      int K = p[3];
+
+      // 工业常见 CMYK → RGB（非 ICC）
+      *dst++ = clamp8(255 - (Y + K));
+      *dst++ = clamp8(255 - (M + K));
+      *dst++ = clamp8(255 - (C + K));
+    }
+  }
+}
+
+#ifdef TIFFKERNELS_SSE2
+// 4 通道 CMYK 一次 4 个像素：255 - sat(C + K) 即 clamp8(255 - (C + K))
+void bgrSse2(const uint8_t *src, int spp, uint16_t photometric, uint8_t *dst,
+             int width) {
+  if (photometric != PHOTOMETRIC_SEPARATED || spp != 4) {
+    bgrScalar(src, spp, photometric, dst, width);
+    return;
+  }
+
+  const __m128i ones = _mm_set1_epi8(static_cast<char>(0xFF));
+  alignas(16) uint8_t rgbx[16];
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * x));
+    // K 广播到每个像素的 4 个字节
+    __m128i k = _mm_srli_epi32(v, 24);
+    k = _mm_or_si128(k, _mm_slli_epi32(k, 8));
+    k = _mm_or_si128(k, _mm_slli_epi32(k, 16));
+    _mm_store_si128(reinterpret_cast<__m128i *>(rgbx),
+                    _mm_subs_epu8(ones, _mm_adds_epu8(v, k)));
+    for (int i = 0; i < 4; ++i) {
+      *dst++ = rgbx[4 * i + 2];
+      *dst++ = rgbx[4 * i + 1];
+      *dst++ = rgbx[4 * i];
+    }
+  }
+  bgrScalar(src + 4 * x, spp, photometric, dst, width - x);
+}
+#endif
+
+// ---------------- interleave ----------------
+
+void interleaveScalar(const uint8_t *src, int srcSpp, int colorChannels,
+                      int alphaIdx, const uint8_t *alpha,
+                      const uint8_t *const *extras, int extraCount,
+                      uint8_t *dst, int width) {
+  const int oldExtra = srcSpp - colorChannels;
+  const int dstSpp = colorChannels + 1 + oldExtra - (alphaIdx >= 0 ? 1 : 0) +
+                     extraCount;
+
+  for (int x = 0; x < width; ++x) {
+    // 1. 颜色通道
+    memcpy(dst, src, colorChannels);
+
+    // 2. Alpha（覆盖或新建）
+    dst[colorChannels] = alpha[x];
+
+    // 3. 拷贝旧 Extra（跳过旧 Alpha）
+    int dstIdx = colorChannels + 1;
+    for (int e = 0; e < oldExtra; ++e) {
+      if (e == alphaIdx)
+        continue;
+      dst[dstIdx++] = src[colorChannels + e];
+    }
+
+    // 4. 新增通道
+    for (int e = 0; e < extraCount; ++e)
+      dst[dstIdx++] = extras[e][x];
+
+    src += srcSpp;
+    dst += dstSpp;
+  }
+}
+
+// 常见布局（无旧 Extra 或只有旧 Alpha）按编译期通道数展开
+template <int CC, int EC>
+void interleaveFixedRow(const uint8_t *src, int srcSpp, const uint8_t *alpha,
+                        const uint8_t *const *extras, uint8_t *dst,
+                        int width) {
+  constexpr int dstSpp = CC + 1 + EC;
+  const uint8_t *e0 = EC > 0 ? extras[0] : nullptr;
+  const uint8_t *e1 = EC > 1 ? extras[1] : nullptr;
+  for (int x = 0; x < width; ++x) {
+    memcpy(dst, src, CC);
+    dst[CC] = alpha[x];
+    if (EC > 0)
+      dst[CC + 1] = e0[x];
+    if (EC > 1)
+      dst[CC + 2] = e1[x];
+    src += srcSpp;
+    dst += dstSpp;
+  }
+}
+
+void interleaveFixed(const uint8_t *src, int srcSpp, int colorChannels,
+                     int alphaIdx, const uint8_t *alpha,
+                     const uint8_t *const *extras, int extraCount,
+                     uint8_t *dst, int width) {
+  const int oldExtra = srcSpp - colorChannels;
+  if (oldExtra == (alphaIdx >= 0 ? 1 : 0)) {
+    switch (colorChannels * 4 + extraCount) {
+    case 3 * 4 + 0:
+      return interleaveFixedRow<3, 0>(src, srcSpp, alpha, extras, dst, width);
+    case 3 * 4 + 1:
+      return interleaveFixedRow<3, 1>(src, srcSpp, alpha, extras, dst, width);
+    case 3 * 4 + 2:
+      return interleaveFixedRow<3, 2>(src, srcSpp, alpha, extras, dst, width);
+    case 4 * 4 + 0:
+      return interleaveFixedRow<4, 0>(src, srcSpp, alpha, extras, dst, width);
+    case 4 * 4 + 1:
+      return interleaveFixedRow<4, 1>(src, srcSpp, alpha, extras, dst, width);
+    case 4 * 4 + 2:
+      return interleaveFixedRow<4, 2>(src, srcSpp, alpha, extras, dst, width);
+    default:
+      break;
+    }
+  }
+  interleaveScalar(src, srcSpp, colorChannels, alphaIdx, alpha, extras,
+                   extraCount, dst, width);
+}
+
+} // namespace
+
+const KernelStage<BlacknessRowFn> &blacknessKernels() {
+  static const KernelStage<BlacknessRowFn> stage(
+      "blackness", {{"scalar", blacknessScalar}, {"lut", blacknessLut}},
+      "lut");
+  return stage;
+}
+
+const KernelStage<BgrRowFn> &bgrKernels() {
+#ifdef TIFFKERNELS_SSE2
+  static const KernelStage<BgrRowFn> stage(
+      "bgr", {{"scalar", bgrScalar}, {"sse2", bgrSse2}}, "sse2");
+#else
+  static const KernelStage<BgrRowFn> stage("bgr", {{"scalar", bgrScalar}},
+                                           "scalar");
+#endif
+  return stage;
+}
+
+const KernelStage<InterleaveRowFn> &interleaveKernels() {
+  static const KernelStage<InterleaveRowFn> stage(
+      "interleave", {{"scalar", interleaveScalar}, {"fixed", interleaveFixed}},
+      "fixed");
+  return stage;
+}
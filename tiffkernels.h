@@ -0,0 +1,33 @@
+#ifndef TIFFKERNELS_H
+#define TIFFKERNELS_H
+
+#include <cstdint>
+
+#include "kernelregistry.h"
+#include "tiffprocess.h"
+
+// ---------------- 行内核 ----------------
+// 各阶段的逐行实现，登记在 KernelRegistry 中（第一个为参考实现）：
+//   blackness  : scalar | lut     黑度（BGR -> 0~255）
+//   bgr        : scalar | sse2    非 ICC 的 RGB / CMYK -> BGR
+//   interleave : scalar | fixed   颜色 | Alpha | 旧 Extra | 新通道 交错
+// 按行调用，外层按行带并行，校验模式下在抽样行上比对参考实现。
+
+using BlacknessRowFn = void (*)(const uint8_t *bgr, uint8_t *dst, int width,
+                                BlacknessMethod method);
+
+using BgrRowFn = void (*)(const uint8_t *src, int spp, uint16_t photometric,
+                          uint8_t *dst, int width);
+
+// 参数同 tiffProcess::appendChannelsRow
+using InterleaveRowFn = void (*)(const uint8_t *src, int srcSpp,
+                                 int colorChannels, int alphaIdx,
+                                 const uint8_t *alpha,
+                                 const uint8_t *const *extras, int extraCount,
+                                 uint8_t *dst, int width);
+
+const KernelStage<BlacknessRowFn> &blacknessKernels();
+const KernelStage<BgrRowFn> &bgrKernels();
+const KernelStage<InterleaveRowFn> &interleaveKernels();
+
+#endif // TIFFKERNELS_H
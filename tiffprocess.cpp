@@ -1,28 +1,59 @@
 #include "tiffprocess.h"
 
+#include "colorlut.h"
+#include "contentbounds.h"
+#include "morphology.h"
+#include "taskpool.h"
 #include "tiffimage.h"
+#include "tiffkernels.h"
 #include "utils.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <mutex>
+#include <thread>
 #define TIFF_DBG(fmt, ...)                                                     \
   do {                                                                         \
     printf("[TIFF] " fmt "\n", ##__VA_ARGS__);                                 \
     fflush(stdout);                                                            \
   } while (0)
-static inline uint8_t clamp8(int v) {
-  return static_cast<uint8_t>(std::max(0, std::min(255, v)));
-}
 
 tiffProcess &tiffProcess::getInstance() {
   static tiffProcess instance; // 局部静态变量，C++11 保证线程安全
   return instance;
 }
 
+int tiffProcess::setColorProfiles(const std::string &cmykProfilePath,
+                                  const std::string &rgbProfilePath) {
+  _cmykProfile.clear();
+  _rgbProfile.clear();
+  if (!cmykProfilePath.empty()) {
+    _cmykProfile = readIccProfile(cmykProfilePath);
+    if (_cmykProfile.empty())
+      return -1;
+  }
+  if (!rgbProfilePath.empty()) {
+    _rgbProfile = readIccProfile(rgbProfilePath);
+    if (_rgbProfile.empty())
+      return -2;
+  }
+  return 0;
+}
+
 int tiffProcess::readTiffImage(std::string_view path, TiffImage &image) {
   TIFF *tif = TIFFOpen(std::string(path).c_str(), "r");
   if (!tif) {
     return -1; // 打开失败
   }
+  int res = readTiffDirectory(tif, image);
+  TIFFClose(tif);
+  if (res == 0)
+    _sourcePath = std::string(path);
+  return res;
+}
 
+int tiffProcess::readTiffDirectory(TIFF *tif, TiffImage &image) {
   TiffMeta &meta = image.meta;
   TiffRawData &raw = image.raw;
   float xres = 0.0f, yres = 0.0f;
@@ -40,6 +71,15 @@ int tiffProcess::readTiffImage(std::string_view path, TiffImage &image) {
   TIFFGetField(tif, TIFFTAG_YRESOLUTION, &yres);
   TIFFGetField(tif, TIFFTAG_RESOLUTIONUNIT, &resUnit);
 
+  uint32_t iccSize = 0;
+  void *iccData = nullptr;
+  if (TIFFGetField(tif, TIFFTAG_ICCPROFILE, &iccSize, &iccData) && iccData) {
+    const uint8_t *icc = static_cast<const uint8_t *>(iccData);
+    meta.iccProfile.assign(icc, icc + iccSize);
+  } else {
+    meta.iccProfile.clear();
+  }
+
   image.meta.xResolution = xres;
   image.meta.yResolution = yres;
   image.meta.resolutionUnit = resUnit;
@@ -54,12 +94,10 @@ int tiffProcess::readTiffImage(std::string_view path, TiffImage &image) {
 
   // ---------------- 校验 ----------------
   if (meta.bitsPerSample != 8) {
-    TIFFClose(tif);
     return -2; // 当前实现只支持 8bit
   }
 
   if (meta.samplesPerPixel == 0 || meta.width == 0 || meta.height == 0) {
-    TIFFClose(tif);
     return -3; // 非法 TIFF
   }
 
@@ -67,43 +105,39 @@ int tiffProcess::readTiffImage(std::string_view path, TiffImage &image) {
   const tsize_t scanlineSize = TIFFScanlineSize(tif);
   raw.bytesPerRow = static_cast<uint32_t>(scanlineSize);
 
-  raw.buffer.resize(static_cast<size_t>(scanlineSize) * meta.height);
+  // 一次按最终大小分配（不清零、不保留上一页的内容，每个字节都由下面的解码写入）
+  const size_t planeSize = static_cast<size_t>(scanlineSize) * meta.height;
+  const uint32_t planes =
+      meta.planarConfig == PLANARCONFIG_CONTIG ? 1 : meta.samplesPerPixel;
+  raw.buffer.reset(planeSize * planes);
 
   if (meta.planarConfig == PLANARCONFIG_CONTIG) {
     // 通道交错（最常见）
     for (uint32_t y = 0; y < meta.height; ++y) {
       uint8_t *dst = raw.buffer.data() + y * scanlineSize;
       if (TIFFReadScanline(tif, dst, y) < 0) {
-        TIFFClose(tif);
         return -4;
       }
     }
   } else {
     // PLANARCONFIG_SEPARATE（每个通道一个 plane）
-    const uint32_t planes = meta.samplesPerPixel;
-    const size_t planeSize = static_cast<size_t>(scanlineSize) * meta.height;
-
-    raw.buffer.resize(planeSize * planes);
-
     for (uint32_t p = 0; p < planes; ++p) {
       for (uint32_t y = 0; y < meta.height; ++y) {
         uint8_t *dst = raw.buffer.data() + p * planeSize + y * scanlineSize;
 
         if (TIFFReadScanline(tif, dst, y, p) < 0) {
-          TIFFClose(tif);
           return -5;
         }
       }
     }
   }
 
-  TIFFClose(tif);
   return 0;
 }
 
-int tiffProcess::generateRgbMat(const TiffImage &image, cv::Mat &outRgb) {
+int tiffProcess::generateRgbMat(const TiffImage &image, cv::Mat &outRgb,
+                                const cv::Rect &roi) {
   const auto &meta = image.meta;
-  const auto &buf = image.raw.buffer;
 
   if (meta.bitsPerSample != 8) {
     return -1; // 只支持 8-bit
@@ -113,95 +147,133 @@ int tiffProcess::generateRgbMat(const TiffImage &image, cv::Mat &outRgb) {
     return -2; // 暂不支持 planar
   }
 
-  const uint32_t width = meta.width;
-  const uint32_t height = meta.height;
-  const uint16_t spp = meta.samplesPerPixel;
+  // 按 bytesPerRow 取行，ROI 只是视图上的偏移，不拷贝
+  const ConstPixelView pixels = image.view();
+  const ConstPixelView src = roi.empty() ? pixels : pixels.roi(roi);
+  if (src.empty())
+    return -3;
+  return convertToBgr(src, meta.photometric, meta.iccProfile, outRgb);
+}
 
-  if (width == 0 || height == 0 || spp < 3) {
+int tiffProcess::convertToBgr(const ConstPixelView &src, uint16_t photometric,
+                              const std::vector<uint8_t> &iccProfile,
+                              cv::Mat &outRgb) {
+  if (src.empty() || !src.interleaved() || src.spp < 3) {
     return -3;
   }
+  const int width = src.width, height = src.height, spp = src.spp;
 
   outRgb.create(height, width, CV_8UC3);
 
-  const uint8_t *src = buf.data();
-  uint8_t *dst = outRgb.data;
-
-  const size_t pixelStride = spp;
-
-  if (meta.photometric == PHOTOMETRIC_RGB) {
-    // -------- RGB → RGB --------
-    for (uint32_t y = 0; y < height; ++y) {
-      for (uint32_t x = 0; x < width; ++x) {
-        const uint8_t *p = src + (y * width + x) * pixelStride;
-
-        // TIFF: RGB
-        uint8_t R = p[0];
-        uint8_t G = p[1];
-        uint8_t B = p[2];
-
-        // OpenCV: BGR
-        *dst++ = B;
-        *dst++ = G;
-        *dst++ = R;
-      }
-    }
-  } else if (meta.photometric == PHOTOMETRIC_SEPARATED) {
+  if (photometric == PHOTOMETRIC_SEPARATED) {
     // -------- CMYK → RGB --------
     if (spp < 4)
       return -4;
 
-    for (uint32_t y = 0; y < height; ++y) {
-      for (uint32_t x = 0; x < width; ++x) {
-        const uint8_t *p = src + (y * width + x) * pixelStride;
-
-        int C = p[0];
-        int M = p[1];
-        int Y = p[2];
-        int K = p[3];
-
-        // 工业常见 CMYK → RGB（非 ICC）
-        uint8_t R = clamp8(255 - (C + K));
-        uint8_t G = clamp8(255 - (M + K));
-        uint8_t B = clamp8(255 - (Y + K));
-
-        *dst++ = B;
-        *dst++ = G;
-        *dst++ = R;
-      }
+    // 有可用配置文件（嵌入优先，其次为配置的）时走 ICC 查找表
+    const std::vector<uint8_t> &cmykProfile =
+        iccProfile.empty() ? _cmykProfile : iccProfile;
+    if (auto lut =
+            CmykRgbLutCache::getInstance().get(cmykProfile, _rgbProfile)) {
+      lut->apply(src, outRgb);
+      return 0;
     }
-  } else {
+  } else if (photometric != PHOTOMETRIC_RGB) {
     return -5; // 不支持的 Photometric
   }
 
+  // RGB → BGR / 工业常见 CMYK → RGB（非 ICC），按行带并行
+  const KernelStage<BgrRowFn> &stage = bgrKernels();
+  const auto k = stage.resolve();
+  parallelFor(cv::Range(0, height), [&](const cv::Range &range) {
+    std::vector<uint8_t> ref(k.verify ? static_cast<size_t>(width) * 3 : 0);
+    for (int y = range.start; y < range.end; ++y) {
+      const uint8_t *row = src.row(y);
+      uint8_t *dst = outRgb.ptr<uint8_t>(y);
+      k.fn(row, spp, photometric, dst, width);
+      if (k.verify && KernelRegistry::getInstance().verifyRow(y)) {
+        k.reference(row, spp, photometric, ref.data(), width);
+        stage.check(k, y, dst, ref.data(), ref.size());
+      }
+    }
+  });
+
   return 0;
 }
 
+void tiffProcess::appendChannelsRow(const uint8_t *src, int srcSpp,
+                                    int colorChannels, int alphaIdx,
+                                    const uint8_t *alpha,
+                                    const uint8_t *const *extras,
+                                    int extraCount, uint8_t *dst, int width) {
+  interleaveKernels().resolve().fn(src, srcSpp, colorChannels, alphaIdx, alpha,
+                                   extras, extraCount, dst, width);
+}
+
 int tiffProcess::updateExtraChannels(TiffImage &image, const cv::Mat &alpha,
                                      const cv::Mat &extra1,
                                      const cv::Mat &extra2) {
-  TiffMeta &meta = image.meta;
-  TiffRawData &raw = image.raw;
+  return updateExtraChannels(image, alpha, std::vector<cv::Mat>{extra1, extra2});
+}
 
-  // ---------------- 基本校验 ----------------
-  if (meta.bitsPerSample != 8 || meta.planarConfig != PLANARCONFIG_CONTIG) {
-    return -1;
+int tiffProcess::updateExtraChannels(TiffImage &image, const cv::Mat &alpha,
+                                     const std::vector<cv::Mat> &extras) {
+  if (alpha.empty()) {
+    return -2;
   }
 
-  if (alpha.empty() || extra1.empty() || extra2.empty()) {
+  if (alpha.type() != CV_8UC1) {
+    return -3;
+  }
+
+  return updateExtraChannels(
+      image, alpha.size(),
+      [&](int y, uint8_t *) { return alpha.ptr<uint8_t>(y); }, extras);
+}
+
+int tiffProcess::updateExtraChannels(TiffImage &image, const RunMask &alpha,
+                                     const std::vector<cv::Mat> &extras) {
+  if (alpha.empty()) {
     return -2;
   }
 
-  if (alpha.type() != CV_8UC1 || extra1.type() != CV_8UC1 ||
-      extra2.type() != CV_8UC1) {
-    return -3;
+  // 交错写入时才逐行解码成 0/255
+  return updateExtraChannels(
+      image, alpha.size(),
+      [&](int y, uint8_t *buf) -> const uint8_t * {
+        decodeRow(alpha, y, 0, alpha.width(), buf);
+        return buf;
+      },
+      extras);
+}
+
+int tiffProcess::updateExtraChannels(TiffImage &image, cv::Size alphaSize,
+                                     const AlphaRowFn &alphaRow,
+                                     const std::vector<cv::Mat> &extras) {
+  TiffMeta &meta = image.meta;
+  TiffRawData &raw = image.raw;
+
+  // ---------------- 基本校验 ----------------
+  // 源像素按视图取行（读入时的 bytesPerRow 可含行填充）
+  const ConstPixelView src = image.view();
+  if (src.empty() || !src.interleaved()) {
+    return -1;
   }
 
-  if (alpha.cols != static_cast<int>(meta.width) ||
-      alpha.rows != static_cast<int>(meta.height) ||
-      extra1.size() != alpha.size() || extra2.size() != alpha.size()) {
+  if (alphaSize.width != static_cast<int>(meta.width) ||
+      alphaSize.height != static_cast<int>(meta.height)) {
     return -4;
   }
 
+  for (const cv::Mat &e : extras) {
+    if (e.empty())
+      return -2;
+    if (e.type() != CV_8UC1)
+      return -3;
+    if (e.size() != alphaSize)
+      return -4;
+  }
+
   // ---------------- 颜色通道数 ----------------
   int colorChannels = -1;
   if (meta.photometric == PHOTOMETRIC_RGB) {
@@ -217,75 +289,61 @@ int tiffProcess::updateExtraChannels(TiffImage &image, const cv::Mat &alpha,
   bool hasAlpha = (alphaExtraIdx >= 0);
 
   // ---------------- 构造新的 ExtraSamples ----------------
+  // 新布局：颜色 | Alpha | 旧 Extra（去掉旧 Alpha） | 新增通道
   std::vector<uint16_t> newExtraSamples;
-
-  if (hasAlpha) {
-    // 保留原顺序（包含 Alpha）
-    newExtraSamples = meta.extraSamples;
-  } else {
-    // 插入 Alpha 到最前
-    newExtraSamples.push_back(EXTRASAMPLE_UNASSALPHA);
-    for (uint16_t t : meta.extraSamples) {
-      newExtraSamples.push_back(t);
-    }
+  newExtraSamples.push_back(hasAlpha ? meta.extraSamples[alphaExtraIdx]
+                                     : EXTRASAMPLE_UNASSALPHA);
+  for (size_t e = 0; e < meta.extraSamples.size(); ++e) {
+    if (hasAlpha && static_cast<int>(e) == alphaExtraIdx)
+      continue;
+    newExtraSamples.push_back(meta.extraSamples[e]);
   }
 
-  // 追加两个新通道
-  newExtraSamples.push_back(EXTRASAMPLE_UNSPECIFIED);
-  newExtraSamples.push_back(EXTRASAMPLE_UNSPECIFIED);
+  // 追加新通道
+  for (size_t i = 0; i < extras.size(); ++i)
+    newExtraSamples.push_back(EXTRASAMPLE_UNSPECIFIED);
 
   // ---------------- sample 计算 ----------------
-  const int oldSpp = meta.samplesPerPixel;
+  const int oldSpp = src.spp;
   const int newExtraCount = static_cast<int>(newExtraSamples.size());
   const int newSpp = colorChannels + newExtraCount;
-
-  // 旧 Alpha 在 sample 中的位置（若存在）
-  int oldAlphaSample = -1;
-  if (hasAlpha) {
-    oldAlphaSample = colorChannels + alphaExtraIdx;
-  }
-
-  // 新 Alpha 在 sample 中的位置（永远是第一个 Extra）
-  const int newAlphaSample = colorChannels;
+  const int extraCount = static_cast<int>(extras.size());
 
   // ---------------- 重建 Raw Buffer ----------------
   const size_t pixelCount = static_cast<size_t>(meta.width) * meta.height;
-
-  std::vector<uint8_t> newBuffer(pixelCount * newSpp);
-
-  const uint8_t *src = raw.buffer.data();
-  uint8_t *dst = newBuffer.data();
-
-  for (size_t i = 0; i < pixelCount; ++i) {
-    // 1. 颜色通道
-    memcpy(dst, src, colorChannels);
-
-    // 2. Alpha（覆盖或新建）
-    dst[newAlphaSample] = alpha.data[i];
-
-    // 3. 拷贝旧 Extra（跳过旧 Alpha）
-    int dstIdx = colorChannels + 1;
-    int srcIdx = colorChannels;
-
-    for (size_t e = 0; e < meta.extraSamples.size(); ++e) {
-      if (hasAlpha && static_cast<int>(e) == alphaExtraIdx) {
-        srcIdx++; // 跳过旧 Alpha
-        continue;
-      }
-      dst[dstIdx++] = src[srcIdx++];
+  const int width = static_cast<int>(meta.width);
+
+  PixelBuffer newBuffer(pixelCount * newSpp); // 每行都由交错内核整行写满
+  const PixelView dst(newBuffer.data(), width, static_cast<int>(meta.height),
+                      static_cast<size_t>(newSpp) * width, newSpp);
+
+  const KernelStage<InterleaveRowFn> &stage = interleaveKernels();
+  const auto k = stage.resolve();
+  const size_t dstRowBytes = dst.rowBytes();
+  std::vector<uint8_t> ref(k.verify ? dstRowBytes : 0);
+
+  std::vector<const uint8_t *> extraRow(extras.size());
+  std::vector<uint8_t> alphaBuf(width);
+  for (uint32_t y = 0; y < meta.height; ++y) {
+    for (size_t i = 0; i < extras.size(); ++i)
+      extraRow[i] = extras[i].ptr<uint8_t>(y);
+
+    const uint8_t *srcRow = src.row(static_cast<int>(y));
+    const uint8_t *alpha = alphaRow(static_cast<int>(y), alphaBuf.data());
+    uint8_t *dstRow = dst.row(static_cast<int>(y));
+    k.fn(srcRow, oldSpp, colorChannels, alphaExtraIdx, alpha, extraRow.data(),
+         extraCount, dstRow, width);
+    if (k.verify && KernelRegistry::getInstance().verifyRow(y)) {
+      k.reference(srcRow, oldSpp, colorChannels, alphaExtraIdx, alpha,
+                  extraRow.data(), extraCount, ref.data(), width);
+      stage.check(k, static_cast<int>(y), dstRow, ref.data(), dstRowBytes);
     }
-
-    // 4. 新增两个通道
-    dst[dstIdx++] = extra1.data[i];
-    dst[dstIdx++] = extra2.data[i];
-
-    src += oldSpp;
-    dst += newSpp;
   }
 
   // ---------------- 更新 meta / raw ----------------
   meta.extraSamples = std::move(newExtraSamples);
   meta.samplesPerPixel = static_cast<uint16_t>(newSpp);
+  raw.bytesPerRow = static_cast<uint32_t>(dst.bytesPerRow);
   raw.buffer = std::move(newBuffer);
 
   return 0;
@@ -305,18 +363,38 @@ int tiffProcess::loadTiff(std::string_view path, cv::Mat &outRgb) {
 
 int tiffProcess::writeTiff(std::string_view path, const TiffImage &image,
                            const PsTemplate &ps) {
+  // safety check
+  if (!ps.ps34377.empty() &&
+      (image.meta.samplesPerPixel != ps.spp ||
+       image.meta.extraSamples.size() != ps.extra)) {
+    return -10; // template mismatch
+  }
+  return writeTiff(path, image, ps.ps34377);
+}
 
-  const TiffMeta &meta = image.meta;
-  const TiffRawData &raw = image.raw;
-
-  if (raw.buffer.empty())
+int tiffProcess::writeTiff(std::string_view path, const TiffImage &image,
+                           const std::vector<uint8_t> &ps34377) {
+  if (image.raw.buffer.empty())
     return -1;
 
-  TIFF *tif = TIFFOpen(path.data(), "w");
+  TIFF *tif = TIFFOpen(std::string(path).c_str(), "w");
 
   if (!tif)
     return -2;
 
+  int res = writeTiffDirectory(tif, image, ps34377);
+  TIFFClose(tif);
+  return res;
+}
+
+int tiffProcess::writeTiffDirectory(TIFF *tif, const TiffImage &image,
+                                    const std::vector<uint8_t> &ps34377) {
+  const TiffMeta &meta = image.meta;
+  const TiffRawData &raw = image.raw;
+
+  if (raw.buffer.empty())
+    return -1;
+
   // ---- Basic ----
   TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, meta.width);
   TIFFSetField(tif, TIFFTAG_IMAGELENGTH, meta.height);
@@ -345,18 +423,16 @@ int tiffProcess::writeTiff(std::string_view path, const TiffImage &image,
                  meta.extraSamples.data());
   }
 
-  // Photoshop template (Spot)
-  if (!ps.ps34377.empty()) {
-
-    // safety check
-    if (meta.samplesPerPixel != ps.spp ||
-        meta.extraSamples.size() != ps.extra) {
-      TIFFClose(tif);
-      return -10; // template mismatch
-    }
+  // ICC 配置文件原样保留
+  if (!meta.iccProfile.empty()) {
+    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32)meta.iccProfile.size(),
+                 meta.iccProfile.data());
+  }
 
-    TIFFSetField(tif, TIFFTAG_PHOTOSHOP, (uint32)ps.ps34377.size(),
-                 ps.ps34377.data());
+  // Photoshop 资源（通道名 / 专色）
+  if (!ps34377.empty()) {
+    TIFFSetField(tif, TIFFTAG_PHOTOSHOP, (uint32)ps34377.size(),
+                 ps34377.data());
   }
   const tsize_t sl = TIFFScanlineSize(tif);
   const size_t expectedRow =
@@ -367,73 +443,65 @@ int tiffProcess::writeTiff(std::string_view path, const TiffImage &image,
   fflush(stdout);
 
   // ---- Write pixels ----
-  const tsize_t lineBytes = TIFFScanlineSize(tif);
-  const uint8_t *buffer = raw.buffer.data();
+  return writeScanlines(tif, image.view());
+}
 
-  for (uint32_t row = 0; row < meta.height; ++row) {
-    if (TIFFWriteScanline(tif, (void *)(buffer + row * lineBytes), row, 0) <
-        0) {
-      TIFFClose(tif);
-      return -3;
+int tiffProcess::writeScanlines(TIFF *tif, const ConstPixelView &pixels) {
+  if (pixels.empty())
+    return -1;
+  // 视图一行的有效字节须与文件行一致（行填充不写出）
+  if (static_cast<size_t>(TIFFScanlineSize(tif)) != pixels.rowBytes())
+    return -4;
+
+  for (int p = 0; p < pixels.planes; ++p) {
+    for (int row = 0; row < pixels.height; ++row) {
+      if (TIFFWriteScanline(tif, const_cast<uint8_t *>(pixels.row(row, p)),
+                            static_cast<uint32_t>(row),
+                            static_cast<uint16_t>(p)) < 0) {
+        return -3;
+      }
     }
   }
 
-  TIFFClose(tif);
   return 0;
 }
 
 int tiffProcess::calcBlackness(const cv::Mat &rgb, BlacknessMethod method,
-                               cv::Mat &blackness) {
+                               cv::Mat &blackness, BlacknessHistogram *hist) {
   if (rgb.empty() || rgb.type() != CV_8UC3)
     return -1;
+  if (method != BlacknessMethod::GRAY &&
+      method != BlacknessMethod::DARK_NEUTRAL &&
+      method != BlacknessMethod::MAX_CHANNEL)
+    return -2;
 
   blackness.create(rgb.size(), CV_8UC1);
-
-  for (int y = 0; y < rgb.rows; ++y) {
-    const cv::Vec3b *src = rgb.ptr<cv::Vec3b>(y);
-    uchar *dst = blackness.ptr<uchar>(y);
-
-    for (int x = 0; x < rgb.cols; ++x) {
-      uchar R = src[x][0];
-      uchar G = src[x][1];
-      uchar B = src[x][2];
-
-      uchar value = 0;
-
-      switch (method) {
-      case BlacknessMethod::GRAY: {
-        //
-        value = static_cast<uchar>(0.299f * R + 0.587f * G + 0.114f * B);
-        break;
-      }
-      case BlacknessMethod::DARK_NEUTRAL: {
-        //暗度
-        float brightness = (R + G + B) / (3.0f * 255.0f);
-        float dark = 1.0f - brightness;
-
-        //中性色
-        uchar maxv = std::max({R, G, B});
-        uchar minv = std::min({R, G, B});
-        float chroma = (maxv - minv) / 255.0f;
-        float neutral = 1.0f - chroma;
-
-        float b = dark * neutral;
-        value = static_cast<uchar>(std::clamp(b, 0.0f, 1.0f) * 255.0f);
-        break;
+  if (hist)
+    hist->clear();
+  std::mutex histMutex;
+
+  // 按行带并行；直方图每个行带单独统计，结束时合并
+  const KernelStage<BlacknessRowFn> &stage = blacknessKernels();
+  const auto k = stage.resolve();
+  parallelFor(cv::Range(0, rgb.rows), [&](const cv::Range &range) {
+    BlacknessHistogram local;
+    std::vector<uint8_t> ref(k.verify ? rgb.cols : 0);
+    for (int y = range.start; y < range.end; ++y) {
+      const uint8_t *src = rgb.ptr<uint8_t>(y);
+      uchar *dst = blackness.ptr<uchar>(y);
+      k.fn(src, dst, rgb.cols, method);
+      if (k.verify && KernelRegistry::getInstance().verifyRow(y)) {
+        k.reference(src, ref.data(), rgb.cols, method);
+        stage.check(k, y, dst, ref.data(), ref.size());
       }
-      case BlacknessMethod::MAX_CHANNEL: {
-        // 近似 K = 1 - max(R,G,B)
-        uchar maxv = std::max({R, G, B});
-        value = 255 - maxv;
-        break;
-      }
-      default:
-        return -2;
-      }
-
-      dst[x] = value;
+      for (int x = 0; x < rgb.cols; ++x)
+        ++local.bins[dst[x]];
     }
-  }
+    if (hist) {
+      std::lock_guard<std::mutex> lock(histMutex);
+      hist->merge(local);
+    }
+  });
 
   return 0;
 }
@@ -446,31 +514,56 @@ int tiffProcess::removeBlack(const cv::Mat &blackness, int thresh,
   return 0;
 }
 
+int tiffProcess::removeBlack(const cv::Mat &blackness, int thresh,
+                             BitMask &output, cv::Point origin) {
+  if (blackness.empty() || blackness.type() != CV_8UC1)
+    return -1;
+  // 与 THRESH_BINARY_INV 一致：黑度 <= thresh 的像素保留（置 1）
+  return thresholdToBits(blackness, thresh, output, origin) == 0 ? 0 : -2;
+}
+
+int tiffProcess::removeBlack(const cv::Mat &blackness, int thresh,
+                             RunMask &output, cv::Point origin) {
+  if (blackness.empty() || blackness.type() != CV_8UC1)
+    return -1;
+  return thresholdToRuns(blackness, thresh, output, origin) == 0 ? 0 : -2;
+}
+
 int tiffProcess::removeSmallComponents(const cv::Mat &input, int minArea,
                                        cv::Mat &output) {
   if (input.empty() || input.type() != CV_8UC1)
     return -1;
 
-  cv::Mat labels, stats, centroids;
-
-  cv::connectedComponentsWithStats(input, labels, stats, centroids,
-                                   8, // 8连通
-                                   CV_32S);
+  // 按行程标记（8 连通），标签按行程存，不生成整幅标签图
+  RunMask runs;
+  int res = encodeRuns(input, runs);
+  if (res == 0)
+    res = filterRunsByArea(runs, minArea, runs);
+  if (res != 0)
+    return res;
 
-  output = cv::Mat::zeros(labels.size(), CV_8UC1);
+  // 尺寸一致时沿用 output 原缓冲（可能是调用方缓冲）
+  return decodeRuns(runs, output);
+}
 
-  for (int y = 0; y < labels.rows; ++y) {
-    const int *labelRow = labels.ptr<int>(y);
-    uchar *outRow = output.ptr<uchar>(y);
+int tiffProcess::removeSmallComponents(const BitMask &input, int minArea,
+                                       BitMask &output) {
+  if (input.empty())
+    return -1;
+  RunMask runs;
+  int res = encodeRuns(input, runs);
+  if (res == 0)
+    res = filterRunsByArea(runs, minArea, runs);
+  if (res != 0)
+    return res;
+  return decodeRuns(runs, output);
+}
 
-    for (int x = 0; x < labels.cols; ++x) {
-      int lbl = labelRow[x];
-      if (lbl > 0 && stats.at<int>(lbl, cv::CC_STAT_AREA) >= minArea) {
-        outRow[x] = 255;
-      }
-    }
-  }
-  return 0;
+int tiffProcess::removeSmallComponents(const RunMask &input, int minArea,
+                                       RunMask &output) {
+  if (input.empty())
+    return -1;
+  return filterRunsByArea(input, minArea, output);
 }
 
 int tiffProcess::generateWhiteCompensation(const cv::Mat &blackness,
@@ -522,37 +615,260 @@ int tiffProcess::generateWhiteCompensation(const cv::Mat &blackness,
   return 0;
 }
 
-int tiffProcess::genernateTiffFile(std::string_view path,
-                                   BlacknessMethod method, int blacknessThresh,
-                                   int noiseThresh, const PsTemplate &ps) {
-  cv::Mat rgbImg;
-  int res;
+int tiffProcess::generateWhiteCompensation(const cv::Mat &blackness,
+                                           const BitMask &transparent,
+                                           cv::Point origin, int thresh,
+                                           cv::Mat &white) {
+  // -------- 参数检查 --------
+  if (blackness.empty() || transparent.empty())
+    return -1;
+
+  if (blackness.type() != CV_8UC1)
+    return -2;
+
+  if (origin.x < 0 || origin.y < 0 ||
+      origin.x + blackness.cols > transparent.width() ||
+      origin.y + blackness.rows > transparent.height())
+    return -3;
+
+  if (thresh <= 0 || thresh > 255)
+    return -4;
+
+  white.create(blackness.size(), CV_8UC1);
+
+  parallelFor(cv::Range(0, blackness.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uchar *bptr = blackness.ptr<uchar>(y);
+      const uint64_t *tbits = transparent.row(origin.y + y);
+      uchar *wptr = white.ptr<uchar>(y);
+
+      for (int x = 0; x < blackness.cols; ++x) {
+        const int tx = origin.x + x;
+        const int b = bptr[x];
+        // 透明像素或黑度高于阈值：不补白
+        if (!((tbits[tx >> 6] >> (tx & 63)) & 1u) || b >= thresh) {
+          wptr[x] = 0;
+          continue;
+        }
+        int val = (thresh - b) * 255 / thresh;
+        wptr[x] = static_cast<uchar>(std::clamp(val, 0, 255));
+      }
+    }
+  });
+  return 0;
+}
+
+int tiffProcess::generateWhiteCompensation(const cv::Mat &blackness,
+                                           const RunMask &transparent,
+                                           cv::Point origin, int thresh,
+                                           cv::Mat &white) {
+  // -------- 参数检查 --------
+  if (blackness.empty() || transparent.empty())
+    return -1;
+
+  if (blackness.type() != CV_8UC1)
+    return -2;
+
+  if (origin.x < 0 || origin.y < 0 ||
+      origin.x + blackness.cols > transparent.width() ||
+      origin.y + blackness.rows > transparent.height())
+    return -3;
+
+  if (thresh <= 0 || thresh > 255)
+    return -4;
+
+  white.create(blackness.size(), CV_8UC1);
+  white.setTo(0);
+
+  // 只有行程内（不透明）的像素需要补白
+  parallelFor(cv::Range(0, blackness.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uchar *bptr = blackness.ptr<uchar>(y);
+      uchar *wptr = white.ptr<uchar>(y);
+      const BitRun *runs = transparent.row(origin.y + y);
+      const size_t count = transparent.runCount(origin.y + y);
+
+      for (size_t i = 0; i < count; ++i) {
+        const int x0 = std::max(runs[i].x0 - origin.x, 0);
+        const int x1 = std::min(runs[i].x1 - origin.x, blackness.cols);
+        for (int x = x0; x < x1; ++x) {
+          const int b = bptr[x];
+          if (b >= thresh)
+            continue;
+          int val = (thresh - b) * 255 / thresh;
+          wptr[x] = static_cast<uchar>(std::clamp(val, 0, 255));
+        }
+      }
+    }
+  });
+  return 0;
+}
 
-  res = generateRgbMat(this->_tiff, rgbImg);
+int tiffProcess::offsetWhiteEdge(const cv::Mat &transparent, int offset,
+                                 cv::Mat &white) {
+  if (offset == 0)
+    return 0;
+  if (transparent.empty() || white.empty())
+    return -1;
+  if (transparent.type() != CV_8UC1 || white.type() != CV_8UC1)
+    return -2;
+  if (transparent.size() != white.size())
+    return -3;
+
+  const int64_t r2 = static_cast<int64_t>(offset) * offset;
+  cv::Mat dist2;
+
+  if (offset < 0) {
+    // 到最近透明像素的距离
+    int res = squaredDistanceTransform(transparent, dist2);
+    if (res != 0)
+      return res;
+    parallelFor(cv::Range(0, white.rows), [&](const cv::Range &r) {
+      for (int y = r.start; y < r.end; ++y) {
+        const int *d = dist2.ptr<int>(y);
+        uchar *w = white.ptr<uchar>(y);
+        for (int x = 0; x < white.cols; ++x)
+          if (d[x] <= r2)
+            w[x] = 0;
+      }
+    });
+    return 0;
+  }
+
+  // 到最近不透明像素的距离及其位置
+  cv::Mat inv, nearest;
+  cv::threshold(transparent, inv, 0, 255, cv::THRESH_BINARY_INV);
+  int res = squaredDistanceTransform(inv, dist2, &nearest);
   if (res != 0)
     return res;
-  cv::Mat blackness;
-  res = calcBlackness(rgbImg, method, blackness);
+  parallelFor(cv::Range(0, white.rows), [&](const cv::Range &r) {
+    for (int y = r.start; y < r.end; ++y) {
+      const uchar *t = transparent.ptr<uchar>(y);
+      const int *d = dist2.ptr<int>(y);
+      const int *n = nearest.ptr<int>(y);
+      uchar *w = white.ptr<uchar>(y);
+      for (int x = 0; x < white.cols; ++x) {
+        if (t[x] || d[x] > r2 || n[x] < 0)
+          continue;
+        // 最近像素是不透明的，外扩不会改写它，原地读取安全
+        w[x] = white.ptr<uchar>(n[x] / white.cols)[n[x] % white.cols];
+      }
+    }
+  });
+  return 0;
+}
+
+// 按输出 ExtraSamples 顺序描述各通道：透明度 | 原有 Extra | 白墨
+static std::vector<PsChannelDesc>
+describeExtraChannels(const TiffMeta &meta,
+                      const std::vector<std::string> &appended) {
+  std::vector<PsChannelDesc> channels;
+  const size_t extra = meta.extraSamples.size();
+  const size_t kept = extra - std::min(extra, appended.size());
+
+  for (size_t i = 0; i < kept; ++i) {
+    if (i == 0 && isAlphaSample(meta.extraSamples[i]))
+      channels.push_back(PsChannelDesc::alpha("Transparency"));
+    else
+      channels.push_back(PsChannelDesc::alpha("Alpha " + std::to_string(i)));
+  }
+  for (const std::string &name : appended)
+    channels.push_back(PsChannelDesc::spot(name, 0xFFFF, 0xFFFF, 0xFFFF));
+  return channels;
+}
+
+int tiffProcess::processImage(TiffImage &image, BlacknessMethod method,
+                              int blacknessThresh, int noiseThresh,
+                              int whiteOffset) {
+  const TiffMeta &meta = image.meta;
+  const cv::Size size(static_cast<int>(meta.width),
+                      static_cast<int>(meta.height));
+  int res;
+
+  // 内容区域：各阶段只算区域内，四周均匀边距只算 (0,0) 一个像素再填常数
+  cv::Rect roi = findContentBounds(image.view());
+  if (roi.empty())
+    roi = cv::Rect(0, 0, 1, 1); // 整幅均匀
+  const bool hasMargin = roi.size() != size;
+
+  cv::Mat rgbImg;
+  res = generateRgbMat(image, rgbImg, roi);
   if (res != 0)
     return res;
-
   if (rgbImg.empty())
     return -1;
-  cv::Mat noBlack;
-  res = removeBlack(blackness, blacknessThresh, noBlack);
+
+  cv::Mat blackness(size, CV_8UC1);
+  cv::Mat blackRoi = blackness(roi);
+  res = calcBlackness(rgbImg, method, blackRoi);
+  if (res != 0)
+    return res;
+  if (taskCancelled())
+    return kTaskCancelled;
+
+  // 阈值化直接得到行程编码蒙版，只在交错写入输出通道时解码
+  RunMask noBlack(size.width, size.height);
+  res = removeBlack(blackRoi, blacknessThresh, noBlack, roi.tl());
   if (res != 0)
     return res;
-  cv::Mat noNoise;
+
+  // 边距像素的黑度 / 蒙版 / 补白
+  cv::Mat marginBlack, marginMask, marginWhite;
+  if (hasMargin) {
+    cv::Mat px;
+    res = generateRgbMat(image, px, cv::Rect(0, 0, 1, 1));
+    if (res == 0)
+      res = calcBlackness(px, method, marginBlack);
+    if (res == 0)
+      res = removeBlack(marginBlack, blacknessThresh, marginMask);
+    if (res == 0)
+      res = generateWhiteCompensation(marginBlack, marginMask, blacknessThresh,
+                                      marginWhite);
+    if (res != 0)
+      return res;
+    fillOutside(blackness, roi, marginBlack.at<uchar>(0, 0));
+    fillOutside(noBlack, roi, marginMask.at<uchar>(0, 0) != 0);
+  }
+
+  // 按行程标记，均匀边距每行只是一两个行程，不必再裁区域
+  RunMask noNoise;
   res = removeSmallComponents(noBlack, noiseThresh, noNoise);
   if (res != 0)
     return res;
-  cv::Mat whiteCompensation;
-  res = generateWhiteCompensation(blackness, noNoise, blacknessThresh,
-                                  whiteCompensation);
+  if (taskCancelled())
+    return kTaskCancelled;
+
+  cv::Mat whiteCompensation(size, CV_8UC1);
+  cv::Mat whiteRoi = whiteCompensation(roi);
+  res = generateWhiteCompensation(blackRoi, noNoise, roi.tl(), blacknessThresh,
+                                  whiteRoi);
   if (res != 0)
     return res;
+  if (hasMargin)
+    fillOutside(whiteCompensation, roi, marginWhite.at<uchar>(0, 0));
+
+  // 收缩 / 外扩只影响内容区外 |offset| 以内
+  if (whiteOffset != 0) {
+    const cv::Rect pad = padRect(roi, std::abs(whiteOffset), size);
+    cv::Mat maskPad;
+    res = decodeRuns(noNoise, maskPad, pad);
+    if (res != 0)
+      return res;
+    cv::Mat whitePad = whiteCompensation(pad);
+    res = offsetWhiteEdge(maskPad, whiteOffset, whitePad);
+    if (res != 0)
+      return res;
+  }
+
   cv::Mat whiteInk = 255 - whiteCompensation;
-  res = updateExtraChannels(this->_tiff, noNoise, whiteInk, whiteInk.clone());
+  return updateExtraChannels(image, noNoise,
+                             std::vector<cv::Mat>{whiteInk, whiteInk.clone()});
+}
+
+int tiffProcess::genernateTiffFile(std::string_view path,
+                                   BlacknessMethod method, int blacknessThresh,
+                                   int noiseThresh, const PsTemplate &ps) {
+  int res = processImage(this->_tiff, method, blacknessThresh, noiseThresh);
   if (res != 0)
     return res;
 
@@ -562,3 +878,188 @@ int tiffProcess::genernateTiffFile(std::string_view path,
     return res;
   return 0;
 }
+
+// 有指定模板时用模板，通道布局不一致时按输出重新生成其中的通道资源；
+// 否则按布局从注册表选模板，无匹配时直接生成通道资源
+static int selectPsResources(const TiffMeta &meta, const PsTemplate *ps,
+                             const PsTemplateRegistry &templates,
+                             std::vector<uint8_t> &ps34377) {
+  if (ps) {
+    ps34377 = ps->ps34377;
+    if (!ps34377.empty() && (meta.samplesPerPixel != ps->spp ||
+                             meta.extraSamples.size() != ps->extra)) {
+      DEBUG << "[PsTemplate] layout mismatch, regenerate channels for"
+            << ps->source.c_str();
+      // 副本与模板字节相同，索引可以直接沿用
+      PsResourceIndex index = ps->index;
+      applyPsChannelResources(ps34377, index,
+                              describeExtraChannels(meta, {"W1", "W2"}));
+    }
+    return 0;
+  }
+  if (const PsTemplate *found = templates.find(meta)) {
+    DEBUG << "[PsTemplate] use" << found->source.c_str();
+    ps34377 = found->ps34377;
+  } else {
+    ps34377 = synthesizePsChannelResources(
+        describeExtraChannels(meta, {"W1", "W2"}));
+  }
+  return 0;
+}
+
+int tiffProcess::genernateTiffFile(std::string_view path,
+                                   BlacknessMethod method, int blacknessThresh,
+                                   int noiseThresh,
+                                   const PsTemplateRegistry &templates,
+                                   int whiteOffset) {
+  int res = processImage(this->_tiff, method, blacknessThresh, noiseThresh,
+                         whiteOffset);
+  if (res != 0)
+    return res;
+
+  std::vector<uint8_t> ps34377;
+  res = selectPsResources(this->_tiff.meta, nullptr, templates, ps34377);
+  if (res != 0)
+    return res;
+  res = writeTiff(path, this->_tiff, ps34377);
+  if (res != 0)
+    return res;
+  return 0;
+}
+
+int tiffProcess::pageCount(std::string_view path) {
+  TIFF *tif = TIFFOpen(std::string(path).c_str(), "r");
+  if (!tif)
+    return -1;
+  int count = TIFFNumberOfDirectories(tif);
+  TIFFClose(tif);
+  return count;
+}
+
+int tiffProcess::genernateMultiPageTiff(
+    std::string_view srcPath, std::string_view dstPath,
+    const std::vector<TiffPageParams> &pageParams,
+    const TiffPageParams &defaults, const PsTemplateRegistry &templates,
+    int workers, TiffStageCodes *stages) {
+  const std::string src(srcPath);
+  const int pages = pageCount(src);
+  if (pages <= 0) {
+    if (stages)
+      stages->read = -1;
+    return -1;
+  }
+
+  TIFF *out = TIFFOpen(std::string(dstPath).c_str(), "w");
+  if (!out) {
+    if (stages)
+      stages->write = -2;
+    return -2;
+  }
+
+  if (workers <= 0)
+    workers = TaskPool::getInstance().workers();
+  workers = std::clamp(workers, 1, pages);
+
+  // 页号按递增顺序领取，较小页号总是已在处理中，按序等待不会死锁；
+  // 每个工作线程最多持有一页，内存上限为 workers 页
+  std::atomic<int> nextPage{0};
+  std::mutex writeMutex;
+  std::condition_variable writeCv;
+  int writeTurn = 0;
+  int firstError = 0;
+
+  auto worker = [&]() {
+    const TaskGroup *group = TaskGroup::current();
+    TIFF *in = TIFFOpen(src.c_str(), "r");
+    for (;;) {
+      const int page = nextPage.fetch_add(1);
+      if (page >= pages)
+        break;
+
+      const TiffPageParams &params =
+          page < static_cast<int>(pageParams.size()) ? pageParams[page]
+                                                     : defaults;
+      TiffImage image;
+      std::vector<uint8_t> ps34377;
+      int res = in ? 0 : -1;
+      int TiffStageCodes::*stage = &TiffStageCodes::read; // 当前阶段
+      // 处理中的异常（如内存不足）记为本页失败，仍须推进写出顺序，
+      // 否则后面的页会一直等这一页
+      try {
+        if (res == 0 && !TIFFSetDirectory(in, static_cast<tdir_t>(page)))
+          res = -1;
+        if (res == 0)
+          res = readTiffDirectory(in, image);
+        if (res == 0) {
+          stage = &TiffStageCodes::process;
+          res = processImage(image, params.method, params.blacknessThresh,
+                             params.noiseThresh, params.whiteOffset);
+        }
+        if (res == 0 && params.compression >= 0)
+          image.meta.compression = static_cast<uint16_t>(params.compression);
+        if (res == 0) {
+          stage = &TiffStageCodes::resources;
+          res = selectPsResources(image.meta, params.ps, templates, ps34377);
+        }
+      } catch (const std::exception &e) {
+        DEBUG << "[MultiPage] page" << page << "exception:" << e.what();
+        res = -6;
+      } catch (...) {
+        res = -6;
+      }
+
+      std::unique_lock<std::mutex> lock(writeMutex);
+      // 取消不会通知条件变量，定时醒来检查
+      auto ready = [&] {
+        return writeTurn == page || firstError != 0 ||
+               (group && group->cancelled());
+      };
+      while (!ready())
+        writeCv.wait_for(lock, std::chrono::milliseconds(50));
+      if (writeTurn != page && firstError == 0 && res == 0)
+        res = kTaskCancelled;
+      if (firstError == 0 && res == 0) {
+        if (pages > 1) {
+          TIFFSetField(out, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+          TIFFSetField(out, TIFFTAG_PAGENUMBER, static_cast<uint16_t>(page),
+                       static_cast<uint16_t>(pages));
+        }
+        stage = &TiffStageCodes::write;
+        try {
+          res = writeTiffDirectory(out, image, ps34377);
+          if (res == 0 && !TIFFWriteDirectory(out))
+            res = -4;
+        } catch (...) {
+          res = -6;
+        }
+      }
+      if (res != 0 && firstError == 0) {
+        DEBUG << "[MultiPage] page" << page << "failed:" << res;
+        firstError = res;
+      }
+      // 取消不算某个阶段失败
+      if (stages && res != 0 && res != kTaskCancelled) {
+        if (stages->*stage == 0)
+          stages->*stage = res;
+        if (stages->failedPage < 0)
+          stages->failedPage = page;
+      }
+      ++writeTurn;
+      lock.unlock();
+      writeCv.notify_all();
+    }
+    if (in)
+      TIFFClose(in);
+  };
+
+  // 各页作为线程池任务运行，页内各阶段的行带任务与之共用同一批线程
+  TaskGroup group;
+  for (int i = 0; i < workers; ++i)
+    group.run(worker);
+  const int res = group.wait();
+  if (res != 0 && firstError == 0)
+    firstError = res;
+
+  TIFFClose(out);
+  return firstError;
+}
@@ -2,7 +2,14 @@
 #define TIFFPROCESS_H
 #include <opencv2/opencv.hpp>
 
+#include <functional>
+
+#include "bitmask.h"
+#include "histogram.h"
+#include "pixelview.h"
+#include "pschannels.h"
 #include "pstemplate.h"
+#include "runmask.h"
 #include "tiffimage.h"
 enum class BlacknessMethod {
   GRAY = 0,     // 纯灰度（调试 / 对照用）
@@ -10,41 +17,166 @@ enum class BlacknessMethod {
   MAX_CHANNEL   // 近似 K = 1 - max(R,G,B)
 };
 
+// 多页处理时单页的参数
+struct TiffPageParams {
+  BlacknessMethod method = BlacknessMethod::DARK_NEUTRAL;
+  int blacknessThresh = 235;
+  int noiseThresh = 0;
+  int whiteOffset = 0;            // 白墨收缩 / 外扩（像素）
+  int compression = -1;           // 输出压缩（COMPRESSION_*），< 0 沿用源文件
+  const PsTemplate *ps = nullptr; // 指定模板；为空时按布局从注册表选
+};
+
+// 多页处理各阶段的返回码：每个阶段记录最先在该阶段失败的页的返回码，成功为 0
+struct TiffStageCodes {
+  int read = 0;        // 读取页（TIFFSetDirectory / readTiffDirectory）
+  int process = 0;     // 黑度 -> 去黑 -> 去杂点 -> 补白 -> 追加通道
+  int resources = 0;   // 选模板、生成 34377 资源
+  int write = 0;       // 写出 IFD
+  int failedPage = -1; // 第一个失败的页
+};
+
 class tiffProcess {
 public:
   static tiffProcess &getInstance();
 
+  // 配置 CMYK / RGB 的 ICC 配置文件（TIFF 未嵌入时使用），空路径表示不用
+  int setColorProfiles(const std::string &cmykProfilePath,
+                       const std::string &rgbProfilePath = {});
+
   //加载tiff
   int loadTiff(std::string_view path, cv::Mat &outRgb);
 
+  // 交错视图（可带行填充、可为 ROI / 行带）-> BGR，输出与视图同尺寸；
+  // CMYK 有配置文件时走 ICC
+  int convertToBgr(const ConstPixelView &src, uint16_t photometric,
+                   const std::vector<uint8_t> &iccProfile, cv::Mat &outRgb);
+
+  // 单行输出：颜色 | Alpha | 旧 Extra（跳过 alphaIdx） | extras
+  static void appendChannelsRow(const uint8_t *src, int srcSpp,
+                                int colorChannels, int alphaIdx,
+                                const uint8_t *alpha,
+                                const uint8_t *const *extras, int extraCount,
+                                uint8_t *dst, int width);
+
+  // hist 非空时顺带统计黑度直方图
   int calcBlackness(const cv::Mat &rgb, BlacknessMethod method,
-                    cv::Mat &blackness);
+                    cv::Mat &blackness, BlacknessHistogram *hist = nullptr);
 
   int removeBlack(const cv::Mat &blackness, int thresh, cv::Mat &output);
 
+  // 按位输出，写到 output 中以 origin 为左上角的区域（output 为空时按输入尺寸创建）
+  int removeBlack(const cv::Mat &blackness, int thresh, BitMask &output,
+                  cv::Point origin = cv::Point());
+
+  // 行程编码输出，写到 output 中以 origin 为左上角的区域
+  int removeBlack(const cv::Mat &blackness, int thresh, RunMask &output,
+                  cv::Point origin = cv::Point());
+
   int removeSmallComponents(const cv::Mat &input, int minArea, cv::Mat &output);
 
+  // 以下均按行程做 8 连通标记（见 runmask.h），不生成整幅标签图
+  int removeSmallComponents(const BitMask &input, int minArea,
+                            BitMask &output);
+  int removeSmallComponents(const RunMask &input, int minArea,
+                            RunMask &output);
+
   int generateWhiteCompensation(const cv::Mat &blackness,
                                 const cv::Mat &transparent, int thresh,
                                 cv::Mat &white);
 
+  // blackness 对应 transparent 中以 origin 为左上角的区域
+  int generateWhiteCompensation(const cv::Mat &blackness,
+                                const BitMask &transparent, cv::Point origin,
+                                int thresh, cv::Mat &white);
+  int generateWhiteCompensation(const cv::Mat &blackness,
+                                const RunMask &transparent, cv::Point origin,
+                                int thresh, cv::Mat &white);
+
+  // 白墨收缩（offset < 0，choke）/ 外扩（offset > 0，spread），单位像素
+  // 收缩：离透明区不超过 |offset| 的像素不补白
+  // 外扩：离不透明区不超过 offset 的透明像素取最近不透明像素的补白值
+  int offsetWhiteEdge(const cv::Mat &transparent, int offset, cv::Mat &white);
+
   int genernateTiffFile(std::string_view path, BlacknessMethod method,
                         int blacknessThresh, int noiseThresh,
                         const PsTemplate &ps);
 
+  // 按输出通道布局从注册表中选模板，无匹配时直接生成通道资源
+  int genernateTiffFile(std::string_view path, BlacknessMethod method,
+                        int blacknessThresh, int noiseThresh,
+                        const PsTemplateRegistry &templates,
+                        int whiteOffset = 0);
+
+  // 页数（IFD 数），打开失败返回 -1
+  static int pageCount(std::string_view path);
+
+  // 多页：各页作为线程池任务并行读取/处理（workers 为同时处理的页数，
+  // <= 0 取线程池线程数），按原顺序写出各 IFD；pageParams[i] 为第 i 页参数，
+  // 不足的页用 defaults。外层任务被取消时返回 kTaskCancelled，
+  // 某页处理时抛出异常返回 -6。stages 非空时填各阶段的返回码
+  int genernateMultiPageTiff(std::string_view srcPath, std::string_view dstPath,
+                             const std::vector<TiffPageParams> &pageParams,
+                             const TiffPageParams &defaults,
+                             const PsTemplateRegistry &templates,
+                             int workers = 0,
+                             TiffStageCodes *stages = nullptr);
+
+  // 当前配置的 ICC 配置文件内容（未配置为空）
+  const std::vector<uint8_t> &cmykProfile() const { return _cmykProfile; }
+  const std::vector<uint8_t> &rgbProfile() const { return _rgbProfile; }
+
+  // 最近一次 loadTiff 的源文件
+  const std::string &sourcePath() const { return _sourcePath; }
+
 private:
+  // 黑度 -> 去黑 -> 去杂点 -> 补白 -> 追加通道；所在任务被取消时返回 kTaskCancelled
+  int processImage(TiffImage &image, BlacknessMethod method,
+                   int blacknessThresh, int noiseThresh, int whiteOffset = 0);
+
   int readTiffImage(std::string_view path, TiffImage &image);
 
+  // 读取当前 IFD
+  int readTiffDirectory(TIFF *tif, TiffImage &image);
+
   int writeTiff(std::string_view path, const TiffImage &image,
                 const PsTemplate &ps);
 
-  int generateRgbMat(const TiffImage &image, cv::Mat &outRgb);
+  // 不做模板校验，直接写入给定的 34377 数据（可为空）
+  int writeTiff(std::string_view path, const TiffImage &image,
+                const std::vector<uint8_t> &ps34377);
+
+  // 写入当前 IFD 的标签与像素，不关闭文件（多页时由调用方 TIFFWriteDirectory）
+  int writeTiffDirectory(TIFF *tif, const TiffImage &image,
+                         const std::vector<uint8_t> &ps34377);
+
+  // 按视图逐行（分平面时逐平面）写像素，标签须已设置且与视图一致
+  static int writeScanlines(TIFF *tif, const ConstPixelView &pixels);
+
+  // roi 非空时只转换该区域
+  int generateRgbMat(const TiffImage &image, cv::Mat &outRgb,
+                     const cv::Rect &roi = {});
 
   int updateExtraChannels(TiffImage &image, const cv::Mat &alpha,
                           const cv::Mat &extra1, const cv::Mat &extra2);
 
+  // 写入 Alpha 并追加任意数量的新通道
+  int updateExtraChannels(TiffImage &image, const cv::Mat &alpha,
+                          const std::vector<cv::Mat> &extras);
+  int updateExtraChannels(TiffImage &image, const RunMask &alpha,
+                          const std::vector<cv::Mat> &extras);
+
+  // 第 y 行 Alpha（0/255），buf 为一行宽的临时缓冲，需要展开时写入并返回它
+  using AlphaRowFn = std::function<const uint8_t *(int y, uint8_t *buf)>;
+  int updateExtraChannels(TiffImage &image, cv::Size alphaSize,
+                          const AlphaRowFn &alphaRow,
+                          const std::vector<cv::Mat> &extras);
+
 protected:
   TiffImage _tiff;
+  std::vector<uint8_t> _cmykProfile;
+  std::vector<uint8_t> _rgbProfile;
+  std::string _sourcePath;
 
 private:
   tiffProcess() = default;
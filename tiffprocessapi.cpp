@@ -1,70 +1,384 @@
 #include "tiffprocessapi.h"
 
+#include "bitmask.h"
+#include "contentbounds.h"
+#include "morphology.h"
 #include "utils.h"
 
+// 组件树建树时约 12 B/像素，建好后常驻约 4 B/像素；超过此像素数（通常是
+// 全分辨率大图）不建树，去杂点用行程标记缓存
+constexpr int64_t kMaxTreePixels = int64_t(16) << 20;
+
+// 位运算圆盘每像素约 r / 16 次字运算，随半径增长；超过此半径改用
+// 与半径无关的距离变换（需展开成字节）
+constexpr int kMaxBitDiskRadius = 512;
+
 tiffProcessAPI &tiffProcessAPI::getInstance() {
   static tiffProcessAPI instance;
   return instance;
 }
 
-void tiffProcessAPI::setcvMatImage(const cv::Mat mat) { this->_origin = mat; }
+void tiffProcessAPI::setcvMatImage(const cv::Mat mat) {
+  this->_source = mat;
+  updatePreviewSource();
+}
+
+int tiffProcessAPI::setPreviewScale(int divisor) {
+  if (divisor != 1 && divisor != 2 && divisor != 4 && divisor != 8)
+    return -1;
+  if (divisor == _previewScale)
+    return 0;
+  _previewScale = divisor;
+  updatePreviewSource();
+  return 0;
+}
+
+void tiffProcessAPI::updatePreviewSource() {
+  const int d = _previewScale;
+  if (_source.empty() || d == 1 || _source.cols < d || _source.rows < d)
+    _origin = _source;
+  else
+    cv::resize(_source, _origin, cv::Size(_source.cols / d, _source.rows / d),
+               0, 0, cv::INTER_AREA);
+  _orgins.clear();
+  if (!_origin.empty())
+    cv::split(_origin, _orgins);
+
+  // 黑度 / 蒙版 / 历史都对应旧尺寸，作废
+  _blackness.release();
+  _blacknessTree.clear();
+  _treeTried = false;
+  _transparent = BitMask();
+  _processTransparent = BitMask();
+  _white.release();
+  _removeShowMat.release();
+  _blackThresh = -1;
+  _labelsValid = false;
+  _componentKeep.clear();
+  _history.clear();
+  _historySynced = false;
+}
+
+int tiffProcessAPI::toPreviewArea(int area) const {
+  const int d2 = _previewScale * _previewScale;
+  if (d2 == 1 || area <= 1)
+    return area;
+  return std::max(1, (area + d2 / 2) / d2);
+}
+
+int tiffProcessAPI::toPreviewLength(int length) const {
+  const int d = _previewScale;
+  const int n = (std::abs(length) + d / 2) / d;
+  return length < 0 ? -n : n;
+}
 
 int tiffProcessAPI::calBackness(BlacknessMethod type) {
-  int res = tiffProcess::getInstance().calcBlackness(_origin, type, _blackness);
+  if (_origin.empty())
+    return -1;
+  tiffProcess &proc = tiffProcess::getInstance();
+
+  // 只算内容区域，均匀边距取 (0,0) 像素的黑度
+  _bounds = findContentBounds(_origin);
+  if (_bounds.empty())
+    _bounds = cv::Rect(0, 0, 1, 1);
+
+  _blackness.create(_origin.size(), CV_8UC1);
+  cv::Mat roi = _blackness(_bounds);
+  int res = proc.calcBlackness(_origin(_bounds), type, roi, &_blacknessHist);
   if (res != 0)
     return res;
+
+  if (_bounds.size() != _origin.size()) {
+    cv::Mat px;
+    res = proc.calcBlackness(_origin(cv::Rect(0, 0, 1, 1)), type, px);
+    if (res != 0)
+      return res;
+    const uchar margin = px.at<uchar>(0, 0);
+    fillOutside(_blackness, _bounds, margin);
+    _blacknessHist.bins[margin] +=
+        static_cast<uint64_t>(_origin.total()) - _bounds.area();
+  }
+
+  // 黑度变了，之前的去黑蒙版、组件树和历史记录作废；树到第一次去杂点时再建
+  _blackThresh = -1;
+  _blacknessTree.clear();
+  _treeTried = false;
+  _history.clear();
+  _historySynced = false;
   return 0;
 }
 
+int tiffProcessAPI::autoBlacknessThresh(AutoThresholdMode mode,
+                                        double percentile) {
+  return autoThreshold(_blacknessHist, mode, percentile);
+}
+
+double tiffProcessAPI::transparentFraction(int thresh) const {
+  return _blacknessHist.transparentFraction(thresh);
+}
+
 int tiffProcessAPI::removeBlack(int thresh) {
-  _transparent = cv::Mat(this->_origin.size(), CV_8UC1);
-  int res =
-      tiffProcess::getInstance().removeBlack(_blackness, thresh, _transparent);
+  if (_blackness.empty())
+    return -1;
+  beginEdit();
+  _transparent.create(_origin.cols, _origin.rows);
+  int res = tiffProcess::getInstance().removeBlack(_blackness(_bounds), thresh,
+                                                   _transparent, _bounds.tl());
   if (res != 0)
     return res;
-  std::vector<cv::Mat> merge = this->_orgins;
-  merge.push_back(_transparent);
-  cv::merge(merge, _removeShowMat);
-  return 0;
+  fillOutside(_transparent, _bounds, _blackness.at<uchar>(0, 0) <= thresh);
+  _blackThresh = thresh;
+  _labelsValid = false;
+  _componentKeep.clear();
+  recordHistory(TRANSPARENT, false);
+  return updateShowMat(_transparent);
 }
 
 int tiffProcessAPI::removeSmall(int kernelSize) {
-  int size = kernelSize * 2 - 1;
+  if (_transparent.empty())
+    return -1;
+  // 结构元直径 2k-1，即半径 k-1（按原图像素，预览代理上按比例缩小）
+  const int radius = toPreviewLength(std::max(0, kernelSize - 1));
+  // 闭运算只改变内容区外 radius 以内的边距，结果依赖其外 2*radius 的输入
+  const cv::Rect out = padRect(_bounds, radius, _transparent.size());
+  const cv::Rect in = padRect(_bounds, 3 * radius, _transparent.size());
+
+  beginEdit();
+  _componentKeep.clear();
+  BitMask region, closed;
+  int res = copyBitRect(_transparent, in, region);
+  if (res == 0 && radius <= kMaxBitDiskRadius) {
+    // 按位运算，每个字一次处理 64 个像素
+    res = bitMorphology(region, closed, cv::MORPH_CLOSE, radius,
+                        MorphShape::DISK);
+  } else if (res == 0) {
+    // 大半径：距离变换取阈值，耗时与半径无关
+    cv::Mat bytes, closedBytes;
+    res = unpackBits(region, bytes);
+    if (res == 0)
+      res = fastMorphology(bytes, closedBytes, cv::MORPH_CLOSE, radius,
+                           MorphShape::DISK);
+    if (res == 0)
+      res = packBits(closedBytes, closed);
+  }
+  if (res != 0)
+    return res;
 
-  cv::Mat kernel =
-      cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size));
+  _processTransparent.create(_transparent.width(), _transparent.height());
+  fillOutside(_processTransparent, out, _transparent.get(0, 0));
+  res = copyBitRect(closed, out - in.tl(), _processTransparent, out.tl());
+  if (res != 0)
+    return res;
+  recordHistory(PROCESS_TRANSPARENT, true);
+  return updateShowMat(_processTransparent);
+}
 
-  cv::morphologyEx(_transparent, _processTransparent, cv::MORPH_CLOSE, kernel);
+int tiffProcessAPI::removeSmallByArea(int thresh) {
+  if (_transparent.empty())
+    return -1;
+  thresh = toPreviewArea(thresh); // 面积按原图像素给出
+  if (_blackThresh >= 0 && !_treeTried) {
+    // 只在像素数预算内建树（预览代理通常都在内），之后换去黑阈值也不用重新标记
+    _treeTried = true;
+    if (static_cast<int64_t>(_blackness.total()) <= kMaxTreePixels) {
+      int res = _blacknessTree.build(_blackness);
+      if (res != 0)
+        DEBUG << "[MaxTree] build failed" << res;
+    }
+  }
+  if (!_blacknessTree.empty() && _blackThresh >= 0) {
+    beginEdit();
+    int res = _blacknessTree.reconstruct(_blackThresh, thresh,
+                                         _processTransparent);
+    _componentKeep.clear();
+    if (res != 0)
+      return res;
+    recordHistory(PROCESS_TRANSPARENT, true);
+    return updateShowMat(_processTransparent);
+  }
 
-  std::vector<cv::Mat> merge = this->_orgins;
-  merge.push_back(_processTransparent);
-  cv::merge(merge, _removeShowMat);
+  // 去黑蒙版变化后第一次去杂点时标记一次，之后调面积阈值不再重新标记
+  if (!_labelsValid) {
+    int res = encodeRuns(_transparent, _runs);
+    if (res == 0)
+      res = labelRuns(_runs, _runLabels, _componentAreas);
+    if (res < 0)
+      return res;
+    _labelsValid = true;
+    _componentKeep.clear();
+  }
+
+  std::vector<uint8_t> keep(_componentAreas.size());
+  for (size_t l = 0; l < keep.size(); ++l)
+    keep[l] = _componentAreas[l] >= thresh ? 1 : 0;
+
+  int res = 0;
+  if (_componentKeep.size() == keep.size()) {
+    // 上一次也是按面积去杂点：只改写保留状态翻转的连通域
+    std::vector<uint8_t> changed(keep.size());
+    bool any = false;
+    for (size_t l = 0; l < keep.size(); ++l) {
+      changed[l] = keep[l] != _componentKeep[l] ? 1 : 0;
+      any = any || changed[l];
+    }
+    if (!any)
+      return 0;
+    beginEdit();
+    res = decodeRuns(_runs, _runLabels, keep, _processTransparent, &changed);
+  } else {
+    beginEdit();
+    res = decodeRuns(_runs, _runLabels, keep, _processTransparent);
+  }
+  if (res != 0) {
+    _componentKeep.clear();
+    return res;
+  }
+  _componentKeep = std::move(keep);
+  recordHistory(PROCESS_TRANSPARENT, true);
+  return updateShowMat(_processTransparent);
+}
+
+int tiffProcessAPI::generateWhiteCompensation(int thresh) {
+  if (_blackness.empty() || _transparent.empty() ||
+      _processTransparent.empty())
+    return -1;
+  tiffProcess &proc = tiffProcess::getInstance();
+  beginEdit();
+  // 边距处蒙版可能被闭运算改过，但透明边距黑度高于阈值，补白恒为 0
+  cv::Mat marginWhite;
+  int res = proc.generateWhiteCompensation(_blackness(cv::Rect(0, 0, 1, 1)),
+                                           _transparent, cv::Point(), thresh,
+                                           marginWhite);
+  if (res != 0)
+    return res;
+
+  _white.create(_blackness.size(), CV_8UC1);
+  cv::Mat roi = _white(_bounds);
+  res = proc.generateWhiteCompensation(_blackness(_bounds), _processTransparent,
+                                       _bounds.tl(), thresh, roi);
+  if (res != 0)
+    return res;
+  fillOutside(_white, _bounds, marginWhite.at<uchar>(0, 0));
+
+  const int offset = toPreviewLength(_whiteOffset);
+  if (offset != 0) {
+    // 距离变换需要字节蒙版，只展开受影响的区域
+    const cv::Rect pad = padRect(_bounds, std::abs(offset), _white.size());
+    cv::Mat maskPad;
+    res = unpackBits(_processTransparent, maskPad, pad);
+    if (res != 0)
+      return res;
+    cv::Mat whitePad = _white(pad);
+    res = proc.offsetWhiteEdge(maskPad, offset, whitePad);
+    if (res != 0)
+      return res;
+  }
+
+  const MaskState *prev = _history.current();
+  recordHistory(WHITE, prev && prev->showProcessed);
   return 0;
 }
 
-int tiffProcessAPI::removeSmallByArea(int thresh) {
-  int res = tiffProcess::getInstance().removeSmallComponents(
-      _transparent, thresh, _processTransparent);
+int tiffProcessAPI::updateShowMat(const BitMask &alpha) {
+  cv::Mat bytes;
+  int res = unpackBits(alpha, bytes);
   if (res != 0)
     return res;
   std::vector<cv::Mat> merge = this->_orgins;
-  merge.push_back(_processTransparent);
+  merge.push_back(bytes);
   cv::merge(merge, _removeShowMat);
-
   return 0;
 }
 
-int tiffProcessAPI::generateWhiteCompensation(int thresh) {
-  tiffProcess::getInstance().generateWhiteCompensation(
-      _blackness, _processTransparent, thresh, _white);
-  return 0;
+void tiffProcessAPI::setWhiteOffset(int offset) { _whiteOffset = offset; }
+
+void tiffProcessAPI::setHistoryLimit(size_t bytes) {
+  _history.setMaxBytes(bytes);
+}
+
+void tiffProcessAPI::recordHistory(int changed, bool showProcessed) {
+  const MaskState *prev = _history.current();
+  // 之前有操作中途失败时其他层也可能被改过，全部重新分块（相同的块仍然共用）
+  if (!prev || !_syncedBeforeEdit)
+    changed = TRANSPARENT | PROCESS_TRANSPARENT | WHITE;
+
+  MaskState state;
+  state.transparent =
+      changed & TRANSPARENT
+          ? TiledLayer(_transparent, prev ? &prev->transparent : nullptr)
+          : prev->transparent;
+  state.processTransparent =
+      changed & PROCESS_TRANSPARENT
+          ? TiledLayer(_processTransparent,
+                       prev ? &prev->processTransparent : nullptr)
+          : prev->processTransparent;
+  state.white = changed & WHITE
+                    ? TiledLayer(_white, prev ? &prev->white : nullptr)
+                    : prev->white;
+  state.blackThresh = _blackThresh;
+  state.showProcessed = showProcessed;
+  _history.push(std::move(state));
+  _historySynced = true;
+}
+
+int tiffProcessAPI::restoreHistory(const MaskState &state,
+                                   const MaskState *from) {
+  // 当前蒙版就是 from 时只解码与 from 不同的块
+  int res = state.transparent.restore(_transparent,
+                                      from ? &from->transparent : nullptr);
+  if (res == 0)
+    res = state.processTransparent.restore(
+        _processTransparent, from ? &from->processTransparent : nullptr);
+  if (res == 0)
+    res = state.white.restore(_white, from ? &from->white : nullptr);
+  _labelsValid = false;
+  _componentKeep.clear();
+  if (res != 0) {
+    _historySynced = false;
+    return res;
+  }
+  _blackThresh = state.blackThresh;
+  _historySynced = true;
+  return updateShowMat(state.showProcessed ? _processTransparent
+                                           : _transparent);
+}
+
+int tiffProcessAPI::undo() {
+  const MaskState *from = _historySynced ? _history.current() : nullptr;
+  const MaskState *state = _history.undo();
+  if (!state)
+    return -1;
+  return restoreHistory(*state, from);
+}
+
+int tiffProcessAPI::redo() {
+  const MaskState *from = _historySynced ? _history.current() : nullptr;
+  const MaskState *state = _history.redo();
+  if (!state)
+    return -1;
+  return restoreHistory(*state, from);
 }
 
 int tiffProcessAPI::genernateTiffFile(std::string_view path,
                                       BlacknessMethod type, int blacknessThresh,
                                       int noiseThresh) {
-  return tiffProcess::getInstance().genernateTiffFile(
-      path, type, blacknessThresh, noiseThresh, this->_ps);
+  tiffProcess &proc = tiffProcess::getInstance();
+  const std::string &src = proc.sourcePath();
+  if (!src.empty() && tiffProcess::pageCount(src) > 1) {
+    TiffPageParams defaults;
+    defaults.method = type;
+    defaults.blacknessThresh = blacknessThresh;
+    defaults.noiseThresh = noiseThresh;
+    defaults.whiteOffset = _whiteOffset;
+    return proc.genernateMultiPageTiff(src, path, this->_pageParams, defaults,
+                                       this->_templates);
+  }
+  return proc.genernateTiffFile(path, type, blacknessThresh, noiseThresh,
+                                this->_templates, _whiteOffset);
+}
+
+void tiffProcessAPI::setPageParams(const std::vector<TiffPageParams> &params) {
+  _pageParams = params;
 }
 
 inline void drawRotatedRect(cv::Mat &img, const cv::RotatedRect &rect,
@@ -117,25 +431,42 @@ int tiffProcessAPI::test() {
 }
 
 int tiffProcessAPI::loadPsTemplate() {
-  this->_ps.load("withW.tif");
-  DEBUG << "load template tiff successfully";
+  int n = loadPsTemplates("templates");
+  if (this->_templates.add("withW.tif"))
+    ++n;
+  DEBUG << "load template tiff successfully, count =" << n;
   return 0;
 }
 
+int tiffProcessAPI::loadPsTemplates(const std::string &dir) {
+  return this->_templates.loadDirectory(dir);
+}
+
+int tiffProcessAPI::setColorProfiles(const std::string &cmykProfilePath,
+                                     const std::string &rgbProfilePath) {
+  return tiffProcess::getInstance().setColorProfiles(cmykProfilePath,
+                                                     rgbProfilePath);
+}
+
 cv::Mat tiffProcessAPI::geRemoveResult() { return this->_removeShowMat; }
 
 cv::Mat tiffProcessAPI::getProcessTransparent() {
-  return this->_processTransparent;
+  cv::Mat bytes;
+  unpackBits(this->_processTransparent, bytes);
+  return bytes;
 }
 
-cv::Mat tiffProcessAPI::getTransparent() { return this->_transparent; }
+cv::Mat tiffProcessAPI::getTransparent() {
+  cv::Mat bytes;
+  unpackBits(this->_transparent, bytes);
+  return bytes;
+}
 
 cv::Mat tiffProcessAPI::getWhite() { return this->_white; }
 
 cv::Mat tiffProcessAPI::openTiffImage(std::string_view path) {
   cv::Mat out;
   tiffProcess::getInstance().loadTiff(path, out);
-  _orgins.clear();
-  cv::split(out, _orgins);
+  setcvMatImage(out);
   return out;
 }
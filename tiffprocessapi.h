@@ -1,6 +1,9 @@
 #ifndef TIFFPROCESSAPI_H
 #define TIFFPROCESSAPI_H
+#include "maskhistory.h"
+#include "maxtree.h"
 #include "pstemplate.h"
+#include "runmask.h"
 #include "tiffprocess.h"
 class tiffProcessAPI {
 public:
@@ -12,23 +15,63 @@ public:
 
   void setcvMatImage(const cv::Mat mat);
 
+  // 交互预览代理：去黑 / 去杂点 / 补白在缩小 divisor 倍（区域平均）的副本上计算，
+  // 杂点面积、闭运算核、白墨偏移按比例换算；生成 TIFF 始终用原图。
+  // divisor 取 1（原图）/ 2 / 4 / 8；改变后需要重新计算黑度
+  int setPreviewScale(int divisor);
+  int previewScale() const { return _previewScale; }
+
   int calBackness(BlacknessMethod type = BlacknessMethod::GRAY);
 
   int removeBlack(int thresh);
 
+  // 由 calBackness 时统计的直方图选阈值，不访问像素；未计算黑度返回 -1
+  int autoBlacknessThresh(AutoThresholdMode mode, double percentile = 99.0);
+
+  // 给定阈值下的透明像素比例（0~1），只查直方图
+  double transparentFraction(int thresh) const;
+
   int removeSmall(int kernelSize);
 
+  // 在当前去黑阈值下删除面积 < thresh 的连通域。
+  // 第一次调用时在像素数预算内建黑度的组件树，之后直接由树重建，
+  // 调哪个滑块都不再阈值化 / 标记；超出预算时用行程标记缓存
   int removeSmallByArea(int thresh);
 
   int generateWhiteCompensation(int thresh);
 
+  // 白墨收缩（< 0）/ 外扩（> 0），单位像素，预览与生成都生效
+  void setWhiteOffset(int offset);
+
+  // 撤销 / 重做去黑、去杂点、补白的结果（重新计算黑度或打开新图后清空）；
+  // 没有可用记录返回 -1
+  int undo();
+  int redo();
+  bool canUndo() const { return _history.canUndo(); }
+  bool canRedo() const { return _history.canRedo(); }
+  // 当前蒙版对应的去黑阈值，未去黑为 -1（撤销后界面据此同步滑块）
+  int blackThresh() const { return _blackThresh; }
+  // 历史记录占用内存上限（字节），超出时丢弃最旧的记录
+  void setHistoryLimit(size_t bytes);
+
+  // 源文件为多页时所有页都会处理，按原顺序写出
   int genernateTiffFile(std::string_view path, BlacknessMethod type,
                         int blacknessThresh, int noiseThresh);
 
+  // 多页 TIFF 各页参数（未设置的页沿用 genernateTiffFile 的参数）
+  void setPageParams(const std::vector<TiffPageParams> &params);
+
   int test();
 
   int loadPsTemplate();
 
+  // CMYK 预览使用的 ICC 配置文件（TIFF 未嵌入时生效）
+  int setColorProfiles(const std::string &cmykProfilePath,
+                       const std::string &rgbProfilePath = {});
+
+  // 加载目录下所有模板，返回加载数量
+  int loadPsTemplates(const std::string &dir);
+
 public:
   cv::Mat geRemoveResult();
   cv::Mat geRemoveSmallResult();
@@ -37,6 +80,25 @@ public:
   cv::Mat getWhite();
 
 private:
+  // 原图 + 蒙版（展开成 0/255）合成预览
+  int updateShowMat(const BitMask &alpha);
+
+  // 由 _source 生成预览用的 _origin / _orgins，并清空基于旧图的结果
+  void updatePreviewSource();
+  // 原图像素单位换算到预览：面积按 divisor^2，长度按 divisor
+  int toPreviewArea(int area) const;
+  int toPreviewLength(int length) const;
+
+  // 修改蒙版前调用：之后直到记录新状态，蒙版都不再与历史当前状态一致
+  void beginEdit() {
+    _syncedBeforeEdit = _historySynced;
+    _historySynced = false;
+  }
+  // 修改成功后记录新状态，只有 changed 中的层重新分块，其余沿用上一状态
+  enum HistoryLayer { TRANSPARENT = 1, PROCESS_TRANSPARENT = 2, WHITE = 4 };
+  void recordHistory(int changed, bool showProcessed);
+  int restoreHistory(const MaskState &state, const MaskState *from);
+
   tiffProcessAPI() = default;
   ~tiffProcessAPI() = default;
 
@@ -47,14 +109,34 @@ private:
   tiffProcessAPI &operator=(tiffProcessAPI &&) = delete;
 
 protected:
-  PsTemplate _ps;
-  cv::Mat _origin;
-  std::vector<cv::Mat> _orgins;
-  cv::Mat _transparent;
-  cv::Mat _processTransparent;
+  PsTemplateRegistry _templates;
+  std::vector<TiffPageParams> _pageParams;
+  int _whiteOffset = 0;
+  cv::Mat _source;       // 原图（全分辨率）
+  cv::Mat _origin;       // 预览计算用：原图或缩小的代理
+  std::vector<cv::Mat> _orgins; // _origin 各通道，合成预览用
+  int _previewScale = 1;
+  BitMask _transparent;        // 去黑蒙版（按位）
+  BitMask _processTransparent; // 去杂点 / 闭运算后的蒙版（按位）
+  // 去杂点缓存：_transparent 的行程、各行程的连通域标签和各连通域面积，
+  // 只在去黑蒙版变化时重算；改面积阈值只重建保留表
+  RunMask _runs;
+  std::vector<int> _runLabels;
+  std::vector<int64_t> _componentAreas;
+  bool _labelsValid = false;
+  // _processTransparent 对应的保留表，为空表示它不是按面积去杂点的结果
+  std::vector<uint8_t> _componentKeep;
+  MaxTree _blacknessTree; // 第一次按面积去杂点时建，超出预算或失败时为空
+  bool _treeTried = false; // 本次黑度已尝试建树
+  int _blackThresh = -1;  // _transparent 对应的去黑阈值
+  MaskHistory _history;
+  bool _historySynced = false; // 当前蒙版就是 _history.current()
+  bool _syncedBeforeEdit = false;
   cv::Mat _white;
   cv::Mat _removeShowMat;
   cv::Mat _blackness;
+  BlacknessHistogram _blacknessHist;
+  cv::Rect _bounds; // 内容区域，外部为均匀边距
 };
 
 #endif // TIFFPROCESSAPI_H
@@ -1,95 +1,290 @@
 #include "tiffprocesslibrary.h"
 
 #include <tiffio.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
 #include <string>
 #include <vector>
 
+#include "asyncwriter.h"
+#include "pschannels.h"
+#include "streamprocessor.h"
+#include "taskpool.h"
+#include "tiffprocess.h"
+
+// ---------------- 路径转换 ----------------
+// Windows 下 wchar_t 为 UTF-16，其余平台为 UTF-32
 static std::string WideToUtf8(const wchar_t* wstr) {
   if (!wstr) return {};
+#ifdef _WIN32
   int len =
       WideCharToMultiByte(CP_UTF8, 0, wstr, -1, nullptr, 0, nullptr, nullptr);
   if (len <= 0) return {};
   std::string utf8(len - 1, '\0');
   WideCharToMultiByte(CP_UTF8, 0, wstr, -1, utf8.data(), len, nullptr, nullptr);
   return utf8;
+#else
+  std::string utf8;
+  for (const wchar_t* p = wstr; *p; ++p) {
+    uint32_t cp = static_cast<uint32_t>(*p);
+    if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+    if (cp < 0x80) {
+      utf8.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      utf8.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      utf8.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      utf8.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+      utf8.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      utf8.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      utf8.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+  return utf8;
+#endif
 }
 
-static std::string WideToUtf8(std::wstring_view wstr) {
-  if (wstr.empty()) return {};
-  std::wstring tmp(wstr);
-  return WideToUtf8(tmp.c_str());
+// Windows 下 TIFFOpen 走 ANSI 代码页，中文路径需用宽字符版本
+static TIFF* OpenTiffForWrite(const wchar_t* path) {
+  if (!path) return nullptr;
+#ifdef _WIN32
+  return TIFFOpenW(path, "w");
+#else
+  return TIFFOpen(WideToUtf8(path).c_str(), "w");
+#endif
 }
 
-extern "C" {
+// ---------------- 视图 / 校验 ----------------
+// 一行的字节数，按 size_t 计算；超出 int（行跨度的类型）或参数为负时返回 -1
+static int RowBytesOf(int width, int channels) {
+  if (width < 0 || channels < 0) return -1;
+  const size_t bytes =
+      static_cast<size_t>(width) * static_cast<size_t>(channels);
+  return bytes > static_cast<size_t>(INT_MAX) ? -1 : static_cast<int>(bytes);
+}
 
-// 传统接口
-int MchBmpTiffOut(LPBYTE pSrc, int nWidth, int nHeight, int nPixBits,
-                  int nBytePerLine, int nCHcnt, wchar_t* szTiffFile) {
-  if (!pSrc || nWidth <= 0 || nHeight <= 0 || nCHcnt < 4) return -1;
-  if (nPixBits != 8) return -2;
+static bool IsValidImage(const TpImage* img, int channels) {
+  if (!img || !img->data || img->width <= 0 || img->height <= 0) return false;
+  if (img->channels <= 0 || (channels > 0 && img->channels != channels))
+    return false;
+  const int rowBytes = RowBytesOf(img->width, img->channels);
+  return rowBytes >= 0 && img->bytesPerLine >= rowBytes;
+}
 
-  const int bytesPerPixel = (nPixBits * nCHcnt) / 8;
-  if (nBytePerLine < nWidth * bytesPerPixel) return -5;
+static bool SameSize(const TpImage* a, const TpImage* b) {
+  return a->width == b->width && a->height == b->height;
+}
 
-  std::string utf8Path = WideToUtf8(szTiffFile);
-  TIFF* tif = TIFFOpen(utf8Path.c_str(), "w");
-  if (!tif) return -3;
+// 调用方缓冲上的像素视图，不拷贝
+static PixelView ViewOf(const TpImage* img) {
+  return PixelView(img->data, img->width, img->height,
+                   static_cast<size_t>(img->bytesPerLine), img->channels);
+}
 
-  const int samplesPerPixel = nCHcnt;
-  const int spotCount = nCHcnt - 4;
+// 调用方缓冲上的 cv::Mat 头，不拷贝；尺寸/类型一致时 create() 不会重新分配
+static cv::Mat AsMat(const TpImage* img) {
+  return cv::Mat(img->height, img->width, CV_8UC(img->channels), img->data,
+                 static_cast<size_t>(img->bytesPerLine));
+}
 
-  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, nWidth);
-  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, nHeight);
-  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, nPixBits);
-  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, samplesPerPixel);
-  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_SEPARATED);
-  TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
-  TIFFSetField(tif, TIFFTAG_INKSET, INKSET_CMYK);
+static int ColorChannelsOf(int photometric) {
+  if (photometric == TP_PHOTOMETRIC_RGB) return 3;
+  if (photometric == TP_PHOTOMETRIC_CMYK) return 4;
+  return -1;
+}
 
-  if (spotCount > 0) {
-    std::vector<uint16_t> extraSamples(spotCount, EXTRASAMPLE_UNSPECIFIED);
-    TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, spotCount, extraSamples.data());
+// 按行带转换颜色并计算黑度，临时 BGR 只有一个行带大小
+static int CalcBlacknessBands(const TpImage* src, int photometric, int method,
+                              cv::Mat& blackness) {
+  constexpr int kBandRows = 256;
+  const int bands = (src->height + kBandRows - 1) / kBandRows;
+  std::vector<int> results(bands, 0);
+
+  const ConstPixelView view = ViewOf(src);
+  parallelFor(cv::Range(0, bands), [&](const cv::Range& r) {
+    tiffProcess& proc = tiffProcess::getInstance();
+    cv::Mat bgr;
+    for (int b = r.start; b < r.end; ++b) {
+      const int y0 = b * kBandRows;
+      const int rows = std::min(kBandRows, src->height - y0);
+
+      int res = proc.convertToBgr(view.rows(y0, y0 + rows),
+                                  static_cast<uint16_t>(photometric), {}, bgr);
+      if (res == 0) {
+        cv::Mat dst = blackness.rowRange(y0, y0 + rows);
+        res = proc.calcBlackness(bgr, static_cast<BlacknessMethod>(method),
+                                 dst);
+      }
+      results[b] = res;
+    }
+  });
+
+  for (int res : results)
+    if (res != 0) return res;
+  return 0;
+}
+
+// 黑度 -> 蒙版 -> 去杂点 -> 白墨（白墨通道值 = 255 - 补白强度）
+static int RunPipeline(const TpImage* src, const TpParams* params,
+                       cv::Mat& mask, cv::Mat& whiteInk) {
+  if (!IsValidImage(src, -1) || !params) return -1;
+  const int colorChannels = ColorChannelsOf(params->photometric);
+  if (colorChannels < 0 || src->channels < colorChannels) return -2;
+  if (params->alphaIndex >= src->channels - colorChannels) return -2;
+
+  cv::Mat blackness(src->height, src->width, CV_8UC1);
+  int res = CalcBlacknessBands(src, params->photometric,
+                               params->blacknessMethod, blackness);
+  if (res != 0) return res;
+
+  tiffProcess& proc = tiffProcess::getInstance();
+  res = proc.removeBlack(blackness, params->blacknessThresh, mask);
+  if (res != 0) return res;
+
+  if (params->noiseArea > 0) {
+    res = proc.removeSmallComponents(mask, params->noiseArea, mask);
+    if (res != 0) return res;
   }
 
-  if (spotCount > 0) {
-    std::string inkNames("Cyan\0Magenta\0Yellow\0Black\0", 26);
-    for (int i = 0; i < spotCount; ++i) {
-      inkNames += "Spot";
-      inkNames += std::to_string(i + 1);
-      inkNames.push_back('\0');
+  const int whiteThresh =
+      params->whiteThresh > 0 ? params->whiteThresh : params->blacknessThresh;
+  cv::Mat white;
+  res = proc.generateWhiteCompensation(blackness, mask, whiteThresh, white);
+  if (res != 0) return res;
+  res = proc.offsetWhiteEdge(mask, params->whiteOffset, white);
+  if (res != 0) return res;
+  whiteInk = 255 - white;
+  return 0;
+}
+
+// 逐行写 TIFF：先写标签，行按顺序陆续送入，按条带编码
+class TiffRowWriter {
+ public:
+  ~TiffRowWriter() { close(); }
+
+  int open(const wchar_t* path, int width, int height, int channels,
+           int photometric, bool hasAlpha,
+           const std::vector<std::string>& spotNames) {
+    const int colorChannels = ColorChannelsOf(photometric);
+    if (colorChannels < 0 || channels < colorChannels) return -2;
+
+    _tif = OpenTiffForWrite(path);
+    if (!_tif) return -3;
+
+    const int extraCount = channels - colorChannels;
+
+    TIFFSetField(_tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(_tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(_tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(_tif, TIFFTAG_SAMPLESPERPIXEL, channels);
+    TIFFSetField(_tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(_tif, TIFFTAG_PHOTOMETRIC, photometric);
+    TIFFSetField(_tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+    TIFFSetField(_tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(_tif, 0));
+    if (photometric == TP_PHOTOMETRIC_CMYK)
+      TIFFSetField(_tif, TIFFTAG_INKSET, INKSET_CMYK);
+
+    if (extraCount > 0) {
+      std::vector<uint16_t> extraSamples(extraCount, EXTRASAMPLE_UNSPECIFIED);
+      if (hasAlpha) extraSamples[0] = EXTRASAMPLE_UNASSALPHA;
+      TIFFSetField(_tif, TIFFTAG_EXTRASAMPLES, extraCount,
+                   extraSamples.data());
+
+      // Photoshop 通道名：透明度 + 专色
+      std::vector<PsChannelDesc> descs;
+      for (int i = 0; i < extraCount; ++i) {
+        if (i == 0 && hasAlpha) {
+          descs.push_back(PsChannelDesc::alpha("Transparency"));
+          continue;
+        }
+        const size_t spot = descs.size() - (hasAlpha ? 1 : 0);
+        std::string name = spot < spotNames.size()
+                               ? spotNames[spot]
+                               : "Spot" + std::to_string(spot + 1);
+        descs.push_back(PsChannelDesc::spot(name, 0xFFFF, 0xFFFF, 0xFFFF));
+      }
+      std::vector<uint8_t> ps34377 = synthesizePsChannelResources(descs);
+      TIFFSetField(_tif, TIFFTAG_PHOTOSHOP, (uint32_t)ps34377.size(),
+                   ps34377.data());
     }
-    TIFFSetField(tif, TIFFTAG_INKNAMES, inkNames.size(), inkNames.c_str());
+    return 0;
   }
 
-  for (int y = 0; y < nHeight; ++y) {
-    LPBYTE srcLine = pSrc + y * nBytePerLine;
-    if (TIFFWriteScanline(tif, srcLine, y, 0) < 0) {
-      TIFFClose(tif);
+  int writeRow(const uint8_t* row, int y) {
+    if (!_tif) return -3;
+    if (TIFFWriteScanline(_tif, const_cast<uint8_t*>(row), y, 0) < 0)
       return -4;
-    }
+    return 0;
   }
 
-  TIFFClose(tif);
+  void close() {
+    if (_tif) TIFFClose(_tif);
+    _tif = nullptr;
+  }
+
+ private:
+  TIFF* _tif = nullptr;
+};
+
+// 写 TIFF，行数据由 rowAt 按需提供（可以是调用方缓冲，也可以是临时行）
+static int WriteTiffRows(const wchar_t* path, int width, int height,
+                         int channels, int photometric, bool hasAlpha,
+                         const std::vector<std::string>& spotNames,
+                         const std::function<const uint8_t*(int)>& rowAt) {
+  TiffRowWriter writer;
+  int res = writer.open(path, width, height, channels, photometric, hasAlpha,
+                        spotNames);
+  if (res != 0) return res;
+
+  for (int y = 0; y < height; ++y) {
+    res = writer.writeRow(rowAt(y), y);
+    if (res != 0) return res;
+  }
   return 0;
 }
 
-// 现代接口
-int MchBmpTiffOut1(const std::uint8_t* data, int width, int height,
-                   int bitsPerChannel, int bytesPerLine, int channelCount,
-                   std::wstring_view tiffPath) {
+static StreamParams ToStreamParams(const TpParams* params) {
+  StreamParams sp;
+  sp.photometric = static_cast<uint16_t>(params->photometric);
+  sp.alphaIndex = params->alphaIndex;
+  sp.method = static_cast<BlacknessMethod>(params->blacknessMethod);
+  sp.blacknessThresh = params->blacknessThresh;
+  sp.noiseArea = params->noiseArea;
+  sp.whiteThresh = params->whiteThresh;
+  return sp;
+}
+
+// 流式写出的句柄：行带处理器 + 逐行写 TIFF
+struct TpStream {
+  StreamProcessor processor;
+  TiffRowWriter writer;
+  int height = 0;
+};
+
+// 传统 CMYK + 专色写出（MchBmpTiffOut 系列共用）
+static int WriteCmykSpots(const uint8_t* data, int width, int height,
+                          int bitsPerChannel, int bytesPerLine,
+                          int channelCount, const wchar_t* path) {
   if (!data || width <= 0 || height <= 0 || channelCount < 4) return -1;
   if (bitsPerChannel != 8) return -2;
 
   const int bytesPerPixel = (bitsPerChannel * channelCount) / 8;
-  if (bytesPerLine < width * bytesPerPixel) return -5;
+  const int rowBytes = RowBytesOf(width, bytesPerPixel);
+  if (rowBytes < 0 || bytesPerLine < rowBytes) return -5;
 
-  std::string utf8Path = WideToUtf8(tiffPath);
-
-  TIFF* tif = TIFFOpen(utf8Path.c_str(), "w");
+  TIFF* tif = OpenTiffForWrite(path);
   if (!tif) return -3;
 
   const int samplesPerPixel = channelCount;
@@ -121,8 +316,8 @@ int MchBmpTiffOut1(const std::uint8_t* data, int width, int height,
   }
 
   for (int y = 0; y < height; ++y) {
-    const std::uint8_t* srcLine = data + y * bytesPerLine;
-    if (TIFFWriteScanline(tif, const_cast<std::uint8_t*>(srcLine), y, 0) < 0) {
+    const uint8_t* srcLine = data + static_cast<size_t>(y) * bytesPerLine;
+    if (TIFFWriteScanline(tif, const_cast<uint8_t*>(srcLine), y, 0) < 0) {
       TIFFClose(tif);
       return -4;
     }
@@ -131,4 +326,408 @@ int MchBmpTiffOut1(const std::uint8_t* data, int width, int height,
   TIFFClose(tif);
   return 0;
 }
+
+// 异步写出的句柄，引用 I/O 线程上的任务
+struct TpWriteJob {
+  std::shared_ptr<AsyncWriteJob> job;
+};
+
+// 拷贝（或借用）行数据后交给 I/O 线程；write 用紧凑或原始行跨度写出
+static int SubmitWrite(
+    const uint8_t* data, int height, int rowBytes, int bytesPerLine,
+    int flags, TpWriteCallback callback, void* user, TpWriteJob** job,
+    std::function<int(const uint8_t* data, int bytesPerLine)> write) {
+  if (job) *job = nullptr;
+
+  auto prepare = [&]() -> AsyncWriteQueue::Task {
+    if (flags & TP_ASYNC_BORROW)
+      return [=]() { return write(data, bytesPerLine); };
+
+    auto copy = std::make_shared<std::vector<uint8_t>>(
+        static_cast<size_t>(rowBytes) * height);
+    for (int y = 0; y < height; ++y)
+      std::memcpy(copy->data() + static_cast<size_t>(y) * rowBytes,
+                  data + static_cast<size_t>(y) * bytesPerLine, rowBytes);
+    return [=]() { return write(copy->data(), rowBytes); };
+  };
+
+  AsyncWriteQueue::Callback done;
+  if (callback) done = [callback, user](int result) { callback(user, result); };
+
+  // 异常不能穿过 C 接口：拷贝数据时内存不足按提交失败返回
+  std::shared_ptr<AsyncWriteJob> j;
+  try {
+    j = AsyncWriteQueue::getInstance().submit(prepare, std::move(done));
+  } catch (const std::bad_alloc&) {
+    return -6;
+  }
+  if (!j) return -6;
+  if (job) *job = new TpWriteJob{std::move(j)};
+  return 0;
+}
+
+// 异常不能穿过 C 接口：cv::Mat / 缓冲分配失败、OpenCV 错误以及并行任务中
+// 重新抛出的异常都按 -6 返回（与异步写出失败相同）
+static int NoThrow(const std::function<int()>& body) {
+  try {
+    return body();
+  } catch (...) {
+    return -6;
+  }
+}
+
+extern "C" {
+
+// 传统接口
+int MchBmpTiffOut(LPBYTE pSrc, int nWidth, int nHeight, int nPixBits,
+                  int nBytePerLine, int nCHcnt, wchar_t* szTiffFile) {
+  return NoThrow([&] {
+    return WriteCmykSpots(pSrc, nWidth, nHeight, nPixBits, nBytePerLine, nCHcnt,
+                          szTiffFile);
+  });
+}
+
+// 现代接口
+int MchBmpTiffOut1(const uint8_t* data, int width, int height,
+                   int bitsPerChannel, int bytesPerLine, int channelCount,
+                   std::wstring_view tiffPath) {
+  return NoThrow([&] {
+    std::wstring path(tiffPath);
+    return WriteCmykSpots(data, width, height, bitsPerChannel, bytesPerLine,
+                          channelCount, path.c_str());
+  });
+}
+
+void TpDefaultParams(TpParams* params) {
+  if (!params) return;
+  params->photometric = TP_PHOTOMETRIC_CMYK;
+  params->alphaIndex = -1;
+  params->blacknessMethod = TP_BLACKNESS_MAX_CHANNEL;
+  params->blacknessThresh = 235;
+  params->noiseArea = 0;
+  params->whiteThresh = 0;
+  params->whiteOffset = 0;
+}
+
+void TpSetThreads(int workers, int pinThreads) {
+  // 无返回值：创建线程失败时保持原配置
+  NoThrow([&] {
+    TaskPool::getInstance().configure(workers, pinThreads != 0);
+    return 0;
+  });
+}
+
+int TpCalcBlackness(const TpImage* src, int photometric, int method,
+                    TpImage* blackness) {
+  return NoThrow([&] {
+    if (!IsValidImage(src, -1) || !IsValidImage(blackness, 1)) return -1;
+    if (!SameSize(src, blackness)) return -4;
+    if (method < TP_BLACKNESS_GRAY || method > TP_BLACKNESS_MAX_CHANNEL)
+      return -2;
+    cv::Mat dst = AsMat(blackness);
+    return CalcBlacknessBands(src, photometric, method, dst);
+  });
+}
+
+int TpRemoveBlack(const TpImage* blackness, int thresh, TpImage* mask) {
+  return NoThrow([&] {
+    if (!IsValidImage(blackness, 1) || !IsValidImage(mask, 1)) return -1;
+    if (!SameSize(blackness, mask)) return -4;
+    cv::Mat dst = AsMat(mask);
+    return tiffProcess::getInstance().removeBlack(AsMat(blackness), thresh,
+                                                  dst);
+  });
+}
+
+int TpRemoveSmall(const TpImage* mask, int minArea, TpImage* out) {
+  return NoThrow([&] {
+    if (!IsValidImage(mask, 1) || !IsValidImage(out, 1)) return -1;
+    if (!SameSize(mask, out)) return -4;
+    cv::Mat dst = AsMat(out);
+    return tiffProcess::getInstance().removeSmallComponents(AsMat(mask),
+                                                            minArea, dst);
+  });
+}
+
+int TpWhiteCompensation(const TpImage* blackness, const TpImage* mask,
+                        int thresh, TpImage* white) {
+  return NoThrow([&] {
+    if (!IsValidImage(blackness, 1) || !IsValidImage(mask, 1) ||
+        !IsValidImage(white, 1))
+      return -1;
+    if (!SameSize(blackness, mask) || !SameSize(blackness, white)) return -4;
+    cv::Mat dst = AsMat(white);
+    return tiffProcess::getInstance().generateWhiteCompensation(
+        AsMat(blackness), AsMat(mask), thresh, dst);
+  });
+}
+
+int TpAppendChannels(const TpImage* src, int photometric, int alphaIndex,
+                     const TpImage* alpha, const TpImage* const* extras,
+                     int extraCount, TpImage* dst) {
+  return NoThrow([&] {
+    if (!IsValidImage(src, -1) || !IsValidImage(alpha, 1) ||
+        !IsValidImage(dst, -1))
+      return -1;
+    if (extraCount < 0 || (extraCount > 0 && !extras)) return -1;
+
+    const int colorChannels = ColorChannelsOf(photometric);
+    if (colorChannels < 0 || src->channels < colorChannels) return -2;
+    const int oldExtra = src->channels - colorChannels;
+    if (alphaIndex >= oldExtra) return -2;
+
+    const int dstChannels =
+        colorChannels + 1 + oldExtra - (alphaIndex >= 0 ? 1 : 0) + extraCount;
+    if (dst->channels != dstChannels) return -3;
+    if (!SameSize(src, alpha) || !SameSize(src, dst)) return -4;
+    for (int i = 0; i < extraCount; ++i) {
+      if (!IsValidImage(extras[i], 1)) return -1;
+      if (!SameSize(src, extras[i])) return -4;
+    }
+
+    const ConstPixelView srcView = ViewOf(src);
+    const ConstPixelView alphaView = ViewOf(alpha);
+    const PixelView dstView = ViewOf(dst);
+    std::vector<ConstPixelView> extraViews(extraCount);
+    for (int i = 0; i < extraCount; ++i) extraViews[i] = ViewOf(extras[i]);
+
+    parallelFor(cv::Range(0, src->height), [&](const cv::Range& r) {
+      std::vector<const uint8_t*> extraRow(extraCount);
+      for (int y = r.start; y < r.end; ++y) {
+        for (int i = 0; i < extraCount; ++i) extraRow[i] = extraViews[i].row(y);
+        tiffProcess::appendChannelsRow(srcView.row(y), srcView.spp,
+                                       colorChannels, alphaIndex,
+                                       alphaView.row(y), extraRow.data(),
+                                       extraCount, dstView.row(y), src->width);
+      }
+    });
+    return 0;
+  });
+}
+
+int TpWriteTiff(const TpImage* img, int photometric, int hasAlpha,
+                const wchar_t* tiffPath) {
+  return NoThrow([&] {
+    if (!IsValidImage(img, -1)) return -1;
+    const ConstPixelView view = ViewOf(img);
+    return WriteTiffRows(tiffPath, view.width, view.height, view.spp,
+                         photometric, hasAlpha != 0, {},
+                         [&](int y) { return view.row(y); });
+  });
+}
+
+int TpProcess(const TpImage* src, const TpParams* params, TpImage* dst) {
+  return NoThrow([&] {
+    if (!IsValidImage(dst, -1)) return -1;
+    cv::Mat mask, whiteInk;
+    int res = RunPipeline(src, params, mask, whiteInk);
+    if (res != 0) return res;
+
+    TpImage alphaImg{mask.data, mask.cols, mask.rows, 1,
+                     static_cast<int>(mask.step)};
+    TpImage whiteImg{whiteInk.data, whiteInk.cols, whiteInk.rows, 1,
+                     static_cast<int>(whiteInk.step)};
+    const TpImage* extras[2] = {&whiteImg, &whiteImg};
+    return TpAppendChannels(src, params->photometric, params->alphaIndex,
+                            &alphaImg, extras, 2, dst);
+  });
+}
+
+int TpProcessToTiff(const TpImage* src, const TpParams* params,
+                    const wchar_t* tiffPath) {
+  return NoThrow([&] {
+    cv::Mat mask, whiteInk;
+    int res = RunPipeline(src, params, mask, whiteInk);
+    if (res != 0) return res;
+
+    const int colorChannels = ColorChannelsOf(params->photometric);
+    const int oldExtra = src->channels - colorChannels;
+    const int dstChannels =
+        colorChannels + 1 + oldExtra - (params->alphaIndex >= 0 ? 1 : 0) + 2;
+
+    // 每行在写出前才组装，整幅只保留单通道中间结果
+    const ConstPixelView srcView = ViewOf(src);
+    std::vector<uint8_t> row(static_cast<size_t>(src->width) * dstChannels);
+    return WriteTiffRows(
+        tiffPath, src->width, src->height, dstChannels, params->photometric,
+        true, {"W1", "W2"}, [&](int y) {
+          const uint8_t* white = whiteInk.ptr<uint8_t>(y);
+          const uint8_t* extras[2] = {white, white};
+          tiffProcess::appendChannelsRow(
+              srcView.row(y), srcView.spp, colorChannels, params->alphaIndex,
+              mask.ptr<uint8_t>(y), extras, 2, row.data(), src->width);
+          return static_cast<const uint8_t*>(row.data());
+        });
+  });
+}
+
+int TpStreamBegin(int width, int height, int channels, const TpParams* params,
+                  const wchar_t* tiffPath, TpStream** stream) {
+  return NoThrow([&] {
+    if (!stream) return -1;
+    *stream = nullptr;
+    if (width <= 0 || height <= 0 || channels <= 0 || !params) return -1;
+    if (params->blacknessMethod < TP_BLACKNESS_GRAY ||
+        params->blacknessMethod > TP_BLACKNESS_MAX_CHANNEL)
+      return -2;
+    // 收缩/外扩需要前后若干行的距离信息，逐行输出时无法确定
+    if (params->whiteOffset != 0) return -2;
+
+    auto s = std::make_unique<TpStream>();
+    s->height = height;
+    TpStream* raw = s.get();
+    int res = s->processor.begin(
+        width, channels, ToStreamParams(params),
+        [raw](const uint8_t* row, int y) {
+          return raw->writer.writeRow(row, y);
+        });
+    if (res != 0) return res;
+
+    res = s->writer.open(tiffPath, width, height, s->processor.outputChannels(),
+                         params->photometric, true, {"W1", "W2"});
+    if (res != 0) return res;
+
+    *stream = s.release();
+    return 0;
+  });
+}
+
+int TpStreamWriteRows(TpStream* stream, const TpImage* band) {
+  return NoThrow([&] {
+    if (!stream || !IsValidImage(band, -1)) return -1;
+    if (stream->processor.rowsIn() + band->height > stream->height) return -4;
+    return stream->processor.pushRows(ViewOf(band));
+  });
+}
+
+int TpStreamEnd(TpStream* stream) {
+  return NoThrow([&] {
+    if (!stream) return -1;
+    std::unique_ptr<TpStream> s(stream);
+    if (s->processor.rowsIn() != s->height) return -4;
+    int res = s->processor.finish();
+    s->writer.close();
+    return res;
+  });
+}
+
+void TpStreamAbort(TpStream* stream) { delete stream; }
+
+int TpProcessStreamToTiff(int width, int height, int channels,
+                          const TpParams* params, int bandRows,
+                          TpRowProvider provider, void* user,
+                          const wchar_t* tiffPath) {
+  return NoThrow([&] {
+    if (!provider) return -1;
+    // 行跨度要放进 TpImage::bytesPerLine（int），
+    // 溢出的宽度 / 通道数在分配前拒绝
+    const int stride = RowBytesOf(width, channels);
+    if (stride <= 0) return -1;
+    if (bandRows <= 0) bandRows = 256;
+
+    TpStream* raw = nullptr;
+    int res = TpStreamBegin(width, height, channels, params, tiffPath, &raw);
+    if (res != 0) return res;
+    std::unique_ptr<TpStream> stream(raw);
+
+    // 默认由库提供行带缓冲，回调也可以把 data 指向自己的内存
+    bandRows = std::min(bandRows, height);
+    std::vector<uint8_t> buffer(static_cast<size_t>(stride) * bandRows);
+
+    for (int y0 = 0; y0 < height; y0 += bandRows) {
+      const int rows = std::min(bandRows, height - y0);
+      TpImage band{buffer.data(), width, rows, channels, stride};
+      res = provider(user, y0, rows, &band);
+      if (res != 0) return res;
+      if (band.width != width || band.height != rows ||
+          band.channels != channels)
+        return -4;
+
+      res = TpStreamWriteRows(stream.get(), &band);
+      if (res != 0) return res;
+    }
+    return TpStreamEnd(stream.release());
+  });
+}
+
+int MchBmpTiffOutAsync(const uint8_t* pSrc, int nWidth, int nHeight,
+                       int nPixBits, int nBytePerLine, int nCHcnt,
+                       const wchar_t* szTiffFile, int flags,
+                       TpWriteCallback callback, void* user, TpWriteJob** job) {
+  return NoThrow([&] {
+    if (job) *job = nullptr;
+    if (!pSrc || nWidth <= 0 || nHeight <= 0 || nCHcnt < 4 || !szTiffFile)
+      return -1;
+    if (nPixBits != 8) return -2;
+    const int rowBytes = RowBytesOf(nWidth, nCHcnt);
+    if (rowBytes < 0 || nBytePerLine < rowBytes) return -5;
+
+    std::wstring path(szTiffFile);
+    return SubmitWrite(pSrc, nHeight, rowBytes, nBytePerLine, flags, callback,
+                       user, job,
+                       [=](const uint8_t* data, int bytesPerLine) {
+                         return WriteCmykSpots(data, nWidth, nHeight, nPixBits,
+                                               bytesPerLine, nCHcnt,
+                                               path.c_str());
+                       });
+  });
+}
+
+int TpWriteTiffAsync(const TpImage* img, int photometric, int hasAlpha,
+                     const wchar_t* tiffPath, int flags,
+                     TpWriteCallback callback, void* user, TpWriteJob** job) {
+  return NoThrow([&] {
+    if (job) *job = nullptr;
+    if (!IsValidImage(img, -1) || !tiffPath) return -1;
+    if (ColorChannelsOf(photometric) < 0) return -2;
+
+    const int width = img->width;
+    const int height = img->height;
+    const int channels = img->channels;
+    std::wstring path(tiffPath);
+    return SubmitWrite(
+        img->data, height, RowBytesOf(width, channels), img->bytesPerLine,
+        flags, callback, user, job,
+        [=](const uint8_t* data, int bytesPerLine) {
+          return WriteTiffRows(path.c_str(), width, height, channels,
+                               photometric, hasAlpha != 0, {}, [&](int y) {
+                                 return data +
+                                        static_cast<size_t>(y) * bytesPerLine;
+                               });
+        });
+  });
+}
+
+int TpJobWait(TpWriteJob* job, int timeoutMs) {
+  return NoThrow([&] {
+    if (!job || !job->job) return -1;
+    return job->job->wait(timeoutMs);
+  });
+}
+
+int TpJobPoll(TpWriteJob* job) { return TpJobWait(job, 0); }
+
+void TpJobRelease(TpWriteJob* job) { delete job; }
+
+int TpAsyncSetQueueDepth(int depth) {
+  return NoThrow([&] {
+    if (depth < 1) return -1;
+    AsyncWriteQueue::getInstance().setMaxInFlight(depth);
+    return 0;
+  });
+}
+
+void TpAsyncWaitAll() {
+  NoThrow([] {
+    AsyncWriteQueue::getInstance().waitAll();
+    return 0;
+  });
+}
+
+void TpAsyncShutdown() {
+  NoThrow([] {
+    AsyncWriteQueue::getInstance().shutdown();
+    return 0;
+  });
+}
 }
@@ -1,7 +1,10 @@
 #ifndef TIFFPROCESSLIBRARY_H
 #define TIFFPROCESSLIBRARY_H
 
+// C / C++ 共用头文件；C++ 另有 std::wstring_view 版本的 MchBmpTiffOut1
+#ifdef __cplusplus
 #include <string_view>
+#endif
 #ifdef _WIN32
 #ifdef TIFFPROCESSLIBRARY_EXPORTS
 #define TIFF_API __declspec(dllexport)
@@ -9,21 +12,168 @@
 #define TIFF_API __declspec(dllimport)
 #endif
 #else
-#define TIFF_API
+#define TIFF_API __attribute__((visibility("default")))
 #endif
 
-#include <cstdint>
+#include <stdint.h>
+#include <wchar.h>
 
-typedef std::uint8_t BYTE;
+typedef uint8_t BYTE;
 typedef BYTE* LPBYTE;
 
+// ---------------- 处理流水线 C 接口 ----------------
+// 所有图像都是调用方持有的交错 8bit 缓冲，库内只包一层视图，不做整幅拷贝
+
+// 颜色模型（与 TIFF Photometric 取值一致）
+enum TpPhotometric { TP_PHOTOMETRIC_RGB = 2, TP_PHOTOMETRIC_CMYK = 5 };
+
+// 黑度算法（与 BlacknessMethod 一致）
+enum TpBlacknessMethod {
+  TP_BLACKNESS_GRAY = 0,
+  TP_BLACKNESS_DARK_NEUTRAL = 1,
+  TP_BLACKNESS_MAX_CHANNEL = 2
+};
+
+typedef struct TpImage {
+  uint8_t* data;       // 第一行首地址
+  int width;
+  int height;
+  int channels;      // 每像素通道数（交错）
+  int bytesPerLine;  // 行跨度，>= width * channels，可含填充
+} TpImage;
+
+typedef struct TpParams {
+  int photometric;      // TpPhotometric
+  int alphaIndex;       // 输入中 Alpha 所在的 Extra 下标，无则 -1
+  int blacknessMethod;  // TpBlacknessMethod
+  int blacknessThresh;  // 去黑阈值（0~255）
+  int noiseArea;        // 去杂点最小面积（像素），<= 0 不去杂点
+  int whiteThresh;      // 补白阈值，<= 0 时同 blacknessThresh
+  int whiteOffset;      // 白墨收缩（< 0）/ 外扩（> 0），像素；流式接口不支持
+} TpParams;
+
+#ifdef __cplusplus
 extern "C" {
+#endif
 TIFF_API int MchBmpTiffOut(LPBYTE pSrc, int nWidth, int nHeight, int nPixBits,
                            int nBytePerLine, int nCHcnt, wchar_t* szTiffFile);
 
-TIFF_API int MchBmpTiffOut1(const std::uint8_t* data, int width, int height,
+#ifdef __cplusplus
+TIFF_API int MchBmpTiffOut1(const uint8_t* data, int width, int height,
                             int bitsPerChannel, int bytesPerLine,
                             int channelCount, std::wstring_view tiffPath);
+#endif
+
+// 默认参数：CMYK、MAX_CHANNEL、阈值 235、不去杂点、白墨不收缩
+TIFF_API void TpDefaultParams(TpParams* params);
+
+// 处理线程数（<= 0 取 CPU 核数），pinThreads 非 0 时工作线程绑核；
+// 所有接口共用同一个线程池，须在没有处理进行时调用
+TIFF_API void TpSetThreads(int workers, int pinThreads);
+
+// 颜色图 -> 黑度（blackness 为单通道，尺寸与 src 相同）
+TIFF_API int TpCalcBlackness(const TpImage* src, int photometric, int method,
+                             TpImage* blackness);
+
+// 黑度 -> 透明度蒙版（黑度 > thresh 为 0，其余 255）
+TIFF_API int TpRemoveBlack(const TpImage* blackness, int thresh,
+                           TpImage* mask);
+
+// 去掉面积小于 minArea 的连通区域（8 连通），mask 与 out 可为同一缓冲
+TIFF_API int TpRemoveSmall(const TpImage* mask, int minArea, TpImage* out);
+
+// 补白强度（0~255，透明处为 0）
+TIFF_API int TpWhiteCompensation(const TpImage* blackness, const TpImage* mask,
+                                 int thresh, TpImage* white);
+
+// 输出通道：颜色 | Alpha | 其余旧 Extra | extras[0..extraCount)
+// dst->channels 必须等于上述通道数
+TIFF_API int TpAppendChannels(const TpImage* src, int photometric,
+                              int alphaIndex, const TpImage* alpha,
+                              const TpImage* const* extras, int extraCount,
+                              TpImage* dst);
+
+// 写 TIFF：第一个 Extra 记为 Alpha（hasAlpha 非 0 时），
+// 其余为专色，并生成 Photoshop 通道名资源
+TIFF_API int TpWriteTiff(const TpImage* img, int photometric, int hasAlpha,
+                         const wchar_t* tiffPath);
+
+// 完整流水线：src -> dst（颜色 | Alpha | 旧 Extra | 白墨 W1 | W2）
+TIFF_API int TpProcess(const TpImage* src, const TpParams* params,
+                       TpImage* dst);
+
+// 完整流水线并直接写 TIFF，逐行组装输出，不分配整幅输出缓冲
+TIFF_API int TpProcessToTiff(const TpImage* src, const TpParams* params,
+                             const wchar_t* tiffPath);
+
+// ---------------- 流式接口 ----------------
+// 行带按顺序送入，处理后按条带写出；只缓存去杂点尚未确定的少量行，
+// 两侧峰值内存都是几个行带而不是整页
+typedef struct TpStream TpStream;
+
+// 推送式：Begin -> WriteRows（任意行数，累计 height 行）-> End
+TIFF_API int TpStreamBegin(int width, int height, int channels,
+                           const TpParams* params, const wchar_t* tiffPath,
+                           TpStream** stream);
+// band 在调用返回后即可复用
+TIFF_API int TpStreamWriteRows(TpStream* stream, const TpImage* band);
+// 输出剩余行、关闭文件并释放句柄（出错也会释放）
+TIFF_API int TpStreamEnd(TpStream* stream);
+// 放弃并释放句柄，已写的文件不完整
+TIFF_API void TpStreamAbort(TpStream* stream);
+
+// 拉取式：库按顺序请求 [y0, y0 + rows) 行，回调填充 band->data，
+// 或把 band->data / bytesPerLine 指向自己的内存（到下次回调前有效）；
+// 回调返回非 0 时中止
+typedef int (*TpRowProvider)(void* user, int y0, int rows, TpImage* band);
+
+// bandRows <= 0 时取 256
+TIFF_API int TpProcessStreamToTiff(int width, int height, int channels,
+                                   const TpParams* params, int bandRows,
+                                   TpRowProvider provider, void* user,
+                                   const wchar_t* tiffPath);
+
+// ---------------- 异步写出 ----------------
+// 提交后立即返回，由库内 I/O 线程编码写盘；未完成的写任务数有上限
+// （默认 2，双缓冲），满了提交会阻塞，直到前一页写完
+typedef struct TpWriteJob TpWriteJob;
+
+// 在 I/O 线程上调用，result 与同步接口的返回值相同
+typedef void (*TpWriteCallback)(void* user, int result);
+
+enum TpAsyncFlags {
+  TP_ASYNC_COPY = 0,   // 提交时拷贝数据，返回后调用方即可复用缓冲
+  TP_ASYNC_BORROW = 1  // 不拷贝，缓冲须保持有效直到任务完成
+};
+
+// TpJobWait / TpJobPoll 在任务未完成时返回该值
+enum { TP_JOB_PENDING = 1 };
+
+// job 可为空（只用回调）；非空时须调用 TpJobRelease 释放
+TIFF_API int MchBmpTiffOutAsync(const uint8_t* pSrc, int nWidth,
+                                int nHeight, int nPixBits, int nBytePerLine,
+                                int nCHcnt, const wchar_t* szTiffFile,
+                                int flags, TpWriteCallback callback,
+                                void* user, TpWriteJob** job);
+
+TIFF_API int TpWriteTiffAsync(const TpImage* img, int photometric,
+                              int hasAlpha, const wchar_t* tiffPath, int flags,
+                              TpWriteCallback callback, void* user,
+                              TpWriteJob** job);
+
+// timeoutMs < 0 无限等待；返回写出结果，超时返回 TP_JOB_PENDING
+TIFF_API int TpJobWait(TpWriteJob* job, int timeoutMs);
+TIFF_API int TpJobPoll(TpWriteJob* job);
+// 只释放句柄，不取消任务
+TIFF_API void TpJobRelease(TpWriteJob* job);
+
+// 未完成写任务上限（>= 1）
+TIFF_API int TpAsyncSetQueueDepth(int depth);
+TIFF_API void TpAsyncWaitAll(void);
+// 写完剩余任务并结束 I/O 线程，卸载库之前调用
+TIFF_API void TpAsyncShutdown(void);
+#ifdef __cplusplus
 }
+#endif
 
 #endif  // TIFFPROCESSLIBRARY_H
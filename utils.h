@@ -1,11 +1,35 @@
 #ifndef UTILS_H
 #define UTILS_H
+#include <opencv2/opencv.hpp>
+
+#ifdef TIFFPROCESS_NO_QT
+// 无 Qt 的构建（TiffProcessLibrary）：日志输出到 stderr，格式与 qDebug 一致
+#include <iostream>
+#include <sstream>
+
+class DebugLine {
+public:
+  DebugLine(const char *file, int line) {
+    _oss << "[ " << file << ":" << line << " ]";
+  }
+  ~DebugLine() { std::cerr << _oss.str() << std::endl; }
+
+  template <typename T> DebugLine &operator<<(const T &v) {
+    _oss << ' ' << v;
+    return *this;
+  }
+
+private:
+  std::ostringstream _oss;
+};
+
+#define DEBUG DebugLine(__FILE__, __LINE__)
+#else
 #include <qfileinfo.h>
 #include <qimage.h>
 #include <qpixmap.h>
 
 #include <QDebug>
-#include <opencv2/opencv.hpp>
 
 #define DEBUG qDebug().noquote() << "[" << __FILE__ << ":" << __LINE__ << "]"
 
@@ -44,4 +68,5 @@ inline QPixmap cvMatToQPixmap(const cv::Mat& mat) {
 
   return QPixmap::fromImage(img.copy());  // copy 保证数据独立
 }
+#endif  // TIFFPROCESS_NO_QT
 #endif  // UTILS_H